@@ -0,0 +1,273 @@
+#include <Util/Testing.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <Util/Arena.hpp>
+#include <Util/Buffer.hpp>
+#include <Util/DynamicArray2D.hpp>
+#include <Util/FixedPool.hpp>
+#include <Util/MemoryResource.hpp>
+#include <Util/MultidimensionalArray.hpp>
+#include <Util/UString.hpp>
+#include <Util/UStringBuilder.hpp>
+
+#include <cstdint>
+#include <list>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+TEST_CASE(arena_allocate) {
+    Util::Arena arena { 1024 };
+    auto a = static_cast<uint8_t*>(arena.allocate(10, 1));
+    auto b = static_cast<uint8_t*>(arena.allocate(8, 8));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(b) % 8, 0u);
+    EXPECT(b >= a + 10);
+    EXPECT_EQ(arena.used_bytes(), 18u);
+    EXPECT_EQ(arena.reserved_bytes(), 1024u);
+
+    // Doesn't fit in the current chunk
+    (void)arena.allocate(1010, 1);
+    EXPECT_EQ(arena.reserved_bytes(), 2048u);
+
+    // Bigger than a chunk
+    auto big = static_cast<uint8_t*>(arena.allocate(5000, 64));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(big) % 64, 0u);
+    std::fill(big, big + 5000, 0x55);
+    EXPECT(arena.reserved_bytes() >= 2048u + 5000u);
+
+    // Chunks are reused after reset
+    auto reserved = arena.reserved_bytes();
+    arena.reset();
+    EXPECT_EQ(arena.used_bytes(), 0u);
+    EXPECT_EQ(static_cast<uint8_t*>(arena.allocate(10, 1)), a);
+    (void)arena.allocate(1010, 1);
+    (void)arena.allocate(5000, 64);
+    EXPECT_EQ(arena.reserved_bytes(), reserved);
+    return {};
+}
+
+TEST_CASE(arena_scope) {
+    Util::Arena arena { 1024 };
+    (void)arena.allocate(100, 1);
+    void* inside = nullptr;
+    {
+        Util::Arena::Scope scope { arena };
+        inside = arena.allocate(100, 1);
+        (void)arena.allocate(2000, 1);
+        EXPECT_EQ(arena.used_bytes(), 2200u);
+    }
+    EXPECT_EQ(arena.used_bytes(), 100u);
+    EXPECT_EQ(arena.allocate(100, 1), inside);
+    return {};
+}
+
+TEST_CASE(arena_upstream) {
+    CountingResource upstream;
+    {
+        Util::Arena arena { 1024, &upstream };
+        std::pmr::vector<int> vector { &arena };
+        for (int s = 0; s < 1000; s++) {
+            vector.push_back(s);
+        }
+        EXPECT_EQ(vector[999], 999);
+        EXPECT(upstream.allocated_bytes > 0);
+        EXPECT_EQ(upstream.allocated_bytes, arena.reserved_bytes());
+    }
+    EXPECT_EQ(upstream.allocated_bytes, 0u);
+    return {};
+}
+
+namespace {
+
+struct Node {
+    int value;
+    Node* next;
+};
+
+}
+
+TEST_CASE(fixed_pool) {
+    CountingResource upstream;
+    {
+        Util::FixedPool<Node, 16> pool { &upstream };
+        std::vector<Node*> nodes;
+        for (int s = 0; s < 100; s++) {
+            nodes.push_back(pool.create(s, nodes.empty() ? nullptr : nodes.back()));
+        }
+        EXPECT_EQ(pool.object_count(), 100u);
+        EXPECT_EQ(nodes[50]->value, 50);
+        EXPECT_EQ(nodes[50]->next, nodes[49]);
+        auto allocations = upstream.allocations;
+        EXPECT_EQ(allocations, 7u);
+
+        // Freed slots are reused
+        auto freed = nodes[10];
+        pool.destroy(freed);
+        EXPECT_EQ(pool.object_count(), 99u);
+        nodes[10] = pool.create(-1, nullptr);
+        EXPECT_EQ(nodes[10], freed);
+
+        for (auto node : nodes) {
+            pool.destroy(node);
+        }
+        EXPECT_EQ(pool.object_count(), 0u);
+        for (int s = 0; s < 100; s++) {
+            nodes[s] = pool.create(s, nullptr);
+        }
+        EXPECT_EQ(upstream.allocations, allocations);
+        for (auto node : nodes) {
+            pool.destroy(node);
+        }
+    }
+    EXPECT_EQ(upstream.allocated_bytes, 0u);
+    return {};
+}
+
+namespace {
+
+// Big enough for a list node.
+struct ListNodeStorage {
+    void* pointers[4];
+};
+
+}
+
+TEST_CASE(fixed_pool_resource) {
+    CountingResource upstream;
+    {
+        Util::FixedPool<ListNodeStorage> pool { &upstream };
+        std::pmr::list<int> list { &pool };
+        for (int s = 0; s < 100; s++) {
+            list.push_back(s);
+        }
+        EXPECT_EQ(pool.object_count(), 100u);
+
+        // Too big for a slot, goes to upstream.
+        auto allocations = upstream.allocations;
+        std::pmr::vector<int> vector { 100, &pool };
+        EXPECT_EQ(upstream.allocations, allocations + 1);
+        EXPECT_EQ(pool.object_count(), 100u);
+
+        list.clear();
+        EXPECT_EQ(pool.object_count(), 0u);
+    }
+    EXPECT_EQ(upstream.allocated_bytes, 0u);
+    return {};
+}
+
+TEST_CASE(scoped_memory_resource) {
+    CountingResource resource;
+    EXPECT_EQ(Util::current_memory_resource(), std::pmr::get_default_resource());
+    {
+        Util::ScopedMemoryResource scope { resource };
+        EXPECT_EQ(Util::current_memory_resource(), &resource);
+
+        Buffer buffer;
+        buffer.insert(0, { 1, 2, 3 });
+        EXPECT_EQ(buffer.resource(), &resource);
+
+        Util::UString string { std::string(100, 'x') };
+        Util::UString substring = string.substring(10, 50);
+        Util::UStringBuilder builder;
+        builder.append(string);
+        builder.append(" and more");
+        auto built = builder.release_string();
+        EXPECT_EQ(built.size(), 109u);
+        EXPECT_EQ(built.substring(100).encode(), " and more");
+
+        Util::MultidimensionalArray<int, 4, 4> array { 5 };
+        EXPECT_EQ(array.get(3u, 3u), 5);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+        Util::DynamicArray2D<int, 4, 4> array_2d { 5 };
+        EXPECT_EQ(array_2d.get(3, 3), 5);
+#pragma GCC diagnostic pop
+
+        EXPECT(resource.allocations >= 6u);
+        EXPECT(resource.allocated_bytes > 0u);
+    }
+    EXPECT_EQ(resource.allocated_bytes, 0u);
+    EXPECT_EQ(Util::current_memory_resource(), std::pmr::get_default_resource());
+
+    // Explicit resource has priority.
+    CountingResource explicit_resource;
+    auto allocations = resource.allocations;
+    {
+        Util::ScopedMemoryResource scope { resource };
+        Util::UStringBuilder builder { &explicit_resource };
+        builder.append(std::string(100, 'x'));
+        Util::MultidimensionalArray<int, 4, 4> array { 0, &explicit_resource };
+        auto string = builder.release_string();
+        EXPECT_EQ(resource.allocations, allocations);
+        EXPECT(explicit_resource.allocated_bytes > 0u);
+    }
+    EXPECT_EQ(explicit_resource.allocated_bytes, 0u);
+    return {};
+}
+
+TEST_CASE(scoped_memory_resource_arena) {
+    Util::Arena arena;
+    Util::ScopedMemoryResource scope { arena };
+    Util::UString string;
+    {
+        Util::Arena::Scope arena_scope { arena };
+        Util::UStringBuilder builder;
+        for (size_t s = 0; s < 100; s++) {
+            builder.appendff("{},", s);
+        }
+        auto temporary = builder.release_string();
+        EXPECT(arena.used_bytes() > 0u);
+
+        // Copy the data, so that it survives the arena scope.
+        Util::ScopedMemoryResource default_scope { *std::pmr::get_default_resource() };
+        string = Util::UString { temporary.substring(0, 20).span() };
+    }
+    EXPECT_EQ(arena.used_bytes(), 0u);
+    EXPECT_EQ(string.encode(), "0,1,2,3,4,5,6,7,8,9,");
+    return {};
+}
+
+// Parse a config-like text into key/value pairs, as a model of a workload
+// that creates a lot of short-lived strings.
+static std::string const& parse_benchmark_text() {
+    static std::string text = [] {
+        std::string text;
+        for (size_t s = 0; s < 1000; s++) {
+            text += "some_setting_number_" + std::to_string(s) + " = value of the setting " + std::to_string(s * 7) + "\n";
+        }
+        return text;
+    }();
+    return text;
+}
+
+static size_t volatile parsed_size;
+
+static void parse_benchmark_workload() {
+    Util::UString text { parse_benchmark_text() };
+    std::pmr::vector<std::pair<Util::UString, Util::UString>> pairs { Util::current_memory_resource() };
+    text.for_each_line([&](std::span<uint32_t const> line_span) {
+        Util::UString line { line_span };
+        auto equals = line.find("=");
+        if (!equals) {
+            return;
+        }
+        Util::UStringBuilder key;
+        key.append("config.");
+        key.append(line.substring(0, *equals - 1));
+        pairs.emplace_back(key.release_string(), line.substring(*equals + 2));
+    });
+    parsed_size = pairs.size();
+}
+
+BENCHMARK(parse_default_resource) {
+    parse_benchmark_workload();
+}
+
+BENCHMARK(parse_arena) {
+    static Util::Arena arena;
+    Util::ScopedMemoryResource scope { arena };
+    Util::Arena::Scope arena_scope { arena };
+    parse_benchmark_workload();
+}
@@ -0,0 +1,165 @@
+#include <Util/Testing.hpp>
+
+#include <Util/Stream.hpp>
+
+#include <random>
+#include <vector>
+
+struct BitField {
+    uint64_t value;
+    unsigned bits;
+};
+
+static std::vector<BitField> random_fields(size_t count) {
+    std::mt19937_64 random { 1234 };
+    std::vector<BitField> fields(count);
+    for (auto& field : fields) {
+        field.bits = random() % 65;
+        field.value = field.bits == 0 ? 0 : random() >> (64 - field.bits);
+    }
+    return fields;
+}
+
+TEST_CASE(bit_order) {
+    Util::WritableMemoryStream out;
+    Writer writer { out };
+    Util::BitWriter bit_writer { writer };
+    EXPECT_NO_ERROR(bit_writer.write_bit(true));
+    EXPECT_NO_ERROR(bit_writer.write_bits(0b10, 2));
+    EXPECT_NO_ERROR(bit_writer.write_bits(0x1ff, 9));
+    EXPECT_EQ(bit_writer.bit_count(), 12u);
+    EXPECT_NO_ERROR(bit_writer.flush());
+    EXPECT_EQ(bit_writer.bit_count(), 16u);
+    EXPECT_EQ(out.data().size(), 2u);
+    EXPECT_EQ(out.data()[0], 0b11111101);
+    EXPECT_EQ(out.data()[1], 0b00001111);
+    return {};
+}
+
+TEST_CASE(read_write) {
+    auto fields = random_fields(10000);
+    Util::WritableMemoryStream out;
+    Writer writer { out };
+    Util::BitWriter bit_writer { writer };
+    for (auto field : fields) {
+        EXPECT_NO_ERROR(bit_writer.write_bits(field.value, field.bits));
+    }
+    EXPECT_NO_ERROR(bit_writer.flush());
+
+    // Byte aligned data after bits
+    EXPECT_NO_ERROR(bit_writer.write_bits(5, 3));
+    EXPECT_NO_ERROR(bit_writer.flush());
+    EXPECT_NO_ERROR(writer.write_little_endian<uint16_t>(0x1234));
+
+    size_t total_bits = 0;
+    for (auto field : fields) {
+        total_bits += field.bits;
+    }
+    EXPECT_EQ(out.data().size(), (total_bits + 7) / 8 + 1 + 2);
+
+    auto in = Util::ReadableMemoryStream::borrow(out.data());
+    BinaryReader reader { in };
+    Util::BitReader bit_reader { reader };
+    for (auto field : fields) {
+        EXPECT_EQ(MUST(bit_reader.read_bits(field.bits)), field.value);
+    }
+    bit_reader.align_to_byte();
+    EXPECT_EQ(MUST(bit_reader.read_bits(3)), 5u);
+    bit_reader.align_to_byte();
+    EXPECT_EQ(MUST(reader.read_little_endian<uint16_t>()), 0x1234);
+    EXPECT(bit_reader.read_bits(1).is_error());
+    return {};
+}
+
+TEST_CASE(read_across_buffers) {
+    auto fields = random_fields(10000);
+    {
+        auto stream = Util::WritableFileStream::open("/tmp/essautil-bitstream-test", { .truncate = true }).release_value();
+        Util::BufferedWriter buffered { stream };
+        Writer writer { buffered };
+        Util::BitWriter bit_writer { writer };
+        for (auto field : fields) {
+            EXPECT_NO_ERROR(bit_writer.write_bits(field.value, field.bits));
+        }
+        EXPECT_NO_ERROR(bit_writer.flush());
+    }
+
+    auto in = MUST(Util::ReadableFileStream::open("/tmp/essautil-bitstream-test"));
+    BinaryReader reader { in };
+    Util::BitReader bit_reader { reader };
+    for (auto field : fields) {
+        EXPECT_EQ(MUST(bit_reader.read_bits(field.bits)), field.value);
+    }
+    return {};
+}
+
+// 12-bit samples (e.g from an ADC), stored in 1.5 bytes instead of 2.
+constexpr size_t BitStreamBenchmarkCount = 1'000'000;
+constexpr unsigned BitStreamBenchmarkBits = 12;
+
+static std::vector<uint16_t> const& benchmark_samples() {
+    static auto samples = [] {
+        std::mt19937 random { 1234 };
+        std::vector<uint16_t> samples(BitStreamBenchmarkCount);
+        for (auto& sample : samples) {
+            sample = random() % (1 << BitStreamBenchmarkBits);
+        }
+        return samples;
+    }();
+    return samples;
+}
+
+static Util::Buffer const& benchmark_packed_data() {
+    static Util::Buffer data = [] {
+        Util::WritableMemoryStream out;
+        Writer writer { out };
+        Util::BitWriter bit_writer { writer };
+        for (auto sample : benchmark_samples()) {
+            MUST(bit_writer.write_bits(sample, BitStreamBenchmarkBits));
+        }
+        MUST(bit_writer.flush());
+        return out.release_buffer();
+    }();
+    return data;
+}
+
+static uint64_t volatile bit_stream_sink;
+
+// Throughput is in samples.
+BENCHMARK_THROUGHPUT(write_bits, BitStreamBenchmarkCount) {
+    Util::WritableMemoryStream out;
+    out.reserve(BitStreamBenchmarkCount * 2);
+    Writer writer { out };
+    Util::BitWriter bit_writer { writer };
+    for (auto sample : benchmark_samples()) {
+        MUST(bit_writer.write_bits(sample, BitStreamBenchmarkBits));
+    }
+    MUST(bit_writer.flush());
+    bit_stream_sink = out.data().size();
+}
+
+BENCHMARK_THROUGHPUT(read_bits, BitStreamBenchmarkCount) {
+    auto in = Util::ReadableMemoryStream::borrow(benchmark_packed_data().span());
+    BinaryReader reader { in };
+    Util::BitReader bit_reader { reader };
+    uint64_t sum = 0;
+    for (size_t s = 0; s < BitStreamBenchmarkCount; s++) {
+        sum += MUST(bit_reader.read_bits(BitStreamBenchmarkBits));
+    }
+    bit_stream_sink = sum;
+}
+
+BENCHMARK_THROUGHPUT(read_unpacked, BitStreamBenchmarkCount) {
+    static Util::Buffer data = [] {
+        Util::WritableMemoryStream out;
+        MUST(Writer { out }.write_little_endian_array<uint16_t>(benchmark_samples()));
+        return out.release_buffer();
+    }();
+    auto in = Util::ReadableMemoryStream::borrow(data.span());
+    BinaryReader reader { in };
+    uint64_t sum = 0;
+    for (size_t s = 0; s < BitStreamBenchmarkCount; s++) {
+        sum += MUST(reader.read_little_endian<uint16_t>());
+    }
+    bit_stream_sink = sum;
+}
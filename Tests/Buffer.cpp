@@ -1,7 +1,12 @@
 #include <Util/Testing.hpp>
 
+#include "TestHelpers.hpp"
+
 #include <Util/Buffer.hpp>
 
+#include <array>
+#include <memory_resource>
+
 TEST_CASE(constructors) {
     // Default
     {
@@ -73,9 +78,15 @@ TEST_CASE(move) {
         Buffer buffer1 = Buffer::filled(16, 'a');
         Buffer buffer2 { std::move(buffer1) };
         EXPECT_EQ(buffer1.size(), 0ull);
+        EXPECT_EQ(buffer1.capacity(), 0ull);
         EXPECT_EQ(buffer2.size(), 16ull);
+        EXPECT_EQ(buffer2.capacity(), 16ull);
         EXPECT_EQ(buffer2[0], 'a');
         EXPECT_EQ(buffer2[15], 'a');
+
+        // Capacity must be moved too, otherwise this would lose data.
+        buffer2.resize_uninitialized(20);
+        EXPECT_EQ(buffer2[15], 'a');
     }
 
     // Move assignment
@@ -85,6 +96,7 @@ TEST_CASE(move) {
         buffer2 = std::move(buffer1);
         EXPECT_EQ(buffer1.size(), 0ull);
         EXPECT_EQ(buffer2.size(), 16ull);
+        EXPECT_EQ(buffer2.capacity(), 16ull);
         EXPECT_EQ(buffer2[0], 'a');
         EXPECT_EQ(buffer2[15], 'a');
     }
@@ -154,3 +166,99 @@ TEST_CASE(resize_uninitialized) {
     }
     return {};
 }
+
+TEST_CASE(growth) {
+    Buffer buffer;
+    buffer.append(0x12);
+    auto data = buffer.begin();
+    buffer.append(0x34);
+    EXPECT_EQ(buffer.capacity(), 2ull);
+    buffer.append(std::span<uint8_t const> { { 0x56, 0x78, 0x9a } });
+    EXPECT_EQ(buffer.capacity(), 5ull);
+    buffer.append(0xbc);
+    EXPECT_EQ(buffer.capacity(), 10ull);
+    EXPECT_EQ(buffer, (Buffer { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc }));
+
+    // Shrinking and clearing keep the storage.
+    data = buffer.begin();
+    buffer.resize_uninitialized(2);
+    buffer.take_from_back();
+    buffer.clear();
+    EXPECT_EQ(buffer.begin(), data);
+    EXPECT_EQ(buffer.capacity(), 10ull);
+    buffer.shrink_to_fit();
+    EXPECT_EQ(buffer.capacity(), 0ull);
+    return {};
+}
+
+TEST_CASE(insert_in_place) {
+    Buffer buffer { 0x12, 0x9a };
+    buffer.ensure_capacity(10);
+    auto data = buffer.begin();
+    buffer.insert(1, { 0x34, 0x56, 0x78 });
+    EXPECT_EQ(buffer.begin(), data);
+    EXPECT_EQ(buffer, (Buffer { 0x12, 0x34, 0x56, 0x78, 0x9a }));
+
+    // Inserting a part of itself
+    buffer.insert(0, buffer.span().subspan(3, 2));
+    EXPECT_EQ(buffer, (Buffer { 0x78, 0x9a, 0x12, 0x34, 0x56, 0x78, 0x9a }));
+    buffer.insert(2, buffer.span());
+    EXPECT_EQ(buffer.size(), 14ull);
+    EXPECT_EQ(buffer, (Buffer { 0x78, 0x9a, 0x78, 0x9a, 0x12, 0x34, 0x56, 0x78, 0x9a, 0x12, 0x34, 0x56, 0x78, 0x9a }));
+    return {};
+}
+
+TEST_CASE(memory_resource) {
+    CountingResource resource;
+    {
+        Buffer buffer { &resource };
+        for (size_t s = 0; s < 100000; s++) {
+            buffer.append(s);
+        }
+        EXPECT_EQ(buffer.resource(), &resource);
+        EXPECT_EQ(resource.allocated_bytes, buffer.capacity());
+        EXPECT(resource.allocations < 20);
+
+        // Moving between the same resources doesn't copy.
+        auto data = buffer.begin();
+        Buffer moved { std::move(buffer) };
+        EXPECT_EQ(moved.begin(), data);
+        EXPECT_EQ(moved.resource(), &resource);
+        buffer = std::move(moved);
+        EXPECT_EQ(buffer.begin(), data);
+
+        // Moving to a buffer with a different resource copies.
+        Buffer other;
+        other = std::move(buffer);
+        EXPECT(other.begin() != data);
+        EXPECT_EQ(other.resource(), std::pmr::get_default_resource());
+        EXPECT_EQ(other.size(), 100000ull);
+
+        // Copies use the default resource.
+        Buffer copy { other };
+        EXPECT_EQ(copy.resource(), std::pmr::get_default_resource());
+    }
+    EXPECT_EQ(resource.allocated_bytes, 0ull);
+
+    auto filled = Buffer::filled(10, 0xab, &resource);
+    EXPECT_EQ(filled.resource(), &resource);
+    EXPECT_EQ(resource.allocated_bytes, 10ull);
+    return {};
+}
+
+constexpr size_t AppendBenchmarkSize = 16 * 1024 * 1024;
+
+BENCHMARK_THROUGHPUT(append_bytes, AppendBenchmarkSize) {
+    Buffer buffer;
+    for (size_t s = 0; s < AppendBenchmarkSize; s++) {
+        buffer.append(s);
+    }
+}
+
+BENCHMARK_THROUGHPUT(append_spans, AppendBenchmarkSize) {
+    Buffer buffer;
+    std::array<uint8_t, 100> data {};
+    for (size_t s = 0; s < AppendBenchmarkSize / data.size(); s++) {
+        buffer.append(data);
+    }
+}
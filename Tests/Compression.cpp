@@ -0,0 +1,349 @@
+#include <Util/Testing.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <Util/Stream.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> random_bytes(size_t size, uint8_t max = 255) {
+    std::mt19937 random { 1234 };
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data) {
+        byte = random() % (max + 1);
+    }
+    return data;
+}
+
+static ErrorOr<void, __TestSuite::TestError> expect_round_trip(std::span<uint8_t const> data) {
+    auto const& codec = Util::Lz4Codec::the();
+    std::vector<uint8_t> compressed(codec.max_compressed_size(data.size()));
+    compressed.resize(codec.compress(data, compressed));
+    std::vector<uint8_t> decompressed(data.size());
+    EXPECT_NO_ERROR(codec.decompress(compressed, decompressed));
+    EXPECT(std::equal(data.begin(), data.end(), decompressed.begin()));
+    return {};
+}
+
+TEST_CASE(lz4_round_trip) {
+    TRY(expect_round_trip({}));
+    TRY(expect_round_trip(bytes_of("a")));
+    TRY(expect_round_trip(bytes_of("abcabcabcabc")));
+    TRY(expect_round_trip(bytes_of("abcabcabcabcabcabcabcabcabcabcabcabcabcabcabcabcabc")));
+    TRY(expect_round_trip(std::vector<uint8_t>(100000, 'x')));
+    TRY(expect_round_trip(random_bytes(100000)));
+    TRY(expect_round_trip(random_bytes(100000, 3)));
+
+    // Matches further than the maximum offset
+    auto far = random_bytes(200000);
+    std::copy(far.begin(), far.begin() + 1000, far.begin() + 100000);
+    TRY(expect_round_trip(far));
+
+    // Long literal and match lengths
+    std::string text;
+    for (size_t s = 0; s < 1000; s++) {
+        text += std::string(s % 300, 'a' + s % 26) + std::to_string(s);
+    }
+    TRY(expect_round_trip(bytes_of(text)));
+    return {};
+}
+
+TEST_CASE(lz4_format) {
+    // "abc", then a match of 6 bytes at offset 3, then "!".
+    uint8_t block[] { 0x32, 'a', 'b', 'c', 3, 0, 0x10, '!' };
+    std::string output(10, '\0');
+    EXPECT_NO_ERROR(Util::Lz4Codec::the().decompress(block, { reinterpret_cast<uint8_t*>(output.data()), output.size() }));
+    EXPECT_EQ(output, "abcabcabc!");
+
+    // Wrong output size
+    EXPECT(Util::Lz4Codec::the().decompress(block, { reinterpret_cast<uint8_t*>(output.data()), 9 }).is_error());
+
+    // Offset before start of the output
+    uint8_t bad_offset[] { 0x32, 'a', 'b', 'c', 4, 0, 0x10, '!' };
+    EXPECT(Util::Lz4Codec::the().decompress(bad_offset, { reinterpret_cast<uint8_t*>(output.data()), output.size() }).is_error());
+    return {};
+}
+
+TEST_CASE(lz4_corrupted) {
+    auto const& codec = Util::Lz4Codec::the();
+    auto data = random_bytes(10000, 3);
+    std::vector<uint8_t> compressed(codec.max_compressed_size(data.size()));
+    compressed.resize(codec.compress(data, compressed));
+
+    // Garbage must be detected or at least not crash.
+    std::mt19937 random { 1234 };
+    std::vector<uint8_t> output(data.size());
+    for (size_t s = 0; s < 1000; s++) {
+        auto corrupted = compressed;
+        corrupted[random() % corrupted.size()] ^= 1 << random() % 8;
+        (void)codec.decompress(corrupted, output);
+    }
+    EXPECT(codec.decompress(std::span { compressed }.first(compressed.size() / 2), output).is_error());
+    return {};
+}
+
+TEST_CASE(compressing_streams) {
+    std::string text;
+    for (size_t s = 0; s < 10000; s++) {
+        text += "Line " + std::to_string(s) + "\n";
+    }
+
+    Util::WritableMemoryStream compressed;
+    {
+        Util::CompressingWritableStream out { compressed, Util::Lz4Codec::the(), 1000 };
+        Writer writer { out };
+        EXPECT_NO_ERROR(writer.write_little_endian<uint32_t>(text.size()));
+        EXPECT_NO_ERROR(writer.write_all(bytes_of(text).first(500)));
+        EXPECT_NO_ERROR(writer.write_all(bytes_of(text).subspan(500)));
+        EXPECT_NO_ERROR(out.finish());
+        EXPECT_EQ(out.compressed_size(), compressed.data().size());
+        EXPECT(compressed.data().size() < text.size() / 2);
+        EXPECT(out.seek(0).is_error());
+    }
+
+    auto in = Util::ReadableMemoryStream::borrow(compressed.data());
+    Util::DecompressingReadableStream decompressed { in };
+    BinaryReader reader { decompressed };
+    EXPECT_EQ(MUST(reader.read_little_endian<uint32_t>()), text.size());
+    std::string read(text.size(), '\0');
+    EXPECT(MUST(reader.read_all({ reinterpret_cast<uint8_t*>(read.data()), read.size() })));
+    EXPECT_EQ(read, text);
+    EXPECT(!MUST(reader.get()));
+    EXPECT(decompressed.is_eof());
+    return {};
+}
+
+TEST_CASE(compressing_streams_incompressible) {
+    auto data = random_bytes(10000);
+    Util::WritableMemoryStream compressed;
+    {
+        Util::CompressingWritableStream out { compressed, Util::Lz4Codec::the(), 4096 };
+        EXPECT_NO_ERROR(Writer { out }.write_all(data));
+    }
+    // Stored as is, with 3 frame headers.
+    EXPECT_EQ(compressed.data().size(), data.size() + 3 * Util::CompressionFrame::HeaderSize);
+
+    auto in = Util::ReadableMemoryStream::borrow(compressed.data());
+    Util::DecompressingReadableStream decompressed { in };
+    std::vector<uint8_t> read(data.size());
+    EXPECT(MUST(BinaryReader { decompressed }.read_all(read)));
+    EXPECT(read == data);
+    return {};
+}
+
+TEST_CASE(compressing_stream_write_error) {
+    // Accepts at most 3 bytes at once, and fails the write number `fail_at`.
+    struct FlakyStream : public Util::WritableMemoryStream {
+        explicit FlakyStream(size_t fail_at)
+            : m_fail_at(fail_at) { }
+
+        virtual OsErrorOr<size_t> write(std::span<uint8_t const> data) override {
+            if (m_writes++ == m_fail_at) {
+                return OsError { EIO, "FlakyStream::write" };
+            }
+            return WritableMemoryStream::write(data.first(std::min<size_t>(data.size(), 3)));
+        }
+
+        size_t m_fail_at;
+        size_t m_writes = 0;
+    };
+
+    auto decompress = [](std::span<uint8_t const> data) {
+        auto in = Util::ReadableMemoryStream::borrow(data);
+        Util::DecompressingReadableStream decompressed { in };
+        std::string read;
+        char chunk[100];
+        while (auto size = MUST(decompressed.read({ reinterpret_cast<uint8_t*>(chunk), sizeof(chunk) }))) {
+            read.append(chunk, size);
+        }
+        return read;
+    };
+
+    for (size_t fail_at = 0; fail_at < 10; fail_at++) {
+        FlakyStream compressed { fail_at };
+        Util::CompressingWritableStream out { compressed, Util::Lz4Codec::the(), 8 };
+        EXPECT_NO_ERROR(Writer { out }.write_all(bytes_of("abcd")));
+
+        // write_all() retries only the part that wasn't accepted, and the
+        // frame is written where it stopped.
+        EXPECT_NO_ERROR(Writer { out }.write_all(bytes_of("efghijkl")));
+        auto result = out.finish();
+        if (result.is_error()) {
+            EXPECT_EQ(result.release_error().error, EIO);
+            EXPECT_NO_ERROR(out.finish());
+        }
+        EXPECT_EQ(out.compressed_size(), compressed.data().size());
+        EXPECT_EQ(decompress(compressed.data()), "abcdefghijkl");
+    }
+
+    // Partial writes report the accepted count.
+    {
+        FlakyStream compressed { 0 };
+        Util::CompressingWritableStream out { compressed, Util::Lz4Codec::the(), 8 };
+        EXPECT_EQ(MUST(out.write(bytes_of("abcd"))), 4u);
+        EXPECT_EQ(MUST(out.write(bytes_of("efghijkl"))), 4u);
+        EXPECT_EQ(MUST(out.write(bytes_of("ijkl"))), 4u);
+        EXPECT_NO_ERROR(out.finish());
+        EXPECT_EQ(decompress(compressed.data()), "abcdefghijkl");
+    }
+    {
+        FlakyStream compressed { 0 };
+        Util::CompressingWritableStream out { compressed, Util::Lz4Codec::the(), 8 };
+        EXPECT_EQ(MUST(out.write(bytes_of("abcdefghijkl"))), 8u);
+        EXPECT_EQ(MUST(out.write(bytes_of("ijkl"))), 4u);
+        EXPECT_NO_ERROR(out.finish());
+        EXPECT_EQ(decompress(compressed.data()), "abcdefghijkl");
+    }
+
+    // The error is returned if nothing was accepted.
+    {
+        FlakyStream compressed { 1 };
+        Util::CompressingWritableStream out { compressed, Util::Lz4Codec::the(), 8 };
+        EXPECT_EQ(MUST(out.write(bytes_of("abcdefgh"))), 8u);
+        compressed.m_fail_at = 6;
+        auto result = out.write(bytes_of("ijkl"));
+        EXPECT(result.is_error() && result.release_error().error == EIO);
+        EXPECT_NO_ERROR(out.finish());
+        EXPECT_EQ(decompress(compressed.data()), "abcdefgh");
+    }
+    return {};
+}
+
+TEST_CASE(decompressing_stream_seek) {
+    std::vector<uint8_t> data(10000);
+    for (size_t s = 0; s < data.size(); s++) {
+        data[s] = s / 10;
+    }
+    Util::WritableMemoryStream compressed;
+    {
+        Util::CompressingWritableStream out { compressed, Util::Lz4Codec::the(), 1000 };
+        EXPECT_NO_ERROR(Writer { out }.write_all(data));
+    }
+
+    auto in = Util::ReadableMemoryStream::borrow(compressed.data());
+    Util::DecompressingReadableStream decompressed { in };
+    EXPECT_NO_ERROR(decompressed.seek(2500));
+    uint8_t byte;
+    EXPECT_EQ(MUST(decompressed.read({ &byte, 1 })), 1u);
+    EXPECT_EQ(byte, 250);
+    EXPECT(decompressed.seek(-1).is_error());
+    EXPECT(decompressed.seek(0, SeekDirection::FromStart).is_error());
+    EXPECT(decompressed.seek(10000).is_error());
+    return {};
+}
+
+TEST_CASE(decompressing_stream_truncated) {
+    auto data = random_bytes(10000, 3);
+    Util::WritableMemoryStream compressed;
+    {
+        Util::CompressingWritableStream out { compressed };
+        EXPECT_NO_ERROR(Writer { out }.write_all(data));
+    }
+
+    for (size_t size : { size_t { 4 }, compressed.data().size() / 2, compressed.data().size() - 1 }) {
+        auto in = Util::ReadableMemoryStream::borrow(compressed.data().first(size));
+        Util::DecompressingReadableStream decompressed { in };
+        std::vector<uint8_t> read(data.size());
+        auto result = BinaryReader { decompressed }.read_all(read);
+        EXPECT(result.is_error());
+        EXPECT_EQ(result.release_error().error, EILSEQ);
+    }
+    return {};
+}
+
+TEST_CASE(decompressing_stream_frame_size_limit) {
+    auto data = random_bytes(10000, 3);
+    Util::WritableMemoryStream compressed;
+    {
+        Util::CompressingWritableStream out { compressed, Util::Lz4Codec::the(), 4096 };
+        EXPECT_NO_ERROR(Writer { out }.write_all(data));
+    }
+
+    auto read_with_limit = [&](std::span<uint8_t const> stream_data, size_t max_frame_size) {
+        auto in = Util::ReadableMemoryStream::borrow(stream_data);
+        Util::DecompressingReadableStream decompressed { in, Util::Lz4Codec::the(), max_frame_size };
+        std::vector<uint8_t> read(data.size());
+        return BinaryReader { decompressed }.read_all(read);
+    };
+    EXPECT(MUST(read_with_limit(compressed.data(), 4096)));
+    auto result = read_with_limit(compressed.data(), 4095);
+    EXPECT(result.is_error() && result.release_error().error == EINVAL);
+
+    // Corrupted sizes are rejected before allocating.
+    std::vector<uint8_t> huge { 0x00, 0x00, 0x00, 0x70, 0x10, 0x00, 0x00, 0x00 };
+    result = read_with_limit(huge, Util::CompressionFrame::DefaultMaxSize);
+    EXPECT(result.is_error() && result.release_error().error == EINVAL);
+
+    // Compressed frame that isn't smaller than its data
+    std::vector<uint8_t> not_compressed { 0x10, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00 };
+    result = read_with_limit(not_compressed, Util::CompressionFrame::DefaultMaxSize);
+    EXPECT(result.is_error() && result.release_error().error == EILSEQ);
+    return {};
+}
+
+// A dump of simulation state: records of slowly changing values, like
+// what is stored with Writer.
+constexpr size_t DumpRecordCount = 200'000;
+constexpr size_t DumpRecordSize = 22;
+
+static Util::Buffer const& dump_benchmark_data() {
+    static Util::Buffer data = [] {
+        Util::WritableMemoryStream out;
+        Writer writer { out };
+        std::mt19937 random { 1234 };
+        for (size_t s = 0; s < DumpRecordCount; s++) {
+            MUST(writer.write_little_endian<uint32_t>(s));
+            MUST(writer.write_little_endian<uint16_t>(s % 7 == 0 ? 2 : 1));
+            MUST(writer.write_little_endian<float>(s * 0.25f));
+            MUST(writer.write_little_endian<float>(100.f));
+            MUST(writer.write_little_endian<double>(random() % 16));
+        }
+        return out.release_buffer();
+    }();
+    return data;
+}
+
+static Util::Buffer const& dump_benchmark_compressed() {
+    static Util::Buffer data = [] {
+        Util::WritableMemoryStream out;
+        {
+            Util::CompressingWritableStream compressing { out };
+            MUST(Writer { compressing }.write_all(dump_benchmark_data().span()));
+        }
+        return out.release_buffer();
+    }();
+    return data;
+}
+
+TEST_CASE(compression_ratio) {
+    // The ratio is about 46%, mostly because of the random doubles.
+    auto ratio = static_cast<double>(dump_benchmark_compressed().size()) / dump_benchmark_data().size();
+    EXPECT(ratio < 0.5);
+    return {};
+}
+
+static size_t volatile processed_size;
+
+BENCHMARK_THROUGHPUT(compress_dump, DumpRecordCount * DumpRecordSize) {
+    Util::WritableMemoryStream out;
+    Util::CompressingWritableStream compressing { out };
+    MUST(Writer { compressing }.write_all(dump_benchmark_data().span()));
+    MUST(compressing.finish());
+    processed_size = out.data().size();
+}
+
+BENCHMARK_THROUGHPUT(decompress_dump, DumpRecordCount * DumpRecordSize) {
+    auto in = Util::ReadableMemoryStream::borrow(dump_benchmark_compressed().span());
+    Util::DecompressingReadableStream decompressing { in };
+    static std::vector<uint8_t> output(dump_benchmark_data().size());
+    MUST(BinaryReader { decompressing }.read_all(output));
+    processed_size = output.size();
+}
+
+BENCHMARK_THROUGHPUT(copy_dump, DumpRecordCount * DumpRecordSize) {
+    Util::WritableMemoryStream out;
+    MUST(Writer { out }.write_all(dump_benchmark_data().span()));
+    processed_size = out.data().size();
+}
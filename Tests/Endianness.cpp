@@ -0,0 +1,154 @@
+#include <Util/Testing.hpp>
+
+#include <Util/Endianness.hpp>
+#include <Util/Stream.hpp>
+
+#include <random>
+#include <vector>
+
+template<class T>
+static std::vector<T> random_values(size_t count) {
+    std::mt19937_64 random { 1234 };
+    std::vector<T> values(count);
+    for (auto& value : values) {
+        value = static_cast<T>(random());
+    }
+    return values;
+}
+
+template<class T>
+static ErrorOr<void, __TestSuite::TestError> test_swap_array() {
+    // Sizes around SIMD block sizes, so that both the vectorized and the
+    // scalar parts are tested.
+    for (size_t count : { 0, 1, 7, 8, 15, 16, 17, 31, 33, 64, 65, 1000 }) {
+        auto values = random_values<T>(count);
+
+        std::vector<T> copied(count);
+        Util::swap_endianness<T>(values, copied);
+        for (size_t s = 0; s < count; s++) {
+            EXPECT_EQ(copied[s], Util::swap_endianness(values[s]));
+        }
+
+        auto in_place = values;
+        Util::swap_endianness(std::span { in_place });
+        EXPECT(in_place == copied);
+    }
+    return {};
+}
+
+TEST_CASE(swap_array) {
+    TRY(test_swap_array<uint16_t>());
+    TRY(test_swap_array<uint32_t>());
+    TRY(test_swap_array<uint64_t>());
+    return {};
+}
+
+TEST_CASE(convert_array) {
+    std::vector<int16_t> values { 0x0102, -2 };
+    Util::convert_from_host_to_big_endian(std::span { values });
+    EXPECT_EQ(reinterpret_cast<uint8_t const*>(values.data())[0], 0x01);
+    EXPECT_EQ(reinterpret_cast<uint8_t const*>(values.data())[1], 0x02);
+    Util::convert_from_big_to_host_endian(std::span { values });
+    EXPECT_EQ(values[0], 0x0102);
+    EXPECT_EQ(values[1], -2);
+
+    std::vector<float> floats { 1.5f, -2.f };
+    std::vector<float> converted(2);
+    Util::convert_from_host_to_big_endian<float>(floats, converted);
+    Util::convert_from_big_to_host_endian(std::span { converted });
+    EXPECT(converted == floats);
+    Util::convert_from_host_to_little_endian<float>(floats, converted);
+    EXPECT(converted == floats);
+    return {};
+}
+
+TEST_CASE(read_write_arrays) {
+    auto values = random_values<uint32_t>(5000);
+    Util::WritableMemoryStream out;
+    Writer writer { out };
+    EXPECT_NO_ERROR(writer.write_big_endian_array<uint32_t>(values));
+    EXPECT_NO_ERROR(writer.write_little_endian_array<uint32_t>(values));
+    EXPECT_EQ(out.data()[0], values[0] >> 24);
+    EXPECT_EQ(out.data()[values.size() * 4], values[0] & 0xff);
+
+    auto in = Util::ReadableMemoryStream::borrow(out.data());
+    BinaryReader reader { in };
+    EXPECT_EQ(MUST(reader.read_big_endian<uint32_t>()), values[0]);
+    std::vector<uint32_t> read(values.size() - 1);
+    EXPECT_NO_ERROR(reader.read_big_endian_array(std::span { read }));
+    EXPECT(std::equal(read.begin(), read.end(), values.begin() + 1));
+    read.resize(values.size());
+    EXPECT_NO_ERROR(reader.read_little_endian_array(std::span { read }));
+    EXPECT(read == values);
+    EXPECT(reader.read_big_endian_array(std::span { read }).is_error());
+    return {};
+}
+
+// Audio-like data: 10M 16-bit samples.
+constexpr size_t EndiannessBenchmarkCount = 10'000'000;
+
+static std::vector<uint16_t> const& benchmark_samples() {
+    static auto samples = random_values<uint16_t>(EndiannessBenchmarkCount);
+    return samples;
+}
+
+static uint16_t volatile sample_sink;
+
+BENCHMARK_THROUGHPUT(swap_scalar_loop, EndiannessBenchmarkCount * 2) {
+    static std::vector<uint16_t> output(EndiannessBenchmarkCount);
+    auto const& input = benchmark_samples();
+    for (size_t s = 0; s < input.size(); s++) {
+        output[s] = Util::convert_from_big_to_host_endian(input[s]);
+    }
+    sample_sink = output.back();
+}
+
+BENCHMARK_THROUGHPUT(swap_array, EndiannessBenchmarkCount * 2) {
+    static std::vector<uint16_t> output(EndiannessBenchmarkCount);
+    Util::convert_from_big_to_host_endian<uint16_t>(benchmark_samples(), output);
+    sample_sink = output.back();
+}
+
+static Util::Buffer const& benchmark_big_endian_data() {
+    static Util::Buffer data = [] {
+        Util::WritableMemoryStream out;
+        MUST(Writer { out }.write_big_endian_array<uint16_t>(benchmark_samples()));
+        return out.release_buffer();
+    }();
+    return data;
+}
+
+BENCHMARK_THROUGHPUT(read_big_endian_per_element, EndiannessBenchmarkCount * 2) {
+    auto in = Util::ReadableMemoryStream::borrow(benchmark_big_endian_data().span());
+    BinaryReader reader { in };
+    static std::vector<uint16_t> samples(EndiannessBenchmarkCount);
+    for (auto& sample : samples) {
+        sample = MUST(reader.read_big_endian<uint16_t>());
+    }
+    sample_sink = samples.back();
+}
+
+BENCHMARK_THROUGHPUT(read_big_endian_array, EndiannessBenchmarkCount * 2) {
+    auto in = Util::ReadableMemoryStream::borrow(benchmark_big_endian_data().span());
+    BinaryReader reader { in };
+    static std::vector<uint16_t> samples(EndiannessBenchmarkCount);
+    MUST(reader.read_big_endian_array(std::span { samples }));
+    sample_sink = samples.back();
+}
+
+BENCHMARK_THROUGHPUT(write_big_endian_per_element, EndiannessBenchmarkCount * 2) {
+    Util::WritableMemoryStream out;
+    out.reserve(EndiannessBenchmarkCount * 2);
+    Util::BufferedWriter buffered { out };
+    Writer writer { buffered };
+    for (auto sample : benchmark_samples()) {
+        MUST(writer.write_big_endian(sample));
+    }
+    MUST(buffered.flush());
+}
+
+BENCHMARK_THROUGHPUT(write_big_endian_array, EndiannessBenchmarkCount * 2) {
+    Util::WritableMemoryStream out;
+    out.reserve(EndiannessBenchmarkCount * 2);
+    MUST(Writer { out }.write_big_endian_array<uint16_t>(benchmark_samples()));
+}
@@ -0,0 +1,176 @@
+#include <Util/Testing.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <Util/Hash.hpp>
+#include <Util/Stream.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> test_data() {
+    std::vector<uint8_t> data;
+    for (size_t s = 0; s < 1024; s++) {
+        data.push_back(s);
+    }
+    return data;
+}
+
+TEST_CASE(crc32c) {
+    EXPECT_EQ(Util::Crc32c::compute(""), 0u);
+    EXPECT_EQ(Util::Crc32c::compute("a"), 0xc1d04330u);
+    EXPECT_EQ(Util::Crc32c::compute("123456789"), 0xe3069283u);
+    EXPECT_EQ(Util::Crc32c::compute("The quick brown fox jumps over the lazy dog"), 0x22620404u);
+    EXPECT_EQ(Util::Crc32c::compute(test_data()), 0x2cdf6e8fu);
+    EXPECT_EQ(Util::Crc32c::compute_scalar(test_data()), 0x2cdf6e8fu);
+
+    // Chaining
+    EXPECT_EQ(Util::Crc32c::compute("6789", Util::Crc32c::compute("12345")), 0xe3069283u);
+    return {};
+}
+
+TEST_CASE(crc32c_scalar_matches) {
+    std::mt19937 random { 1234 };
+    std::vector<uint8_t> data(10000);
+    for (auto& byte : data) {
+        byte = random();
+    }
+    for (size_t size : { 0, 1, 7, 8, 9, 63, 64, 1000, 10000 }) {
+        for (size_t offset : { 0, 1, 3 }) {
+            auto span = std::span { data }.subspan(offset, std::min(size, data.size() - offset));
+            EXPECT_EQ(Util::Crc32c::compute(span), Util::Crc32c::compute_scalar(span));
+        }
+    }
+    return {};
+}
+
+TEST_CASE(xxhash64) {
+    EXPECT_EQ(Util::XxHash64::compute(""), 0xef46db3751d8e999u);
+    EXPECT_EQ(Util::XxHash64::compute("a"), 0xd24ec4f1a98c6e5bu);
+    EXPECT_EQ(Util::XxHash64::compute("abc"), 0x44bc2cf5ad770999u);
+    EXPECT_EQ(Util::XxHash64::compute("123456789"), 0x8cb841db40e6ae83u);
+    EXPECT_EQ(Util::XxHash64::compute("The quick brown fox jumps over the lazy dog"), 0x0b242d361fda71bcu);
+    EXPECT_EQ(Util::XxHash64::compute(test_data()), 0x6f3914f18fe4df57u);
+    EXPECT_EQ(Util::XxHash64::compute("abc", 1234), 0x2151859f42f363e2u);
+    EXPECT_EQ(Util::XxHash64::compute(test_data(), 1234), 0xeefbf3d9f55d6a13u);
+    return {};
+}
+
+TEST_CASE(incremental) {
+    auto data = test_data();
+    Util::Crc32c crc;
+    Util::XxHash64 xxhash;
+    size_t offset = 0;
+    for (size_t size : { 0, 1, 5, 31, 32, 33, 100, 822 }) {
+        crc.update(std::span { data }.subspan(offset, size));
+        xxhash.update(std::span { data }.subspan(offset, size));
+        offset += size;
+    }
+    EXPECT_EQ(offset, data.size());
+    EXPECT_EQ(crc.digest(), 0x2cdf6e8fu);
+    EXPECT_EQ(xxhash.digest(), 0x6f3914f18fe4df57u);
+
+    // digest() doesn't reset
+    xxhash.update(bytes_of("a"));
+    EXPECT(xxhash.digest() != 0x6f3914f18fe4df57u);
+    xxhash.reset();
+    xxhash.update(bytes_of("a"));
+    EXPECT_EQ(xxhash.digest(), 0xd24ec4f1a98c6e5bu);
+    return {};
+}
+
+TEST_CASE(hashing_streams) {
+    std::string text;
+    for (size_t s = 0; s < 1000; s++) {
+        text += "Line " + std::to_string(s) + "\n";
+    }
+
+    Util::WritableMemoryStream out;
+    Util::XxHash64 write_hash;
+    {
+        Util::HashingWritableStream hashing { out, write_hash };
+        Util::BufferedWriter buffered { hashing, 1000 };
+        EXPECT_NO_ERROR(Writer { buffered }.write_all(bytes_of(text).first(10)));
+        EXPECT_NO_ERROR(Writer { buffered }.write_all(bytes_of(text).subspan(10)));
+        EXPECT_NO_ERROR(buffered.flush());
+        EXPECT(hashing.seek(0).is_error());
+    }
+    EXPECT_EQ(write_hash.digest(), Util::XxHash64::compute(text));
+
+    auto in = Util::ReadableMemoryStream::borrow(out.data());
+    Util::Crc32c read_hash;
+    Util::HashingReadableStream hashing { in, read_hash };
+    Util::TextReader reader { hashing };
+    EXPECT_EQ(MUST(reader.consume_line()).encode(), "Line 0");
+    EXPECT_NO_ERROR(hashing.seek(5));
+    while (!reader.is_eof()) {
+        (void)MUST(reader.consume_line());
+    }
+    EXPECT_EQ(read_hash.digest(), Util::Crc32c::compute(text));
+    EXPECT(hashing.seek(-1).is_error());
+    return {};
+}
+
+constexpr size_t HashBenchmarkSize = 16 * 1024 * 1024;
+
+static std::string const& hash_benchmark_file() {
+    static std::string const file_name = [] {
+        std::string const name = "/tmp/essautil-hash-benchmark";
+        std::mt19937 random { 1234 };
+        std::vector<uint8_t> data(HashBenchmarkSize);
+        for (auto& byte : data) {
+            byte = random();
+        }
+        auto stream = Util::WritableFileStream::open(name, { .truncate = true }).release_value();
+        MUST(Writer { stream }.write_all(data));
+        return name;
+    }();
+    return file_name;
+}
+
+static uint64_t volatile hash_sink;
+
+static void read_benchmark_file(Util::ReadableStream& stream) {
+    static std::vector<uint8_t> buffer(64 * 1024);
+    while (MUST(stream.read(buffer)) > 0) {
+    }
+}
+
+BENCHMARK_THROUGHPUT(read_file_stream, HashBenchmarkSize) {
+    auto stream = MUST(Util::ReadableFileStream::open(hash_benchmark_file()));
+    read_benchmark_file(stream);
+}
+
+BENCHMARK_THROUGHPUT(read_file_stream_crc32c, HashBenchmarkSize) {
+    auto stream = MUST(Util::ReadableFileStream::open(hash_benchmark_file()));
+    Util::Crc32c hasher;
+    Util::HashingReadableStream hashing { stream, hasher };
+    read_benchmark_file(hashing);
+    hash_sink = hasher.digest();
+}
+
+BENCHMARK_THROUGHPUT(read_file_stream_xxhash64, HashBenchmarkSize) {
+    auto stream = MUST(Util::ReadableFileStream::open(hash_benchmark_file()));
+    Util::XxHash64 hasher;
+    Util::HashingReadableStream hashing { stream, hasher };
+    read_benchmark_file(hashing);
+    hash_sink = hasher.digest();
+}
+
+static std::vector<uint8_t> const& hash_benchmark_data() {
+    static std::vector<uint8_t> data(HashBenchmarkSize, 0x55);
+    return data;
+}
+
+BENCHMARK_THROUGHPUT(crc32c, HashBenchmarkSize) {
+    hash_sink = Util::Crc32c::compute(hash_benchmark_data());
+}
+
+BENCHMARK_THROUGHPUT(crc32c_scalar, HashBenchmarkSize) {
+    hash_sink = Util::Crc32c::compute_scalar(hash_benchmark_data());
+}
+
+BENCHMARK_THROUGHPUT(xxhash64, HashBenchmarkSize) {
+    hash_sink = Util::XxHash64::compute(hash_benchmark_data());
+}
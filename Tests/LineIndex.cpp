@@ -0,0 +1,253 @@
+#include <Util/Testing.hpp>
+
+#include "TestHelpers.hpp"
+
+#include <Util/Stream.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Lines of random length (some empty), so that newlines fall everywhere
+// within SIMD blocks.
+static std::vector<std::string> test_lines(size_t count) {
+    std::mt19937 random { 1234 };
+    std::vector<std::string> lines;
+    for (size_t s = 0; s < count; s++) {
+        auto line = "Line " + std::to_string(s);
+        line.append(random() % 100, 'x');
+        if (s % 17 == 0) {
+            line.clear();
+        }
+        lines.push_back(std::move(line));
+    }
+    return lines;
+}
+
+static std::string join_lines(std::vector<std::string> const& lines, bool trailing_newline) {
+    std::string text;
+    for (size_t s = 0; s < lines.size(); s++) {
+        text += lines[s];
+        if (s + 1 < lines.size() || trailing_newline) {
+            text += '\n';
+        }
+    }
+    return text;
+}
+
+TEST_CASE(line_count) {
+    EXPECT_EQ(Util::LineIndex::build(bytes_of("")).line_count(), 0u);
+    EXPECT_EQ(Util::LineIndex::build(bytes_of("a")).line_count(), 1u);
+    EXPECT_EQ(Util::LineIndex::build(bytes_of("a\n")).line_count(), 1u);
+    EXPECT_EQ(Util::LineIndex::build(bytes_of("\n")).line_count(), 1u);
+    EXPECT_EQ(Util::LineIndex::build(bytes_of("a\n\nb")).line_count(), 3u);
+    EXPECT_EQ(Util::LineIndex::build(bytes_of("a\n\nb\n\n")).line_count(), 4u);
+    return {};
+}
+
+TEST_CASE(lines) {
+    for (bool trailing_newline : { false, true }) {
+        for (size_t stride : { 1, 7, 1024 }) {
+            auto lines = test_lines(5000);
+            auto text = join_lines(lines, trailing_newline);
+            auto data = bytes_of(text);
+            auto index = Util::LineIndex::build(data, stride);
+            EXPECT_EQ(index.line_count(), lines.size());
+            EXPECT_EQ(index.data_size(), text.size());
+            for (size_t s = 0; s < lines.size(); s++) {
+                EXPECT_EQ(string_of(index.line(data, s)), lines[s]);
+            }
+            EXPECT_EQ(index.line_string(data, 1).encode(), lines[1]);
+            EXPECT_EQ(index.line_offset(data, lines.size()), text.size());
+
+            EXPECT_EQ(string_of(index.lines(data, 10, 13)), lines[10] + "\n" + lines[11] + "\n" + lines[12]);
+            EXPECT_EQ(string_of(index.lines(data, 0, lines.size())), join_lines(lines, false));
+            EXPECT(index.lines(data, 10, 10).empty());
+            EXPECT(index.lines(data, lines.size(), lines.size() + 10).empty());
+
+            auto strings = index.line_strings(data, 4990, 6000);
+            EXPECT_EQ(strings.size(), 10u);
+            EXPECT_EQ(strings[9].encode(), lines[4999]);
+        }
+    }
+    return {};
+}
+
+TEST_CASE(build_from_stream) {
+    auto text = join_lines(test_lines(10000), false);
+    auto expected = Util::LineIndex::build(bytes_of(text), 100);
+
+    // Split in parts in the middle of blocks and lines.
+    Util::LineIndex::Builder builder { 100 };
+    for (size_t offset = 0; offset < text.size(); offset += 1000) {
+        builder.append(bytes_of(text).subspan(offset, std::min<size_t>(1000, text.size() - offset)));
+    }
+    auto index = builder.finish();
+    auto data = bytes_of(text);
+    EXPECT_EQ(index.line_count(), expected.line_count());
+    for (size_t s = 0; s < index.line_count(); s += 37) {
+        EXPECT_EQ(index.line_offset(data, s), expected.line_offset(data, s));
+    }
+
+    auto stream = Util::WritableFileStream::open("/tmp/essautil-line-index-test", { .truncate = true }).release_value();
+    EXPECT_NO_ERROR(Writer { stream }.write_all(data));
+    auto in = MUST(Util::ReadableFileStream::open("/tmp/essautil-line-index-test"));
+    auto from_file = MUST(Util::LineIndex::build(in, 100));
+    EXPECT_EQ(from_file.line_count(), expected.line_count());
+    EXPECT_EQ(from_file.line_offset(data, 9999), expected.line_offset(data, 9999));
+    return {};
+}
+
+TEST_CASE(save_load) {
+    auto lines = test_lines(10000);
+    auto text = join_lines(lines, true);
+    auto data = bytes_of(text);
+    auto index = Util::LineIndex::build(data, 64);
+
+    Util::WritableMemoryStream out;
+    EXPECT_NO_ERROR(index.save(out));
+    auto in = Util::ReadableMemoryStream::borrow(out.data());
+    auto loaded = MUST(Util::LineIndex::load(in));
+    EXPECT_EQ(loaded.line_count(), index.line_count());
+    EXPECT_EQ(loaded.stride(), 64u);
+    EXPECT_EQ(loaded.data_size(), text.size());
+    for (size_t s = 0; s < lines.size(); s += 13) {
+        EXPECT_EQ(string_of(loaded.line(data, s)), lines[s]);
+    }
+
+    auto not_index = Util::ReadableMemoryStream::from_string("not an index");
+    EXPECT(Util::LineIndex::load(not_index).is_error());
+    auto truncated = Util::ReadableMemoryStream::borrow(out.data().first(out.data().size() - 1));
+    EXPECT(Util::LineIndex::load(truncated).is_error());
+
+    // Corrupted headers fail before allocating for offsets.
+    auto header = [](uint64_t line_count, uint64_t data_size, std::vector<uint64_t> const& deltas = {}) {
+        Util::WritableMemoryStream out;
+        Writer writer { out };
+        MUST(writer.write_little_endian<uint32_t>(0x494c5345));
+        MUST(writer.write_little_endian<uint8_t>(1));
+        MUST(writer.write_varint(1));
+        MUST(writer.write_varint(line_count));
+        MUST(writer.write_varint(data_size));
+        MUST(writer.write_varint(line_count));
+        MUST(writer.write_varint_array(deltas));
+        return out.release_buffer();
+    };
+    auto more_lines_than_bytes = header(uint64_t { 1 } << 60, 100);
+    auto in_more_lines = Util::ReadableMemoryStream::borrow(more_lines_than_bytes.span());
+    auto result = Util::LineIndex::load(in_more_lines);
+    EXPECT(result.is_error() && result.release_error().error == EINVAL);
+    auto huge = header(uint64_t { 1 } << 60, uint64_t { 1 } << 61);
+    auto in_huge = Util::ReadableMemoryStream::borrow(huge.span());
+    EXPECT(Util::LineIndex::load(in_huge).is_error());
+
+    // Corrupted offsets
+    auto load_offsets = [&](std::vector<uint64_t> const& deltas) {
+        auto buffer = header(deltas.size(), 100, deltas);
+        auto in = Util::ReadableMemoryStream::borrow(buffer.span());
+        return Util::LineIndex::load(in);
+    };
+    EXPECT_NO_ERROR(load_offsets({ 0, 10, 20 }));
+    for (auto const& deltas : std::initializer_list<std::vector<uint64_t>> {
+             { 5, 10, 20 }, // Not starting at 0
+             { 0, 200, 1 }, // Out of the data
+             { 0, UINT64_MAX - 9, 20 }, // Wraps around to the data
+         }) {
+        auto result = load_offsets(deltas);
+        EXPECT(result.is_error() && result.release_error().error == EINVAL);
+    }
+    return {};
+}
+
+// A log-like file of about 100 MB. Lines have the same length, so that
+// the size is known up front.
+constexpr size_t LineIndexBenchmarkLines = 1'000'000;
+constexpr size_t LineIndexBenchmarkLineSize = 100;
+constexpr size_t LineIndexBenchmarkSize = LineIndexBenchmarkLines * LineIndexBenchmarkLineSize;
+
+static std::string const& line_index_benchmark_file() {
+    static std::string const file_name = [] {
+        std::string const name = "/tmp/essautil-line-index-benchmark";
+        auto stream = Util::WritableFileStream::open(name, { .truncate = true }).release_value();
+        Util::BufferedWriter buffered { stream };
+        Writer writer { buffered };
+        std::mt19937 random { 1234 };
+        for (size_t s = 0; s < LineIndexBenchmarkLines; s++) {
+            auto line = fmt::format("2024-01-01 12:00:00.{:06} [info] Request {:010} handled in {:3} ms", s, random(), random() % 1000);
+            line.resize(LineIndexBenchmarkLineSize - 1, '.');
+            line += '\n';
+            MUST(writer.write_all(bytes_of(line)));
+        }
+        MUST(buffered.flush());
+        return name;
+    }();
+    return file_name;
+}
+
+static Util::MappedFile const& line_index_benchmark_mapping() {
+    static auto file = MUST(Util::MappedFile::map(line_index_benchmark_file()));
+    return file;
+}
+
+static Util::LineIndex const& line_index_benchmark_index() {
+    static auto index = Util::LineIndex::build(line_index_benchmark_mapping().data());
+    return index;
+}
+
+static size_t volatile line_sink;
+
+BENCHMARK_THROUGHPUT(build_mapped, LineIndexBenchmarkSize) {
+    line_sink = Util::LineIndex::build(line_index_benchmark_mapping().data()).line_count();
+}
+
+BENCHMARK_THROUGHPUT(build_file_stream, LineIndexBenchmarkSize) {
+    auto stream = MUST(Util::ReadableFileStream::open(line_index_benchmark_file()));
+    line_sink = MUST(Util::LineIndex::build(stream)).line_count();
+}
+
+// For comparison: counting lines by reading the file sequentially.
+BENCHMARK_THROUGHPUT(consume_line_file_stream, LineIndexBenchmarkSize) {
+    auto stream = MUST(Util::ReadableFileStream::open(line_index_benchmark_file()));
+    Util::TextReader reader { stream };
+    size_t count = 0;
+    while (!reader.is_eof()) {
+        (void)MUST(reader.consume_line());
+        count++;
+    }
+    line_sink = count;
+}
+
+// Lookups of random lines, 1000 per run.
+BENCHMARK(lookup_random_lines) {
+    auto const& index = line_index_benchmark_index();
+    auto data = line_index_benchmark_mapping().data();
+    std::mt19937 random { 1234 };
+    size_t size = 0;
+    for (size_t s = 0; s < 1000; s++) {
+        size += index.line(data, random() % index.line_count()).size();
+    }
+    line_sink = size;
+}
+
+BENCHMARK(lookup_random_lines_string) {
+    auto const& index = line_index_benchmark_index();
+    auto data = line_index_benchmark_mapping().data();
+    std::mt19937 random { 1234 };
+    size_t size = 0;
+    for (size_t s = 0; s < 1000; s++) {
+        size += index.line_string(data, random() % index.line_count()).size();
+    }
+    line_sink = size;
+}
+
+BENCHMARK(lookup_page) {
+    auto const& index = line_index_benchmark_index();
+    auto data = line_index_benchmark_mapping().data();
+    std::mt19937 random { 1234 };
+    size_t size = 0;
+    for (size_t s = 0; s < 1000; s++) {
+        auto first = random() % index.line_count();
+        size += index.line_strings(data, first, first + 50).size();
+    }
+    line_sink = size;
+}
@@ -0,0 +1,126 @@
+#include <Util/Testing.hpp>
+
+#include <Util/Stream.hpp>
+
+#include <string>
+
+static std::string write_test_file(std::string_view content) {
+    std::string const name = "/tmp/essautil-parallel-decoder-test";
+    auto stream = Util::WritableFileStream::open(name, { .truncate = true }).release_value();
+    MUST(Writer { stream }.write_all({ reinterpret_cast<uint8_t const*>(content.data()), content.size() }));
+    return name;
+}
+
+// Text with sequences of every length, so that chunk boundaries fall in
+// the middle of them.
+static std::string test_text(size_t repeat) {
+    std::string text;
+    for (size_t s = 0; s < repeat; s++) {
+        text += "Line " + std::to_string(s) + ": zażółć gęślą jaźń, 日本語, 🙂🙃\n";
+    }
+    return text;
+}
+
+static ErrorOr<void, __TestSuite::TestError> expect_same_as_sequential(std::string const& content) {
+    auto file_name = write_test_file(content);
+    UString expected { content };
+    for (size_t thread_count : { 1, 2, 3, 8 }) {
+        for (size_t chunk_size : { 1, 7, 64, 1000, 256 * 1024 }) {
+            auto result = MUST(Util::decode_file_parallel(file_name, { .thread_count = thread_count, .chunk_size = chunk_size }));
+            EXPECT_EQ(result.string, expected);
+            EXPECT(result.timings.total >= result.timings.read);
+        }
+    }
+    return {};
+}
+
+TEST_CASE(decode) {
+    TRY(expect_same_as_sequential("Hello"));
+    TRY(expect_same_as_sequential(std::string(10000, 'a')));
+    TRY(expect_same_as_sequential(test_text(1000)));
+
+    auto result = MUST(Util::decode_file_parallel(write_test_file(test_text(10)), {}));
+    EXPECT(result.valid);
+    return {};
+}
+
+TEST_CASE(empty) {
+    auto result = MUST(Util::decode_file_parallel(write_test_file(""), {}));
+    EXPECT_EQ(result.string.size(), 0u);
+    EXPECT(result.valid);
+    return {};
+}
+
+TEST_CASE(invalid) {
+    // Invalid lead bytes and truncated sequences
+    auto text = test_text(100);
+    text[100] = '\xff';
+    text[200] = '\xc5';
+    TRY(expect_same_as_sequential(text));
+    auto result = MUST(Util::decode_file_parallel(write_test_file(text), { .chunk_size = 64 }));
+    EXPECT(!result.valid);
+
+    // Stray continuation bytes, which are counted wrong at first
+    text = "\x80\x80" + test_text(100) + "\xbf\xbf\xbf\xbf\xbf\xbf\xbf" + test_text(100);
+    TRY(expect_same_as_sequential(text));
+    result = MUST(Util::decode_file_parallel(write_test_file(text), { .chunk_size = 64 }));
+    EXPECT(!result.valid);
+    return {};
+}
+
+TEST_CASE(errors) {
+    EXPECT(Util::decode_file_parallel("/nonexistent", {}).is_error());
+    return {};
+}
+
+// About 64 MiB of mostly ASCII text, like source code or logs.
+constexpr size_t ParallelDecoderBenchmarkSize = 64 * 1024 * 1024;
+
+static std::string const& parallel_decoder_benchmark_file() {
+    static std::string const file_name = [] {
+        std::string const name = "/tmp/essautil-parallel-decoder-benchmark";
+        std::string line = "2024-01-01 12:00:00 [info] Użytkownik zalogował się, żądanie obsłużone w 12 ms\n";
+        std::string text;
+        text.reserve(ParallelDecoderBenchmarkSize);
+        while (text.size() + line.size() <= ParallelDecoderBenchmarkSize) {
+            text += line;
+        }
+        text.append(ParallelDecoderBenchmarkSize - text.size(), '.');
+        auto stream = Util::WritableFileStream::open(name, { .truncate = true }).release_value();
+        MUST(Writer { stream }.write_all({ reinterpret_cast<uint8_t const*>(text.data()), text.size() }));
+        return name;
+    }();
+    return file_name;
+}
+
+static size_t volatile decoded_size_sink;
+
+BENCHMARK_THROUGHPUT(read_file_and_decode, ParallelDecoderBenchmarkSize) {
+    auto data = MUST(Util::ReadableFileStream::read_file(parallel_decoder_benchmark_file()));
+    decoded_size_sink = data.decode_infallible().size();
+}
+
+static void benchmark_parallel(size_t thread_count) {
+    auto result = MUST(Util::decode_file_parallel(parallel_decoder_benchmark_file(), { .thread_count = thread_count }));
+    decoded_size_sink = result.string.size();
+}
+
+BENCHMARK_THROUGHPUT(decode_file_parallel_1_thread, ParallelDecoderBenchmarkSize) {
+    benchmark_parallel(1);
+}
+
+BENCHMARK_THROUGHPUT(decode_file_parallel_2_threads, ParallelDecoderBenchmarkSize) {
+    benchmark_parallel(2);
+}
+
+BENCHMARK_THROUGHPUT(decode_file_parallel_4_threads, ParallelDecoderBenchmarkSize) {
+    benchmark_parallel(4);
+}
+
+BENCHMARK_THROUGHPUT(decode_file_parallel_8_threads, ParallelDecoderBenchmarkSize) {
+    benchmark_parallel(8);
+}
+
+BENCHMARK_THROUGHPUT(decode_file_parallel_all_threads, ParallelDecoderBenchmarkSize) {
+    benchmark_parallel(0);
+}
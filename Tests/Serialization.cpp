@@ -0,0 +1,258 @@
+#include <Util/Testing.hpp>
+
+#include <Util/Serialization.hpp>
+#include <Util/Stream.hpp>
+
+#include <vector>
+
+namespace {
+
+struct Vec3 {
+    float x;
+    float y;
+    float z;
+
+    bool operator==(Vec3 const&) const = default;
+};
+
+#define VEC3_FIELDS(F) \
+    F(x)               \
+    F(y)               \
+    F(z)
+
+ESSA_SERIALIZABLE(Vec3, VEC3_FIELDS)
+
+// Same layout in memory as serialized.
+struct Sample {
+    uint32_t id;
+    Vec3 position;
+
+    bool operator==(Sample const&) const = default;
+};
+
+#define SAMPLE_FIELDS(F) \
+    F(id)                \
+    F(position)
+
+ESSA_SERIALIZABLE(Sample, SAMPLE_FIELDS)
+
+enum class ParticleType : uint8_t {
+    Electron,
+    Proton,
+};
+
+// Has padding in memory, so it is serialized field by field.
+struct Particle {
+    uint64_t id;
+    ParticleType type;
+    bool alive;
+    Vec3 position;
+    double mass;
+
+    bool operator==(Particle const&) const = default;
+};
+
+#define PARTICLE_FIELDS(F) \
+    F(id)                  \
+    F(type)                \
+    F(alive)               \
+    F(position)            \
+    F(mass)
+
+ESSA_SERIALIZABLE(Particle, PARTICLE_FIELDS)
+
+}
+
+using namespace Util::Serialization;
+
+static_assert(serialized_size<Vec3>() == 12);
+static_assert(serialized_size<Sample>() == 16);
+static_assert(serialized_size<Particle>() == 30);
+static_assert(has_native_layout<Sample>());
+static_assert(!has_native_layout<Particle>());
+static_assert(serialized_offset<Particle, &Particle::position>() == 10);
+static_assert(serialized_offset<Particle, &Particle::mass>() == 22);
+
+static std::vector<Particle> test_particles(size_t count) {
+    std::vector<Particle> particles;
+    for (size_t s = 0; s < count; s++) {
+        particles.push_back({ .id = s, .type = s % 3 == 0 ? ParticleType::Proton : ParticleType::Electron, .alive = s % 2 == 0, .position = { s * 1.f, s * 2.f, s * 3.f }, .mass = s * 0.5 });
+    }
+    return particles;
+}
+
+TEST_CASE(encode) {
+    Particle particle { .id = 0x0102030405060708, .type = ParticleType::Proton, .alive = true, .position = { 1.f, 2.f, 3.f }, .mass = 4.0 };
+    uint8_t data[30];
+    Util::Serialization::encode(particle, data);
+    uint8_t const expected_start[] { 8, 7, 6, 5, 4, 3, 2, 1, 1, 1, 0x00, 0x00, 0x80, 0x3f };
+    EXPECT(std::equal(std::begin(expected_start), std::end(expected_start), data));
+
+    Particle decoded {};
+    Util::Serialization::decode(data, decoded);
+    EXPECT(decoded == particle);
+    return {};
+}
+
+TEST_CASE(read_write) {
+    auto particles = test_particles(10000);
+    std::vector<Sample> samples;
+    for (uint32_t s = 0; s < 10000; s++) {
+        samples.push_back({ .id = s, .position = { 1, 2, 3 } });
+    }
+
+    Util::WritableMemoryStream out;
+    Writer writer { out };
+    EXPECT_NO_ERROR(write(writer, particles[0]));
+    EXPECT_NO_ERROR(write_array<Particle>(writer, particles));
+    EXPECT_NO_ERROR(write_array<Sample>(writer, samples));
+    EXPECT_NO_ERROR(write(writer, uint16_t { 0x1234 }));
+    EXPECT_EQ(out.data().size(), 30 + 30 * particles.size() + 16 * samples.size() + 2);
+
+    auto in = Util::ReadableMemoryStream::from_string(std::string_view { reinterpret_cast<char const*>(out.data().data()), out.data().size() });
+    BinaryReader reader { in };
+    EXPECT(MUST(read<Particle>(reader)) == particles[0]);
+    std::vector<Particle> read_particles(particles.size());
+    EXPECT_NO_ERROR(read_array<Particle>(reader, read_particles));
+    EXPECT(read_particles == particles);
+    std::vector<Sample> read_samples(samples.size());
+    EXPECT_NO_ERROR(read_array<Sample>(reader, read_samples));
+    EXPECT(read_samples == samples);
+    EXPECT_EQ(MUST(read<uint16_t>(reader)), 0x1234);
+    EXPECT(read<uint16_t>(reader).is_error());
+    EXPECT(read_array<Sample>(reader, read_samples).is_error());
+    return {};
+}
+
+TEST_CASE(array_view) {
+    auto particles = test_particles(1000);
+    Util::WritableMemoryStream out;
+    Writer writer { out };
+    EXPECT_NO_ERROR(write_array<Particle>(writer, particles));
+
+    auto in = Util::ReadableMemoryStream::borrow(out.data());
+    BinaryReader reader { in };
+    auto view = MUST(read_array_view<Particle>(reader, 1000)).value();
+    EXPECT_EQ(view.size(), 1000u);
+
+    // Memory of the stream is used directly.
+    EXPECT_EQ(view.data().data(), out.data().data());
+    EXPECT(view[123] == particles[123]);
+    EXPECT_EQ(view.get<&Particle::mass>(500), 250.0);
+    EXPECT(view.get<&Particle::position>(10) == (Vec3 { 10, 20, 30 }));
+    EXPECT(!view.as_span());
+    EXPECT(!MUST(read_array_view<Particle>(reader, 1)));
+
+    EXPECT(RecordArrayView<Particle>::create(out.data().first(31)).is_error());
+    return {};
+}
+
+TEST_CASE(array_view_native) {
+    std::vector<Sample> samples;
+    for (uint32_t s = 0; s < 100; s++) {
+        samples.push_back({ .id = s, .position = { 1, 2, 3 } });
+    }
+    auto view = MUST(RecordArrayView<Sample>::create({ reinterpret_cast<uint8_t const*>(samples.data()), samples.size() * sizeof(Sample) }));
+    auto span = view.as_span();
+    EXPECT(span.has_value());
+    EXPECT_EQ(span->data(), samples.data());
+    EXPECT_EQ(view.get<&Sample::id>(42), 42u);
+
+    // Unaligned
+    auto unaligned = MUST(RecordArrayView<Sample>::create({ reinterpret_cast<uint8_t const*>(samples.data()) + 1, 16 }));
+    EXPECT(!unaligned.as_span());
+    return {};
+}
+
+constexpr size_t SerializationBenchmarkCount = 1'000'000;
+
+static std::vector<Particle> const& benchmark_particles() {
+    static auto particles = test_particles(SerializationBenchmarkCount);
+    return particles;
+}
+
+static OsErrorOr<void> write_particle_per_field(Writer& writer, Particle const& particle) {
+    TRY(writer.write_little_endian(particle.id));
+    TRY(writer.write_little_endian(static_cast<uint8_t>(particle.type)));
+    TRY(writer.write_little_endian(static_cast<uint8_t>(particle.alive)));
+    TRY(writer.write_little_endian(particle.position.x));
+    TRY(writer.write_little_endian(particle.position.y));
+    TRY(writer.write_little_endian(particle.position.z));
+    TRY(writer.write_little_endian(particle.mass));
+    return {};
+}
+
+static OsErrorOr<Particle> read_particle_per_field(BinaryReader& reader) {
+    Particle particle;
+    particle.id = TRY(reader.read_little_endian<uint64_t>());
+    particle.type = static_cast<ParticleType>(TRY(reader.read_little_endian<uint8_t>()));
+    particle.alive = TRY(reader.read_little_endian<uint8_t>()) != 0;
+    particle.position.x = TRY(reader.read_little_endian<float>());
+    particle.position.y = TRY(reader.read_little_endian<float>());
+    particle.position.z = TRY(reader.read_little_endian<float>());
+    particle.mass = TRY(reader.read_little_endian<double>());
+    return particle;
+}
+
+static Util::Buffer const& benchmark_serialized_particles() {
+    static Util::Buffer data = [] {
+        Util::WritableMemoryStream out;
+        Writer writer { out };
+        MUST(write_array<Particle>(writer, benchmark_particles()));
+        return out.release_buffer();
+    }();
+    return data;
+}
+
+static size_t volatile serialized_size_sink;
+static double volatile mass_sink;
+
+BENCHMARK_THROUGHPUT(write_per_field, SerializationBenchmarkCount * 30) {
+    Util::WritableMemoryStream out;
+    out.reserve(SerializationBenchmarkCount * 30);
+    Util::BufferedWriter buffered { out };
+    Writer writer { buffered };
+    for (auto const& particle : benchmark_particles()) {
+        MUST(write_particle_per_field(writer, particle));
+    }
+    MUST(buffered.flush());
+    serialized_size_sink = out.data().size();
+}
+
+BENCHMARK_THROUGHPUT(write_array, SerializationBenchmarkCount * 30) {
+    Util::WritableMemoryStream out;
+    out.reserve(SerializationBenchmarkCount * 30);
+    Writer writer { out };
+    MUST(write_array<Particle>(writer, benchmark_particles()));
+    serialized_size_sink = out.data().size();
+}
+
+BENCHMARK_THROUGHPUT(read_per_field, SerializationBenchmarkCount * 30) {
+    auto in = Util::ReadableMemoryStream::borrow(benchmark_serialized_particles().span());
+    BinaryReader reader { in };
+    static std::vector<Particle> particles(SerializationBenchmarkCount);
+    for (auto& particle : particles) {
+        particle = MUST(read_particle_per_field(reader));
+    }
+    mass_sink = particles.back().mass;
+}
+
+BENCHMARK_THROUGHPUT(read_array, SerializationBenchmarkCount * 30) {
+    auto in = Util::ReadableMemoryStream::borrow(benchmark_serialized_particles().span());
+    BinaryReader reader { in };
+    static std::vector<Particle> particles(SerializationBenchmarkCount);
+    MUST(read_array<Particle>(reader, particles));
+    mass_sink = particles.back().mass;
+}
+
+// Sum a single field without decoding whole records.
+BENCHMARK_THROUGHPUT(read_array_view_field, SerializationBenchmarkCount * 30) {
+    auto in = Util::ReadableMemoryStream::borrow(benchmark_serialized_particles().span());
+    BinaryReader reader { in };
+    auto view = MUST(read_array_view<Particle>(reader, SerializationBenchmarkCount)).value();
+    double mass = 0;
+    for (size_t s = 0; s < view.size(); s++) {
+        mass += view.get<&Particle::mass>(s);
+    }
+    mass_sink = mass;
+}
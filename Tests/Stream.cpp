@@ -1,8 +1,15 @@
 #include <Util/Testing.hpp>
 
+#include "TestHelpers.hpp"
+
+#include <Util/Arena.hpp>
 #include <Util/Stream.hpp>
 #include <Util/Stream/File.hpp>
 #include <Util/UString.hpp>
+#include <atomic>
+#include <future>
+#include <random>
+#include <thread>
 #include <vector>
 
 ErrorOr<void, __TestSuite::TestError> expect_buffers_equal(std::span<uint8_t const> got, std::span<uint8_t const> expected) {
@@ -11,6 +18,14 @@ ErrorOr<void, __TestSuite::TestError> expect_buffers_equal(std::span<uint8_t con
     return {};
 }
 
+// Memory stream that doesn't expose its memory, so that readers buffer it
+// like a file.
+struct OpaqueMemoryStream : public Util::ReadableMemoryStream {
+    using ReadableMemoryStream::ReadableMemoryStream;
+
+    virtual std::optional<std::span<uint8_t const>> peek_span() const override { return {}; }
+};
+
 TEST_CASE(writable_memory_stream) {
 
     Util::WritableMemoryStream out;
@@ -23,11 +38,75 @@ TEST_CASE(writable_memory_stream) {
     return {};
 }
 
+TEST_CASE(writable_memory_stream_seek) {
+    Util::WritableMemoryStream out;
+    Writer writer { out };
+
+    // Back-patching a length prefix
+    EXPECT_NO_ERROR(writer.write_little_endian<uint16_t>(0));
+    EXPECT_NO_ERROR(writer.write("abc"));
+    EXPECT_NO_ERROR(out.seek(0, SeekDirection::FromStart));
+    EXPECT_NO_ERROR(writer.write_little_endian<uint16_t>(3));
+    EXPECT_EQ(out.offset(), 2u);
+    TRY(expect_buffers_equal(out.data(), std::span<uint8_t const> { { 0x03, 0x00, 'a', 'b', 'c' } }));
+
+    // Overwriting past the end extends the data
+    EXPECT_NO_ERROR(out.seek(-1, SeekDirection::FromEnd));
+    EXPECT_NO_ERROR(writer.write("de"));
+    TRY(expect_buffers_equal(out.data(), std::span<uint8_t const> { { 0x03, 0x00, 'a', 'b', 'd', 'e' } }));
+
+    // Gaps are filled with zeros
+    EXPECT_NO_ERROR(out.seek(2, SeekDirection::FromEnd));
+    EXPECT_NO_ERROR(writer.write("f"));
+    TRY(expect_buffers_equal(out.data(), std::span<uint8_t const> { { 0x03, 0x00, 'a', 'b', 'd', 'e', 0, 0, 'f' } }));
+
+    EXPECT(out.seek(-10, SeekDirection::FromCurrent).is_error());
+    return {};
+}
+
+TEST_CASE(writable_memory_stream_release_buffer) {
+    Util::WritableMemoryStream out;
+    out.reserve(5);
+    auto reserved = out.data().data();
+    EXPECT_NO_ERROR(Writer { out }.write("hello"));
+    EXPECT_EQ(out.data().data(), reserved);
+
+    auto buffer = out.release_buffer();
+    EXPECT_EQ(buffer.begin(), reserved);
+    EXPECT_EQ(buffer.decode().release_value().encode(), "hello");
+    EXPECT(out.data().empty());
+
+    // The stream can be reused.
+    EXPECT_NO_ERROR(Writer { out }.write("world"));
+    EXPECT_EQ(out.release_buffer().decode().release_value().encode(), "world");
+    return {};
+}
+
 TEST_CASE(writer_fmt_integration) {
     Util::WritableMemoryStream out;
     Writer writer { out };
-    writer.writeff("{}", 12.25);
+    EXPECT_NO_ERROR(writer.writeff("{}", 12.25));
     TRY(expect_buffers_equal(out.data(), std::span<uint8_t const> { { '1', '2', '.', '2', '5' } }));
+
+    // Long output is written in bulk too.
+    EXPECT_NO_ERROR(writer.writeff("{:>1000}", 'x'));
+    EXPECT_EQ(out.data().size(), 1005u);
+    EXPECT_EQ(out.data().back(), 'x');
+    return {};
+}
+
+TEST_CASE(writer_fmt_error) {
+    struct FailingStream : public Util::WritableStream {
+        virtual OsErrorOr<size_t> write(std::span<uint8_t const>) override {
+            return OsError { ENOSPC, "FailingStream::write" };
+        }
+        virtual OsErrorOr<void> seek(ssize_t, SeekDirection) override {
+            return {};
+        }
+    };
+    FailingStream out;
+    auto result = Writer { out }.writeff("{}", 12.25);
+    EXPECT(result.is_error() && result.release_error().error == ENOSPC);
     return {};
 }
 
@@ -92,6 +171,99 @@ TEST_CASE(readable_memory_stream) {
     return {};
 }
 
+TEST_CASE(readable_memory_stream_borrow) {
+    std::string data = "hello world\nsecond line";
+    auto stream = Util::ReadableMemoryStream::borrow_string(data);
+    EXPECT_EQ(stream.peek_span()->data(), reinterpret_cast<uint8_t const*>(data.data()));
+
+    // BinaryReader uses memory of the stream directly.
+    Util::BinaryReader reader { stream };
+    auto view = reader.read_view(5).release_value();
+    EXPECT(view.has_value());
+    EXPECT_EQ(view->data(), reinterpret_cast<uint8_t const*>(data.data()));
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { ' ' });
+    auto line = reader.read_until_view('\n').release_value();
+    EXPECT_EQ(line->data(), reinterpret_cast<uint8_t const*>(data.data() + 6));
+    EXPECT_EQ(line->size(), 5u);
+    EXPECT_EQ(reader.peek_span().release_value().size(), 11u);
+    EXPECT(!reader.read_view(12).release_value().has_value());
+    EXPECT_EQ(reader.read_view(11).release_value()->size(), 11u);
+    EXPECT(reader.is_eof());
+    EXPECT(reader.peek_span().release_value().empty());
+
+    // Copying streams are independent of the original data.
+    auto copy = Util::ReadableMemoryStream::from_string(data);
+    data[0] = 'j';
+    EXPECT_EQ(Util::BinaryReader { copy }.get().release_value(), std::optional<uint8_t> { 'h' });
+    return {};
+}
+
+TEST_CASE(readable_memory_stream_copy_move) {
+    auto read_rest = [](Util::ReadableMemoryStream& stream) {
+        return Util::BinaryReader { stream }.read_until('\n').release_value();
+    };
+    auto to_string = [](Util::Buffer const& data) { return std::string { data.begin(), data.end() }; };
+
+    std::optional<Util::ReadableMemoryStream> original = Util::ReadableMemoryStream::from_string("owned data");
+    EXPECT_NO_ERROR(original->seek(6));
+
+    // Copies and moves keep the offset, and don't point into the source.
+    Util::ReadableMemoryStream copy { *original };
+    auto assigned = Util::ReadableMemoryStream::from_string("x");
+    assigned = *original;
+    Util::ReadableMemoryStream moved { Util::ReadableMemoryStream { *original } };
+    original.reset();
+    EXPECT_EQ(to_string(read_rest(copy)), "data");
+    EXPECT_EQ(to_string(read_rest(assigned)), "data");
+    EXPECT_EQ(to_string(read_rest(moved)), "data");
+
+    // Moving between buffers of different resources copies the data.
+    Util::Arena arena;
+    std::optional<Util::ReadableMemoryStream> source = Util::ReadableMemoryStream::from_string("default resource");
+    std::optional<Util::ReadableMemoryStream> target;
+    {
+        Util::ScopedMemoryResource scope { arena };
+        target = Util::ReadableMemoryStream::from_string("arena");
+    }
+    *target = std::move(*source);
+    source.reset();
+    EXPECT_EQ(to_string(read_rest(*target)), "default resource");
+    target.reset();
+
+    // Copies of a borrowing stream borrow the same data.
+    std::string data = "borrowed";
+    auto borrowed = Util::ReadableMemoryStream::borrow_string(data);
+    auto borrowed_copy = borrowed;
+    EXPECT_EQ(borrowed_copy.peek_span()->data(), reinterpret_cast<uint8_t const*>(data.data()));
+    return {};
+}
+
+TEST_CASE(binary_reader_read_view) {
+    constexpr char const* FileName = "/tmp/essautil-test-read-view";
+    std::vector<uint8_t> data(Util::BufferedReader::BufferSize * 3);
+    for (size_t s = 0; s < data.size(); s++) {
+        data[s] = s * 3;
+    }
+    {
+        auto out = Util::WritableFileStream::open(FileName, { .truncate = true }).release_value();
+        EXPECT_NO_ERROR(Writer { out }.write_all(data));
+    }
+
+    // Files are buffered, which grows for views bigger than the buffer.
+    auto file = Util::ReadableFileStream::open(FileName).release_value();
+    Util::BinaryReader reader { file };
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { 0 });
+    auto view = reader.read_view(Util::BufferedReader::BufferSize * 2).release_value();
+    TRY(expect_buffers_equal(*view, std::span { data }.subspan(1, Util::BufferedReader::BufferSize * 2)));
+    EXPECT(!reader.read_view(Util::BufferedReader::BufferSize).release_value().has_value());
+    view = reader.read_view(Util::BufferedReader::BufferSize - 1).release_value();
+    TRY(expect_buffers_equal(*view, std::span { data }.last(Util::BufferedReader::BufferSize - 1)));
+    EXPECT(reader.is_eof());
+
+    remove(FileName);
+    return {};
+}
+
 TEST_CASE(binary_reader_buffering) {
     uint8_t big_buffer[16384];
     for (size_t s = 0; s < 16384; s++) {
@@ -253,6 +425,47 @@ TEST_CASE(binary_reader_read_while) {
     return {};
 }
 
+TEST_CASE(binary_reader_long_runs) {
+    // Runs longer than the reader's buffer
+    std::string data = std::string(10000, 'a') + ";" + std::string(5000, 'b') + ";";
+    Util::ReadableMemoryStream in = Util::ReadableMemoryStream::from_string(data);
+    Util::BinaryReader reader { in };
+
+    EXPECT_EQ(reader.read_while([](uint8_t byte) { return byte == 'a'; }).release_value().size(), 10000u);
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { ';' });
+    auto run = reader.read_until(';').release_value();
+    EXPECT_EQ(run, Buffer::filled(5000, 'b'));
+    EXPECT(reader.is_eof());
+    return {};
+}
+
+TEST_CASE(binary_reader_read_until_view) {
+    std::string data = "first;second;" + std::string(5000, 'x') + ";last";
+    OpaqueMemoryStream in { { reinterpret_cast<uint8_t const*>(data.data()), data.size() } };
+    Util::BinaryReader reader { in };
+
+    auto as_string = [](std::span<uint8_t const> span) {
+        return std::string { reinterpret_cast<char const*>(span.data()), span.size() };
+    };
+
+    EXPECT_EQ(as_string(reader.read_until_view(';').release_value().value()), "first");
+    EXPECT_EQ(as_string(reader.read_until_view(';').release_value().value()), "second");
+
+    // Doesn't fit in the buffer, so nothing is read.
+    EXPECT(!reader.read_until_view(';').release_value());
+    EXPECT_EQ(reader.read_until(';').release_value().size(), 5000u);
+
+    EXPECT_EQ(as_string(reader.read_until_view(';').release_value().value()), "last");
+    EXPECT(reader.is_eof());
+
+    // Memory streams are not limited by the buffer size.
+    auto memory = Util::ReadableMemoryStream::borrow_string(data);
+    Util::BinaryReader memory_reader { memory };
+    EXPECT_NO_ERROR(memory_reader.seek(13));
+    EXPECT_EQ(memory_reader.read_until_view(';').release_value()->size(), 5000u);
+    return {};
+}
+
 TEST_CASE(text_reader_consume_while) {
     Util::ReadableMemoryStream in = Util::ReadableMemoryStream::from_string("test\nhello");
     Util::TextReader reader { in };
@@ -274,6 +487,56 @@ TEST_CASE(text_reader_consume_line) {
     return {};
 }
 
+TEST_CASE(text_reader_chunk_boundaries) {
+    // Lines are longer than the reader's buffer, and multibyte sequences
+    // end up split between refills.
+    std::string data;
+    std::vector<std::string> lines;
+    for (size_t s = 0; s < 10; s++) {
+        std::string line;
+        for (size_t t = 0; t < 1000 + s * 7; t++) {
+            line += t % 3 == 0 ? "ą" : (t % 3 == 1 ? "你" : "x");
+        }
+        lines.push_back(line);
+        data += line + "\n";
+    }
+
+    Util::ReadableMemoryStream in = Util::ReadableMemoryStream::from_string(data);
+    Util::TextReader reader { in };
+    for (auto const& line : lines) {
+        EXPECT_EQ(reader.consume_line().release_value().encode(), line);
+    }
+    EXPECT_EQ(reader.location().line, 10u);
+    EXPECT_EQ(reader.location().offset, Util::UString { data }.size());
+    EXPECT(reader.is_eof());
+    return {};
+}
+
+template<class Reader>
+concept ReadsBytes = requires(Reader& reader, std::span<uint8_t> data) {
+    reader.read(data);
+    reader.get();
+    reader.seek(0);
+};
+
+static_assert(ReadsBytes<Util::BinaryReader>);
+static_assert(!ReadsBytes<Util::TextReader>, "Byte access would bypass decoded codepoints");
+
+TEST_CASE(text_reader_invalid_utf8) {
+    Util::ReadableMemoryStream in = Util::ReadableMemoryStream::from_string("a\xff" "b\nc\xc4");
+    Util::TextReader reader { in };
+
+    EXPECT_EQ(reader.consume_line().release_value().encode(), "a\ufffdb");
+    EXPECT_EQ(reader.location().line, 1u);
+    EXPECT_EQ(reader.consume().release_value(), std::optional<uint32_t> { 'c' });
+    EXPECT_EQ(reader.location().column, 1u);
+    EXPECT_EQ(reader.peek().release_value(), std::optional<uint32_t> { 0xfffd });
+    EXPECT_EQ(reader.consume().release_value(), std::optional<uint32_t> { 0xfffd });
+    EXPECT(!reader.consume().release_value());
+    EXPECT(reader.is_eof());
+    return {};
+}
+
 TEST_CASE(file_streams) {
     constexpr char const* FileName = "/tmp/essautil-test";
     {
@@ -309,6 +572,263 @@ TEST_CASE(file_streams) {
     return {};
 }
 
+TEST_CASE(mapped_file) {
+    constexpr char const* FileName = "/tmp/essautil-test-mapped";
+    std::string data;
+    for (size_t s = 0; s < 10000; s++) {
+        data += static_cast<char>(s * 7);
+    }
+    {
+        auto stream = Util::WritableFileStream::open(FileName, { .truncate = true }).release_value();
+        EXPECT_NO_ERROR(Writer { stream }.write_all({ reinterpret_cast<uint8_t const*>(data.data()), data.size() }));
+    }
+
+    auto file = Util::MappedFile::map(FileName).release_value();
+    TRY(expect_buffers_equal(file.data(), { reinterpret_cast<uint8_t const*>(data.data()), data.size() }));
+    EXPECT_NO_ERROR(file.advise(Util::MappedFile::AccessPattern::Random));
+
+    auto stream = Util::ReadableMappedStream::open(FileName).release_value();
+    BinaryReader reader { stream };
+    EXPECT_EQ(reader.read_big_endian<uint16_t>().release_value(), 0x0007u);
+    EXPECT_NO_ERROR(reader.seek(-1, SeekDirection::FromEnd));
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { static_cast<uint8_t>(9999 * 7) });
+    EXPECT(reader.is_eof());
+
+    EXPECT_EQ(Util::ReadableFileStream::read_file(FileName).release_value(), Buffer { file.data() });
+
+    // Empty files can't be mapped, but should work anyway.
+    {
+        auto stream = Util::WritableFileStream::open(FileName, { .truncate = true }).release_value();
+    }
+    auto empty = Util::MappedFile::map(FileName).release_value();
+    EXPECT_EQ(empty.size(), 0u);
+    EXPECT(Util::ReadableMappedStream { std::move(empty) }.is_eof());
+
+    EXPECT(Util::MappedFile::map("/tmp/essautil-test-does-not-exist").is_error());
+
+    remove(FileName);
+    return {};
+}
+
+TEST_CASE(buffered_writer) {
+    Util::WritableMemoryStream out;
+    {
+        Util::BufferedWriter buffered { out, 16 };
+        Writer writer { buffered };
+
+        EXPECT_NO_ERROR(writer.write_little_endian<uint32_t>(0x03020100));
+        EXPECT_NO_ERROR(writer.write_little_endian<uint32_t>(0x07060504));
+        EXPECT(out.data().empty());
+        EXPECT_EQ(buffered.buffered_size(), 8u);
+
+        // Overflows the buffer, so the first 16 bytes are flushed.
+        uint8_t data[] = { 8, 9, 10, 11, 12, 13, 14, 15, 16, 17 };
+        EXPECT_NO_ERROR(writer.write_all(data));
+        EXPECT_EQ(out.data().size(), 16u);
+        EXPECT_EQ(buffered.buffered_size(), 2u);
+
+        // Bigger than the buffer, written directly together with what was
+        // buffered.
+        std::vector<uint8_t> big;
+        for (uint8_t s = 18; s < 50; s++) {
+            big.push_back(s);
+        }
+        EXPECT_NO_ERROR(writer.write_all(big));
+        EXPECT_EQ(out.data().size(), 50u);
+        EXPECT_EQ(buffered.buffered_size(), 0u);
+
+        EXPECT_NO_ERROR(writer.write_little_endian<uint8_t>(50));
+        EXPECT_EQ(out.data().size(), 50u);
+    }
+    // Flushed on destruction
+    EXPECT_EQ(out.data().size(), 51u);
+    for (size_t s = 0; s < out.data().size(); s++) {
+        EXPECT_EQ(out.data()[s], s);
+    }
+    return {};
+}
+
+TEST_CASE(buffered_writer_error) {
+    // Accepts `limit` bytes, and then fails.
+    struct LimitedStream : public Util::WritableMemoryStream {
+        explicit LimitedStream(size_t limit)
+            : m_limit(limit) { }
+
+        virtual OsErrorOr<size_t> write(std::span<uint8_t const> data) override {
+            if (offset() == m_limit && !data.empty()) {
+                return OsError { ENOSPC, "LimitedStream::write" };
+            }
+            return WritableMemoryStream::write(data.first(std::min(data.size(), m_limit - offset())));
+        }
+
+        size_t m_limit;
+    };
+    std::vector<uint8_t> data(32);
+    for (size_t s = 0; s < data.size(); s++) {
+        data[s] = s;
+    }
+
+    // Filling the buffer up before a failed flush
+    {
+        LimitedStream out { 0 };
+        Util::BufferedWriter buffered { out, 16 };
+        EXPECT_EQ(MUST(buffered.write(std::span { data }.first(10))), 10u);
+        EXPECT_EQ(MUST(buffered.write(std::span { data }.first(10))), 6u);
+        EXPECT_EQ(buffered.buffered_size(), 16u);
+        auto result = buffered.write(std::span { data }.first(10));
+        EXPECT(result.is_error() && result.release_error().error == ENOSPC);
+        EXPECT(buffered.flush().is_error());
+        EXPECT_EQ(buffered.buffered_size(), 16u);
+
+        // Buffered data is written once the stream accepts it again.
+        out.m_limit = 16;
+        EXPECT_NO_ERROR(buffered.flush());
+    }
+
+    // Writing through a part of big data
+    {
+        LimitedStream out { 20 };
+        Util::BufferedWriter buffered { out, 16 };
+        EXPECT_EQ(MUST(buffered.write(std::span { data }.first(4))), 4u);
+        EXPECT_EQ(MUST(buffered.write(data)), 16u);
+        EXPECT_EQ(buffered.buffered_size(), 0u);
+        auto result = Writer { buffered }.write_all(std::span { data }.subspan(16));
+        EXPECT(result.is_error() && result.release_error().error == ENOSPC);
+        TRY(expect_buffers_equal(out.data().subspan(4), std::span { data }.first(16)));
+    }
+    return {};
+}
+
+TEST_CASE(buffered_file_writer) {
+    constexpr char const* FileName = "/tmp/essautil-test-buffered";
+    std::vector<uint8_t> expected;
+    {
+        auto stream = Util::WritableFileStream::open(FileName, { .truncate = true }).release_value();
+        Util::BufferedWriter buffered { stream, 100 };
+        Writer writer { buffered };
+        for (size_t s = 0; s < 1000; s++) {
+            std::vector<uint8_t> data(s % 250, static_cast<uint8_t>(s));
+            EXPECT_NO_ERROR(writer.write_all(data));
+            expected.insert(expected.end(), data.begin(), data.end());
+        }
+        EXPECT_NO_ERROR(buffered.flush());
+    }
+    EXPECT_EQ(Util::ReadableFileStream::read_file(FileName).release_value(), Buffer { expected });
+    remove(FileName);
+    return {};
+}
+
+static ErrorOr<void, __TestSuite::TestError> test_async_file(Util::AsyncIOQueue& queue) {
+    constexpr char const* FileName = "/tmp/essautil-test-async";
+    auto file = Util::AsyncFile::open(queue, FileName, { .write = true, .truncate = true }).release_value();
+
+    std::vector<uint8_t> data(100000);
+    for (size_t s = 0; s < data.size(); s++) {
+        data[s] = s * 13;
+    }
+    // Write out of order, in chunks.
+    std::vector<std::future<OsErrorOr<size_t>>> writes;
+    for (size_t offset = 0; offset < data.size(); offset += 10000) {
+        writes.push_back(file.write_at(std::span { data }.subspan(data.size() - offset - 10000, 10000), data.size() - offset - 10000));
+    }
+    for (auto& write : writes) {
+        EXPECT_EQ(write.get().release_value(), 10000u);
+    }
+
+    std::atomic<size_t> callback_bytes = 0;
+    std::vector<uint8_t> read_data(data.size());
+    for (size_t offset = 0; offset < data.size(); offset += 1000) {
+        file.read_at(std::span { read_data }.subspan(offset, 1000), offset, [&](OsErrorOr<size_t> result) {
+            callback_bytes += result.release_value();
+        });
+    }
+    queue.wait_for_all();
+    EXPECT_EQ(callback_bytes.load(), data.size());
+    EXPECT(read_data == data);
+
+    auto buffer = file.read_all().release_value().get().release_value();
+    TRY(expect_buffers_equal(buffer.span(), data));
+
+    // Reading past the end reads nothing.
+    EXPECT_EQ(file.read_buffer_at(data.size() - 10, 100).get().release_value().size(), 10u);
+
+    auto read_only = Util::AsyncFile::open(queue, FileName).release_value();
+    auto result = read_only.write_at(data, 0).get();
+    EXPECT(result.is_error() && result.release_error().error == EBADF);
+
+    remove(FileName);
+    return {};
+}
+
+TEST_CASE(async_file_io_uring) {
+    auto queue = Util::AsyncIOQueue::create_io_uring(4);
+    if (queue.is_error()) {
+        fmt::print("io_uring not available, skipping\n");
+        return {};
+    }
+    EXPECT_EQ(queue.value()->backend(), Util::AsyncIOQueue::Backend::IoUring);
+    return test_async_file(*queue.value());
+}
+
+TEST_CASE(async_file_thread_pool) {
+    auto queue = Util::AsyncIOQueue::create_thread_pool(3).release_value();
+    EXPECT_EQ(queue->backend(), Util::AsyncIOQueue::Backend::ThreadPool);
+    return test_async_file(*queue);
+}
+
+// Transfers at most a few bytes per operation, like reads of huge sizes
+// or of files that are being written.
+class ShortTransferQueue : public Util::AsyncIOQueue {
+public:
+    static constexpr size_t MaxSize = 1000;
+
+    virtual Backend backend() const override { return m_queue->backend(); }
+
+    virtual void submit_read(int fd, std::span<uint8_t> data, size_t offset, Callback callback) override {
+        m_operation_count++;
+        m_queue->submit_read(fd, data.first(std::min(data.size(), MaxSize)), offset, std::move(callback));
+    }
+
+    virtual void submit_write(int fd, std::span<uint8_t const> data, size_t offset, Callback callback) override {
+        m_operation_count++;
+        m_queue->submit_write(fd, data.first(std::min(data.size(), MaxSize)), offset, std::move(callback));
+    }
+
+    virtual void wait_for_all() override { m_queue->wait_for_all(); }
+
+    size_t operation_count() const { return m_operation_count; }
+
+private:
+    std::unique_ptr<Util::AsyncIOQueue> m_queue = Util::AsyncIOQueue::create_thread_pool(2).release_value();
+    std::atomic<size_t> m_operation_count = 0;
+};
+
+TEST_CASE(async_file_short_reads) {
+    constexpr char const* FileName = "/tmp/essautil-test-async-short";
+    std::vector<uint8_t> data(10500);
+    for (size_t s = 0; s < data.size(); s++) {
+        data[s] = s * 7;
+    }
+    {
+        auto stream = Util::WritableFileStream::open(FileName, { .truncate = true }).release_value();
+        EXPECT_NO_ERROR(Writer { stream }.write_all(data));
+    }
+
+    // Reads are continued until the buffer is full or the end of file.
+    ShortTransferQueue queue;
+    auto file = Util::AsyncFile::open(queue, FileName).release_value();
+    auto buffer = file.read_all().release_value().get().release_value();
+    TRY(expect_buffers_equal(buffer.span(), data));
+    EXPECT_EQ(queue.operation_count(), 11u);
+
+    auto tail = file.read_buffer_at(8000, 5000).get().release_value();
+    TRY(expect_buffers_equal(tail.span(), std::span { data }.subspan(8000)));
+    EXPECT_EQ(queue.operation_count(), 15u);
+
+    remove(FileName);
+    return {};
+}
+
 TEST_CASE(seek) {
     std::initializer_list<uint8_t> data = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
     Util::ReadableMemoryStream out { data };
@@ -325,3 +845,414 @@ TEST_CASE(seek) {
 
     return {};
 }
+
+TEST_CASE(buffered_reader_read_error) {
+    // Returns the data in two reads, with an error between them.
+    struct FlakyStream : public OpaqueMemoryStream {
+        using OpaqueMemoryStream::OpaqueMemoryStream;
+
+        virtual OsErrorOr<size_t> read(std::span<uint8_t> data) override {
+            if (++m_reads == 2) {
+                return OsError { EIO, "FlakyStream::read" };
+            }
+            return OpaqueMemoryStream::read(data.first(std::min<size_t>(data.size(), 4)));
+        }
+
+        size_t m_reads = 0;
+    };
+
+    // Error while moving unread data to the front of the buffer
+    {
+        FlakyStream stream { bytes_of("abcdefgh") };
+        Util::BinaryReader reader { stream };
+        EXPECT_EQ(MUST(reader.get()), std::optional<uint8_t> { 'a' });
+        EXPECT_EQ(MUST(reader.get()), std::optional<uint8_t> { 'b' });
+        EXPECT(reader.read_view(3).is_error());
+        EXPECT_EQ(string_of(MUST(reader.read_until('\0')).span()), "cdefgh");
+    }
+
+    // Error after consuming all buffered data
+    {
+        FlakyStream stream { bytes_of("abcdefgh") };
+        Util::BinaryReader reader { stream };
+        uint8_t data[4];
+        EXPECT(MUST(reader.read_all(data)));
+        EXPECT(reader.get().is_error());
+        EXPECT_EQ(string_of(MUST(reader.read_until('\0')).span()), "efgh");
+    }
+    return {};
+}
+
+TEST_CASE(buffered_reader_seek_within_buffer) {
+    struct CountingStream : public OpaqueMemoryStream {
+        using OpaqueMemoryStream::OpaqueMemoryStream;
+
+        virtual OsErrorOr<size_t> read(std::span<uint8_t> data) override {
+            reads++;
+            return ReadableMemoryStream::read(data);
+        }
+        virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction) override {
+            seeks++;
+            return ReadableMemoryStream::seek(count, direction);
+        }
+
+        size_t reads = 0;
+        size_t seeks = 0;
+    };
+
+    std::vector<uint8_t> data(10000);
+    for (size_t s = 0; s < data.size(); s++) {
+        data[s] = s;
+    }
+    CountingStream stream { data };
+    Util::BinaryReader reader { stream };
+
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { 0 });
+    EXPECT_NO_ERROR(reader.seek(99));
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { 100 });
+    EXPECT_NO_ERROR(reader.seek(-51));
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { 50 });
+    EXPECT_EQ(stream.reads, 1u);
+    EXPECT_EQ(stream.seeks, 0u);
+
+    // Position of the stream is unknown until the first absolute seek.
+    EXPECT_NO_ERROR(reader.seek(5000, SeekDirection::FromStart));
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { 5000 % 256 });
+    EXPECT_NO_ERROR(reader.seek(5200, SeekDirection::FromStart));
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { 5200 % 256 });
+    EXPECT_NO_ERROR(reader.seek(4990, SeekDirection::FromStart));
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { 4990 % 256 });
+    EXPECT_EQ(stream.reads, 3u);
+    EXPECT_EQ(stream.seeks, 2u);
+
+    // Big reads bypass the buffer, which must be then dropped.
+    EXPECT_NO_ERROR(reader.seek(0, SeekDirection::FromStart));
+    std::vector<uint8_t> big(Util::BufferedReader::BufferSize * 2);
+    EXPECT(reader.read_all(big).release_value());
+    EXPECT_NO_ERROR(reader.seek(-10));
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { (big.size() - 10) % 256 });
+    EXPECT_NO_ERROR(reader.seek(big.size() - 5, SeekDirection::FromStart));
+    EXPECT_EQ(reader.get().release_value(), std::optional<uint8_t> { (big.size() - 5) % 256 });
+    return {};
+}
+
+TEST_CASE(file_read_at_write_at) {
+    constexpr char const* FileName = "/tmp/essautil-test-read-at";
+    {
+        auto out = Util::WritableFileStream::open(FileName, { .truncate = true }).release_value();
+        EXPECT_NO_ERROR(Writer { out }.write("hello world"));
+        EXPECT_EQ(out.write_at(6, std::span<uint8_t const> { { 'W' } }).release_value(), 1u);
+        EXPECT_NO_ERROR(Writer { out }.write("!"));
+    }
+    auto in = Util::ReadableFileStream::open(FileName).release_value();
+    std::array<uint8_t, 5> data;
+    EXPECT_EQ(in.read_at(6, data).release_value(), 5u);
+    EXPECT_EQ(std::string(data.begin(), data.end()), "World");
+    EXPECT_EQ(in.read_at(10, data).release_value(), 2u);
+    EXPECT_EQ(in.read_at(100, data).release_value(), 0u);
+
+    // File position isn't affected.
+    EXPECT_EQ(Util::BinaryReader { in }.read_until('\0').release_value().decode().release_value().encode(), "hello World!");
+    remove(FileName);
+    return {};
+}
+
+TEST_CASE(random_access_reader) {
+    constexpr char const* FileName = "/tmp/essautil-test-random-access";
+    std::vector<uint8_t> data(100000);
+    for (size_t s = 0; s < data.size(); s++) {
+        data[s] = s * 7 + s / 256;
+    }
+    {
+        auto out = Util::WritableFileStream::open(FileName, { .truncate = true }).release_value();
+        EXPECT_NO_ERROR(Writer { out }.write_all(data));
+    }
+    auto file = Util::ReadableFileStream::open(FileName).release_value();
+    Util::RandomAccessReader reader { file, 1000, 8 };
+
+    // Crossing block boundaries and end of file
+    std::vector<uint8_t> read_data(2500);
+    EXPECT_EQ(reader.read_at(1500, read_data).release_value(), 2500u);
+    TRY(expect_buffers_equal(read_data, std::span { data }.subspan(1500, 2500)));
+    EXPECT_EQ(reader.statistics().misses, 3u);
+    EXPECT_NO_ERROR(reader.read_at(2000, std::span { read_data }.first(10)));
+    EXPECT_EQ(reader.statistics().hits, 1u);
+    EXPECT_EQ(reader.read_at(data.size() - 100, read_data).release_value(), 100u);
+    TRY(expect_buffers_equal(std::span { read_data }.first(100), std::span { data }.last(100)));
+    EXPECT(!reader.read_all_at(data.size() + 100, read_data).release_value());
+
+    // Multiple threads reading at once
+    std::atomic<bool> all_equal = true;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 random { static_cast<uint32_t>(t) };
+            std::vector<uint8_t> buffer(3000);
+            for (size_t s = 0; s < 1000; s++) {
+                auto offset = random() % data.size();
+                auto size = random() % buffer.size();
+                auto bytes_read = MUST(reader.read_at(offset, std::span { buffer }.first(size)));
+                auto expected = std::span { data }.subspan(offset, std::min(size, data.size() - offset));
+                if (bytes_read != expected.size() || !std::equal(expected.begin(), expected.end(), buffer.begin())) {
+                    all_equal = false;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT(all_equal.load());
+    remove(FileName);
+    return {};
+}
+
+constexpr size_t TextBenchmarkSize = 16 * 1024 * 1024;
+
+// Generated once, lines of mostly ASCII text with some Polish characters.
+static std::string const& text_benchmark_file() {
+    static std::string const file_name = [] {
+        std::string const name = "/tmp/essautil-text-benchmark";
+        std::string text;
+        for (size_t s = 0; text.size() < TextBenchmarkSize; s++) {
+            text += "Linia " + std::to_string(s) + ": zażółć gęślą jaźń, the quick brown fox\n";
+        }
+        auto stream = Util::WritableFileStream::open(name, { .truncate = true }).release_value();
+        MUST(Writer { stream }.write_all({ reinterpret_cast<uint8_t const*>(text.data()), text.size() }));
+        return name;
+    }();
+    return file_name;
+}
+
+BENCHMARK_THROUGHPUT(text_reader_consume_line, TextBenchmarkSize) {
+    auto stream = Util::ReadableFileStream::open(text_benchmark_file()).release_value();
+    Util::TextReader reader { stream };
+    while (!reader.is_eof()) {
+        (void)MUST(reader.consume_line());
+    }
+}
+
+BENCHMARK_THROUGHPUT(text_reader_consume, TextBenchmarkSize) {
+    auto stream = Util::ReadableFileStream::open(text_benchmark_file()).release_value();
+    Util::TextReader reader { stream };
+    while (MUST(reader.consume())) {
+    }
+}
+
+BENCHMARK_THROUGHPUT(binary_reader_read_until, TextBenchmarkSize) {
+    auto stream = Util::ReadableFileStream::open(text_benchmark_file()).release_value();
+    Util::BinaryReader reader { stream };
+    while (!reader.is_eof()) {
+        (void)MUST(reader.read_until('\n'));
+    }
+}
+
+BENCHMARK_THROUGHPUT(binary_reader_read_until_view, TextBenchmarkSize) {
+    auto stream = Util::ReadableFileStream::open(text_benchmark_file()).release_value();
+    Util::BinaryReader reader { stream };
+    while (!reader.is_eof()) {
+        if (!MUST(reader.read_until_view('\n'))) {
+            (void)MUST(reader.read_until('\n'));
+        }
+    }
+}
+
+// Load the file and touch every byte.
+static size_t volatile newline_count;
+
+BENCHMARK_THROUGHPUT(read_file, TextBenchmarkSize) {
+    auto buffer = MUST(Util::ReadableFileStream::read_file(text_benchmark_file()));
+    newline_count = std::count(buffer.begin(), buffer.end(), '\n');
+}
+
+BENCHMARK_THROUGHPUT(mapped_file, TextBenchmarkSize) {
+    auto stream = MUST(Util::ReadableMappedStream::open(text_benchmark_file()));
+    auto data = stream.remaining_data();
+    newline_count = std::count(data.begin(), data.end(), '\n');
+}
+
+constexpr size_t FloatBenchmarkCount = 10'000'000;
+
+BENCHMARK_THROUGHPUT(write_floats_buffered, FloatBenchmarkCount * sizeof(float)) {
+    auto stream = MUST(Util::WritableFileStream::open("/tmp/essautil-float-benchmark", { .truncate = true }));
+    Util::BufferedWriter buffered { stream };
+    Writer writer { buffered };
+    for (size_t s = 0; s < FloatBenchmarkCount; s++) {
+        MUST(writer.write_little_endian(static_cast<float>(s)));
+    }
+    MUST(buffered.flush());
+}
+
+// For comparison, 100 times less floats since every one is a syscall.
+BENCHMARK_THROUGHPUT(write_floats_unbuffered, FloatBenchmarkCount / 100 * sizeof(float)) {
+    auto stream = MUST(Util::WritableFileStream::open("/tmp/essautil-float-benchmark", { .truncate = true }));
+    Writer writer { stream };
+    for (size_t s = 0; s < FloatBenchmarkCount / 100; s++) {
+        MUST(writer.write_little_endian(static_cast<float>(s)));
+    }
+}
+
+constexpr size_t FormatBenchmarkCount = 1'000'000;
+
+BENCHMARK(writeff_buffered) {
+    auto stream = MUST(Util::WritableFileStream::open("/tmp/essautil-format-benchmark", { .truncate = true }));
+    Util::BufferedWriter buffered { stream };
+    Writer writer { buffered };
+    for (size_t s = 0; s < FormatBenchmarkCount; s++) {
+        MUST(writer.writeff("{}: {:.2f}\n", s, s * 0.25));
+    }
+    MUST(buffered.flush());
+}
+
+BENCHMARK(fmt_print_file) {
+    auto file = fopen("/tmp/essautil-format-benchmark", "w");
+    for (size_t s = 0; s < FormatBenchmarkCount; s++) {
+        fmt::print(file, "{}: {:.2f}\n", s, s * 0.25);
+    }
+    fclose(file);
+}
+
+// Many small files, like assets that are loaded at startup.
+constexpr size_t SmallFileCount = 256;
+constexpr size_t SmallFileSize = 16 * 1024;
+
+static std::vector<std::string> const& small_benchmark_files() {
+    static std::vector<std::string> const files = [] {
+        std::vector<std::string> files;
+        std::vector<uint8_t> data(SmallFileSize, 'x');
+        for (size_t s = 0; s < SmallFileCount; s++) {
+            files.push_back("/tmp/essautil-small-benchmark-" + std::to_string(s));
+            auto stream = Util::WritableFileStream::open(files.back(), { .truncate = true }).release_value();
+            MUST(Writer { stream }.write_all(data));
+        }
+        return files;
+    }();
+    return files;
+}
+
+BENCHMARK_THROUGHPUT(small_files_blocking, SmallFileCount * SmallFileSize) {
+    for (auto const& file : small_benchmark_files()) {
+        (void)MUST(Util::ReadableFileStream::read_file(file));
+    }
+}
+
+static void read_small_files_async(Util::AsyncIOQueue& queue) {
+    std::vector<Util::AsyncFile> files;
+    std::vector<std::future<OsErrorOr<Buffer>>> buffers;
+    for (auto const& name : small_benchmark_files()) {
+        files.push_back(MUST(Util::AsyncFile::open(queue, name)));
+        buffers.push_back(files.back().read_buffer_at(0, SmallFileSize));
+    }
+    for (auto& buffer : buffers) {
+        (void)MUST(buffer.get());
+    }
+}
+
+BENCHMARK_THROUGHPUT(small_files_io_uring, SmallFileCount * SmallFileSize) {
+    // Fall back to threads where io_uring isn't available (e.g in
+    // containers), so that the other benchmarks still run.
+    static auto queue = [] {
+        auto queue = Util::AsyncIOQueue::create_io_uring();
+        if (queue.is_error()) {
+            fmt::print("io_uring not available, using a thread pool\n");
+            return MUST(Util::AsyncIOQueue::create_thread_pool());
+        }
+        return queue.release_value();
+    }();
+    read_small_files_async(*queue);
+}
+
+BENCHMARK_THROUGHPUT(small_files_thread_pool, SmallFileCount * SmallFileSize) {
+    static auto queue = MUST(Util::AsyncIOQueue::create_thread_pool());
+    read_small_files_async(*queue);
+}
+
+// Small reads at random offsets, clustered within a part of the file that
+// fits in the cache.
+constexpr size_t RandomReadCount = 100'000;
+constexpr size_t RandomReadSize = 64;
+constexpr size_t RandomReadRange = 1024 * 1024;
+
+BENCHMARK_THROUGHPUT(random_reads_cached, RandomReadCount * RandomReadSize) {
+    auto file = MUST(Util::ReadableFileStream::open(text_benchmark_file()));
+    Util::RandomAccessReader reader { file };
+    std::mt19937 random { 1234 };
+    std::array<uint8_t, RandomReadSize> data;
+    for (size_t s = 0; s < RandomReadCount; s++) {
+        (void)MUST(reader.read_all_at(random() % RandomReadRange, data));
+    }
+}
+
+BENCHMARK_THROUGHPUT(random_reads_seek, RandomReadCount * RandomReadSize) {
+    auto file = MUST(Util::ReadableFileStream::open(text_benchmark_file()));
+    Util::BinaryReader reader { file };
+    std::mt19937 random { 1234 };
+    std::array<uint8_t, RandomReadSize> data;
+    for (size_t s = 0; s < RandomReadCount; s++) {
+        MUST(reader.seek(random() % RandomReadRange, SeekDirection::FromStart));
+        (void)MUST(reader.read_all(data));
+    }
+}
+
+// A table of offsets to variable-size records, which is written before the
+// records and filled in after them.
+constexpr size_t BackPatchRecordCount = 100'000;
+
+static void serialize_with_back_patched_offsets(Util::WritableMemoryStream& out) {
+    Writer writer { out };
+    MUST(writer.write_little_endian<uint32_t>(BackPatchRecordCount));
+    auto table_offset = out.offset();
+    MUST(out.seek(BackPatchRecordCount * sizeof(uint32_t)));
+
+    std::vector<uint32_t> offsets;
+    offsets.reserve(BackPatchRecordCount);
+    for (size_t s = 0; s < BackPatchRecordCount; s++) {
+        offsets.push_back(out.offset());
+        MUST(writer.write_little_endian<uint64_t>(s));
+        MUST(writer.write_little_endian<uint16_t>(s % 32));
+        MUST(writer.write_all(std::span<uint8_t const> { reinterpret_cast<uint8_t const*>("abcdefghijklmnopqrstuvwxyz012345"), s % 32 }));
+    }
+
+    MUST(out.seek(table_offset, SeekDirection::FromStart));
+    for (auto offset : offsets) {
+        MUST(writer.write_little_endian<uint32_t>(offset));
+    }
+}
+
+static size_t volatile serialized_size;
+
+BENCHMARK(serialize_back_patched) {
+    Util::WritableMemoryStream out;
+    serialize_with_back_patched_offsets(out);
+    serialized_size = out.release_buffer().size();
+}
+
+static std::string const& text_benchmark_data() {
+    static std::string data = [] {
+        auto buffer = MUST(Util::ReadableFileStream::read_file(text_benchmark_file()));
+        return std::string { reinterpret_cast<char const*>(buffer.begin()), buffer.size() };
+    }();
+    return data;
+}
+
+static void count_lines(Util::ReadableMemoryStream& stream) {
+    Util::BinaryReader reader { stream };
+    size_t count = 0;
+    while (!reader.is_eof()) {
+        if (!MUST(reader.read_until_view('\n'))) {
+            (void)MUST(reader.read_until('\n'));
+        }
+        count++;
+    }
+    newline_count = count;
+}
+
+BENCHMARK_THROUGHPUT(memory_stream_copy, TextBenchmarkSize) {
+    auto stream = Util::ReadableMemoryStream::from_string(text_benchmark_data());
+    count_lines(stream);
+}
+
+BENCHMARK_THROUGHPUT(memory_stream_borrow, TextBenchmarkSize) {
+    auto stream = Util::ReadableMemoryStream::borrow_string(text_benchmark_data());
+    count_lines(stream);
+}
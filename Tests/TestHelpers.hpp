@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+
+inline std::span<uint8_t const> bytes_of(std::string_view string) {
+    return { reinterpret_cast<uint8_t const*>(string.data()), string.size() };
+}
+
+inline std::string_view string_of(std::span<uint8_t const> bytes) {
+    return { reinterpret_cast<char const*>(bytes.data()), bytes.size() };
+}
+
+// Forwards to new_delete_resource(), counting bytes that are currently
+// allocated and the total number of allocations.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t allocated_bytes = 0;
+    size_t allocations = 0;
+
+private:
+    virtual void* do_allocate(size_t bytes, size_t alignment) override {
+        allocated_bytes += bytes;
+        allocations++;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    virtual void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        allocated_bytes -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    virtual bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        return this == &other;
+    }
+};
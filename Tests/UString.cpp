@@ -1,7 +1,18 @@
 #include <Util/Testing.hpp>
 
+#include "TestHelpers.hpp"
+
+#include <Util/Buffer.hpp>
+#include <Util/MemoryResource.hpp>
 #include <Util/UString.hpp>
+#include <Util/UStringBuilder.hpp>
+#include <Util/UStringSearcher.hpp>
+#include <Util/Utf8.hpp>
 #include <algorithm>
+#include <bit>
+#include <memory_resource>
+#include <span>
+#include <string>
 #include <vector>
 
 TEST_CASE(construction) {
@@ -66,6 +77,99 @@ TEST_CASE(move) {
     return {};
 }
 
+static bool is_stored_inline(UString const& string) {
+    auto object = reinterpret_cast<uint8_t const*>(&string);
+    auto storage = reinterpret_cast<uint8_t const*>(string.storage());
+    return storage >= object && storage < object + sizeof(UString);
+}
+
+TEST_CASE(inline_storage) {
+    // Short strings don't allocate
+    UString short_string { "km/s" };
+    EXPECT(is_stored_inline(short_string));
+    EXPECT(is_stored_inline(UString { 'a' }));
+    EXPECT(!is_stored_inline(UString { "longer string" }));
+
+    // Copy gets its own inline storage
+    auto copy = short_string;
+    EXPECT(is_stored_inline(copy));
+    EXPECT(copy.storage() != short_string.storage());
+    EXPECT_EQ(copy.encode(), "km/s");
+
+    // Move moves inline data
+    auto moved = std::move(copy);
+    EXPECT(is_stored_inline(moved));
+    EXPECT_EQ(moved.encode(), "km/s");
+    EXPECT(copy.is_empty());
+
+    // Growing out of inline storage and shrinking back to it
+    auto concatenated = short_string + " and more";
+    EXPECT(!is_stored_inline(concatenated));
+    EXPECT_EQ(concatenated.encode(), "km/s and more");
+    auto shrunk = concatenated.substring(0, 2);
+    EXPECT(is_stored_inline(shrunk));
+    EXPECT_EQ(shrunk.encode(), "km");
+
+    // Multibyte UTF-8 that decodes to a short string
+    UString polish { "ąęłó" };
+    EXPECT(is_stored_inline(polish));
+    EXPECT_EQ(polish.encode(), "ąęłó");
+
+    // Strings in containers survive relocation
+    std::vector<UString> strings;
+    for (size_t s = 0; s < 100; s++) {
+        strings.push_back(UString { std::to_string(s) });
+    }
+    for (size_t s = 0; s < 100; s++) {
+        EXPECT_EQ(strings[s].encode(), std::to_string(s));
+    }
+
+    return {};
+}
+
+TEST_CASE(shared_storage) {
+    UString original { "abcdefghijklmnopqrstuvwxyz" };
+    EXPECT(!original.is_sharing_storage());
+
+    // Copies share storage
+    auto copy = original;
+    EXPECT_EQ(copy.storage(), original.storage());
+    EXPECT(copy.is_sharing_storage());
+    EXPECT(original.is_sharing_storage());
+
+    // Substrings point into the parent
+    auto substring = original.substring(3, 10);
+    EXPECT_EQ(substring.storage(), original.storage() + 3);
+    EXPECT_EQ(substring.encode(), "defghijklm");
+
+    // Erasing from the ends gives substrings too
+    EXPECT_EQ(original.erase(0, 5).storage(), original.storage() + 5);
+    EXPECT_EQ(original.erase(20, 6).storage(), original.storage());
+    EXPECT_EQ(original.erase(20, 6).encode(), "abcdefghijklmnopqrst");
+
+    // Compacting detaches from the parent
+    auto compacted = substring;
+    compacted.compact();
+    EXPECT(compacted.storage() != substring.storage());
+    EXPECT_EQ(compacted.encode(), "defghijklm");
+    EXPECT(!compacted.is_sharing_storage());
+
+    // Substrings outlive parents
+    UString survivor;
+    {
+        UString parent { "this string will be destroyed" };
+        survivor = parent.substring(5, 6);
+    }
+    EXPECT_EQ(survivor.encode(), "string");
+
+    // Assigning a substring of itself
+    UString self { "some long string to be shortened" };
+    self = self.substring(5, 11);
+    EXPECT_EQ(self.encode(), "long string");
+
+    return {};
+}
+
 TEST_CASE(utf8) {
     struct Testcase {
         char const* string;
@@ -94,7 +198,10 @@ TEST_CASE(utf8) {
 
 TEST_CASE(utf8_invalid) {
     std::vector<uint8_t> testcases[] {
-        { 0xc4 }
+        { 0xc4 },
+        { 'a', 0xc4, 'b' },
+        { 0x85 },
+        { 0xff, 'a' },
     };
 
     for (auto const& testcase : testcases) {
@@ -104,6 +211,98 @@ TEST_CASE(utf8_invalid) {
     return {};
 }
 
+TEST_CASE(utf8_replacement) {
+    // Invalid lead byte
+    EXPECT(UString { "a\xff" "b" } == UString { std::span<uint32_t const> { { 'a', 0xfffd, 'b' } } });
+    // Stray continuation byte
+    EXPECT(UString { "a\x85" "b" } == UString { std::span<uint32_t const> { { 'a', 0xfffd, 'b' } } });
+    // Sequence interrupted by ASCII
+    EXPECT(UString { "a\xc4" "b" } == UString { std::span<uint32_t const> { { 'a', 0xfffd, 'b' } } });
+    // Sequence truncated by end of string
+    EXPECT(UString { "ab\xc4" } == UString { std::span<uint32_t const> { { 'a', 'b', 0xfffd } } });
+    // Custom replacement
+    EXPECT(UString("a\xff", UString::Encoding::Utf8, '?') == "a?");
+
+    return {};
+}
+
+TEST_CASE(utf8_simd) {
+    // Put non-ASCII characters at various offsets so that every SIMD
+    // block boundary case is hit.
+    for (size_t position = 0; position < 100; position++) {
+        std::string string(100, 'x');
+        string.insert(position, "ąę你😀");
+        std::vector<uint32_t> simd(string.size());
+        std::vector<uint32_t> scalar(string.size());
+        auto simd_result = Util::Utf8::decode(simd, string);
+        auto scalar_result = Util::Utf8::decode_scalar(scalar, string);
+        EXPECT_EQ(simd_result.codepoints, 104ull);
+        EXPECT_EQ(scalar_result.codepoints, 104ull);
+        EXPECT(simd_result.valid && scalar_result.valid);
+        EXPECT(simd == scalar);
+        EXPECT_EQ(UString { string }.encode(), string);
+    }
+
+    return {};
+}
+
+TEST_CASE(utf8_streaming) {
+    // Split the input at every possible position (including in the middle
+    // of sequences) and check that the result is the same as decoding it at
+    // once.
+    std::string const inputs[] = { "aą你😀b", "a\xc4" "b\xe4\xbd" "c\xff\x80", "\xf0\x9f\x98" };
+    for (auto const& input : inputs) {
+        std::vector<uint32_t> expected(input.size());
+        auto expected_result = Util::Utf8::decode(expected, input);
+        expected.resize(expected_result.codepoints);
+
+        for (size_t split = 0; split <= input.size(); split++) {
+            Util::Utf8::StreamingDecoder decoder;
+            std::vector<uint32_t> output(input.size() + 3 * Util::Utf8::StreamingDecoder::MaxPendingBytes);
+            auto first = decoder.decode(output, std::string_view { input }.substr(0, split));
+            auto second = decoder.decode(std::span { output }.subspan(first.codepoints), std::string_view { input }.substr(split));
+            auto last = decoder.finish(std::span { output }.subspan(first.codepoints + second.codepoints));
+            output.resize(first.codepoints + second.codepoints + last.codepoints);
+            EXPECT(output == expected);
+            EXPECT_EQ(first.valid && second.valid && last.valid, expected_result.valid);
+        }
+    }
+    return {};
+}
+
+TEST_CASE(utf8_encode_simd) {
+    for (size_t position = 0; position < 100; position++) {
+        std::vector<uint32_t> codepoints(100, 'x');
+        uint32_t const non_ascii[] = { L'ą', L'你', 0x1f600, 0x200000, 0x4000000 };
+        codepoints.insert(codepoints.begin() + position, std::begin(non_ascii), std::end(non_ascii));
+
+        auto length = Util::Utf8::encoded_length(codepoints);
+        EXPECT_EQ(length, 100ull + 2 + 3 + 4 + 5 + 6);
+        EXPECT_EQ(Util::Utf8::encoded_length_scalar(codepoints), length);
+
+        std::vector<uint8_t> simd(length);
+        std::vector<uint8_t> scalar(length);
+        EXPECT_EQ(Util::Utf8::encode(simd, codepoints), length);
+        EXPECT_EQ(Util::Utf8::encode_scalar(scalar, codepoints), length);
+        EXPECT(simd == scalar);
+    }
+
+    // Codepoints with the highest bit set must be counted correctly by
+    // signed SIMD comparisons.
+    std::vector<uint32_t> big(64, 0x80000000);
+    EXPECT_EQ(Util::Utf8::encoded_length(big), 64ull * 6);
+
+    return {};
+}
+
+TEST_CASE(encode_ascii) {
+    UString string { "abcąęłdef" };
+    EXPECT_EQ(string.encode(UString::Encoding::ASCII), "abcdef");
+    EXPECT_EQ(string.encode_buffer(UString::Encoding::ASCII), (Buffer { 'a', 'b', 'c', 'd', 'e', 'f' }));
+
+    return {};
+}
+
 BENCHMARK(utf8) {
     std::string big_string;
     constexpr size_t BigStringSize = 500000;
@@ -114,6 +313,289 @@ BENCHMARK(utf8) {
     (void)Util::UString { big_string }.encode();
 }
 
+constexpr size_t DecodeBenchmarkSize = 4 * 1024 * 1024;
+
+static std::string const& ascii_benchmark_input() {
+    static std::string input = [] {
+        std::string string(DecodeBenchmarkSize, ' ');
+        for (size_t s = 0; s < DecodeBenchmarkSize; s++) {
+            string[s] = 32 + s % 95;
+        }
+        return string;
+    }();
+    return input;
+}
+
+static std::string const& mixed_benchmark_input() {
+    // Log-like text: mostly ASCII with some multibyte characters.
+    static std::string input = [] {
+        std::string string;
+        string.reserve(DecodeBenchmarkSize);
+        while (string.size() + 64 < DecodeBenchmarkSize) {
+            string += "[info] zażółć gęślą jaźń: request handled in 12ms\n";
+        }
+        string.resize(DecodeBenchmarkSize, ' ');
+        return string;
+    }();
+    return input;
+}
+
+BENCHMARK_THROUGHPUT(utf8_decode_ascii, DecodeBenchmarkSize) {
+    static std::vector<uint32_t> output(DecodeBenchmarkSize);
+    (void)Util::Utf8::decode(output, ascii_benchmark_input());
+}
+
+BENCHMARK_THROUGHPUT(utf8_decode_ascii_scalar, DecodeBenchmarkSize) {
+    static std::vector<uint32_t> output(DecodeBenchmarkSize);
+    (void)Util::Utf8::decode_scalar(output, ascii_benchmark_input());
+}
+
+BENCHMARK_THROUGHPUT(utf8_decode_mixed, DecodeBenchmarkSize) {
+    static std::vector<uint32_t> output(DecodeBenchmarkSize);
+    (void)Util::Utf8::decode(output, mixed_benchmark_input());
+}
+
+BENCHMARK_THROUGHPUT(utf8_decode_mixed_scalar, DecodeBenchmarkSize) {
+    static std::vector<uint32_t> output(DecodeBenchmarkSize);
+    (void)Util::Utf8::decode_scalar(output, mixed_benchmark_input());
+}
+
+// The decoder that UString used before the single-pass one: a pass to
+// count codepoints and another one to store them, one byte at a time. Kept
+// as a baseline for the benchmarks.
+namespace TwoPassDecoder {
+
+template<class Callback>
+static bool decode_impl(std::string_view string, uint32_t replacement, Callback callback) {
+    bool error = false;
+    for (size_t s = 0; s < string.size(); s++) {
+        auto byte = std::bit_cast<uint8_t>(string[s]);
+        uint32_t codepoint = 0;
+        int additional_bytes_to_expect = 0;
+        if (byte >= 0b1111'1110) {
+            error = true;
+            codepoint = replacement;
+        }
+        else if ((byte & 0b1111'1110) == 0b1111'1100) {
+            additional_bytes_to_expect = 5;
+            codepoint = byte & 0b1;
+        }
+        else if ((byte & 0b1111'1100) == 0b1111'1000) {
+            additional_bytes_to_expect = 4;
+            codepoint = byte & 0b11;
+        }
+        else if ((byte & 0b1111'1000) == 0b1111'0000) {
+            additional_bytes_to_expect = 3;
+            codepoint = byte & 0b111;
+        }
+        else if ((byte & 0b1111'0000) == 0b1110'0000) {
+            additional_bytes_to_expect = 2;
+            codepoint = byte & 0b1111;
+        }
+        else if ((byte & 0b1110'0000) == 0b1100'0000) {
+            additional_bytes_to_expect = 1;
+            codepoint = byte & 0b11111;
+        }
+        else {
+            codepoint = byte & 0x7f;
+        }
+        for (int i = 0; i < additional_bytes_to_expect; i++) {
+            s++;
+            if (s >= string.size()) {
+                return false;
+            }
+            codepoint <<= 6;
+            codepoint |= (string[s] & 0b111111);
+        }
+        callback(codepoint);
+    }
+    return !error;
+}
+
+static std::vector<uint32_t> decode(std::string_view string) {
+    size_t size = 0;
+    decode_impl(string, 0, [&size](auto) { size++; });
+    std::vector<uint32_t> result(size);
+    size_t offset = 0;
+    decode_impl(string, 0xfffd, [&](auto codepoint) { result[offset++] = codepoint; });
+    return result;
+}
+
+}
+
+TEST_CASE(two_pass_decoder_baseline) {
+    for (auto const* input : { &ascii_benchmark_input(), &mixed_benchmark_input() }) {
+        auto expected = UString { *input };
+        auto decoded = TwoPassDecoder::decode(*input);
+        EXPECT(std::ranges::equal(decoded, expected.span()));
+    }
+    return {};
+}
+
+// UString construction before (two passes, byte by byte) and after (a
+// single SIMD pass).
+BENCHMARK_THROUGHPUT(utf8_construct_two_pass_ascii, DecodeBenchmarkSize) {
+    (void)TwoPassDecoder::decode(ascii_benchmark_input());
+}
+
+BENCHMARK_THROUGHPUT(utf8_construct_two_pass_mixed, DecodeBenchmarkSize) {
+    (void)TwoPassDecoder::decode(mixed_benchmark_input());
+}
+
+BENCHMARK_THROUGHPUT(utf8_construct_ascii, DecodeBenchmarkSize) {
+    (void)Util::UString { ascii_benchmark_input() };
+}
+
+BENCHMARK_THROUGHPUT(utf8_construct, DecodeBenchmarkSize) {
+    (void)Util::UString { mixed_benchmark_input() };
+}
+
+// Throughput of encoding is measured in output (UTF-8) bytes, so that it
+// can be compared with decoding.
+BENCHMARK_THROUGHPUT(utf8_encode_ascii, DecodeBenchmarkSize) {
+    static UString string { ascii_benchmark_input() };
+    (void)string.encode();
+}
+
+BENCHMARK_THROUGHPUT(utf8_encode_ascii_scalar, DecodeBenchmarkSize) {
+    static UString string { ascii_benchmark_input() };
+    std::vector<uint8_t> output(Util::Utf8::encoded_length_scalar(string.span()));
+    (void)Util::Utf8::encode_scalar(output, string.span());
+}
+
+BENCHMARK_THROUGHPUT(utf8_encode_mixed, DecodeBenchmarkSize) {
+    static UString string { mixed_benchmark_input() };
+    (void)string.encode_buffer();
+}
+
+BENCHMARK_THROUGHPUT(utf8_encode_mixed_scalar, DecodeBenchmarkSize) {
+    static UString string { mixed_benchmark_input() };
+    std::vector<uint8_t> output(Util::Utf8::encoded_length_scalar(string.span()));
+    (void)Util::Utf8::encode_scalar(output, string.span());
+}
+
+constexpr size_t ShortStringCount = 100000;
+
+static std::vector<UString> const& short_strings() {
+    // Typical identifiers and unit names.
+    static std::vector<UString> strings = [] {
+        char const* const samples[] = { "m", "km", "m/s", "kg", "x", "id", "Tons", "AU" };
+        std::vector<UString> strings;
+        strings.reserve(ShortStringCount);
+        for (size_t s = 0; s < ShortStringCount; s++) {
+            strings.emplace_back(std::string_view { samples[s % std::size(samples)] });
+        }
+        return strings;
+    }();
+    return strings;
+}
+
+BENCHMARK(short_string_construct) {
+    char const* const samples[] = { "m", "km", "m/s", "kg", "x", "id", "Tons", "AU" };
+    std::vector<UString> strings;
+    strings.reserve(ShortStringCount);
+    for (size_t s = 0; s < ShortStringCount; s++) {
+        strings.emplace_back(std::string_view { samples[s % std::size(samples)] });
+    }
+}
+
+BENCHMARK_THROUGHPUT(short_string_copy, ShortStringCount * sizeof(UString)) {
+    auto copy = short_strings();
+    (void)copy;
+}
+
+namespace {
+
+struct MemoryUsage {
+    size_t object_bytes = 0;
+    size_t heap_bytes = 0;
+    size_t allocations = 0;
+
+    size_t total() const { return object_bytes + heap_bytes; }
+};
+
+}
+
+// Memory taken by many UStrings (objects and heap), with std::pmr::u32string
+// as a reference.
+template<class String>
+static MemoryUsage measure_memory_usage(std::span<std::string_view const> samples, size_t count) {
+    std::vector<UString> decoded_samples { samples.begin(), samples.end() };
+    CountingResource resource;
+    std::vector<String> strings;
+    strings.reserve(count);
+    {
+        Util::ScopedMemoryResource scope { resource };
+        for (size_t s = 0; s < count; s++) {
+            if constexpr (std::is_same_v<String, UString>) {
+                strings.emplace_back(samples[s % samples.size()]);
+            }
+            else {
+                auto const& sample = decoded_samples[s % samples.size()];
+                strings.emplace_back(sample.begin(), sample.end(), &resource);
+            }
+        }
+    }
+    return { .object_bytes = count * sizeof(String), .heap_bytes = resource.allocated_bytes, .allocations = resource.allocations };
+}
+
+static void print_memory_usage(std::string_view name, MemoryUsage usage, size_t count) {
+    fmt::print("{}: {:.1f} bytes per string ({:.1f} on the heap, {} allocations)\n",
+        name, static_cast<double>(usage.total()) / count, static_cast<double>(usage.heap_bytes) / count, usage.allocations);
+}
+
+TEST_CASE(memory_usage) {
+    fmt::print("\n");
+
+    // Typical identifiers and unit names. These are stored inline and
+    // don't allocate at all.
+    std::string_view const short_samples[] = { "m", "km", "m/s", "kg", "x", "id", "Tons", "AU" };
+    auto short_usage = measure_memory_usage<UString>(short_samples, ShortStringCount);
+    auto short_usage_u32 = measure_memory_usage<std::pmr::u32string>(short_samples, ShortStringCount);
+    print_memory_usage("short UString", short_usage, ShortStringCount);
+    print_memory_usage("short std::pmr::u32string", short_usage_u32, ShortStringCount);
+    EXPECT_EQ(short_usage.allocations, 0u);
+
+    // Longer strings are stored on the heap, together with a header for
+    // sharing storage. Non-ASCII input is decoded into a buffer sized for
+    // the UTF-8 bytes and then shrunk, which takes a second allocation.
+    std::string_view const long_samples[] = { "temperature", "Mean anomaly at epoch", "Zażółć gęślą jaźń", "semi_major_axis" };
+    auto long_usage = measure_memory_usage<UString>(long_samples, ShortStringCount);
+    auto long_usage_u32 = measure_memory_usage<std::pmr::u32string>(long_samples, ShortStringCount);
+    print_memory_usage("long UString", long_usage, ShortStringCount);
+    print_memory_usage("long std::pmr::u32string", long_usage_u32, ShortStringCount);
+    EXPECT_EQ(long_usage.allocations, ShortStringCount + ShortStringCount / std::size(long_samples));
+    return {};
+}
+
+// Copying and taking substrings should take the same time regardless of
+// the string length.
+static UString make_long_string(size_t size) {
+    return UString { std::string(size, 'x') };
+}
+
+BENCHMARK(copy_1k) {
+    static auto string = make_long_string(1000);
+    auto copy = string;
+    (void)copy;
+}
+
+BENCHMARK(copy_1m) {
+    static auto string = make_long_string(1000000);
+    auto copy = string;
+    (void)copy;
+}
+
+BENCHMARK(substring_1k) {
+    static auto string = make_long_string(1000);
+    (void)string.substring(10, string.size() - 20);
+}
+
+BENCHMARK(substring_1m) {
+    static auto string = make_long_string(1000000);
+    (void)string.substring(10, string.size() - 20);
+}
+
 TEST_CASE(concatenate) {
     UString str1 { "abc" };
     UString str2 { "ąęł" };
@@ -144,9 +626,100 @@ TEST_CASE(find) {
     // Empty string
     EXPECT_EQ(UString { "" }.find("a").has_value(), false);
 
+    // Start offset
+    EXPECT_EQ(UString { "abcabc" }.find("abc", 1).value(), 3ull);
+    EXPECT_EQ(UString { "abcabc" }.find("abc", 4).has_value(), false);
+    EXPECT_EQ(UString { "abcabc" }.find("abc", 6).has_value(), false);
+
+    // Empty needle
+    EXPECT_EQ(UString { "abc" }.find("").value(), 0ull);
+    EXPECT_EQ(UString { "abc" }.find("", 2).value(), 2ull);
+
+    // Periodic needles
+    EXPECT_EQ(UString { "aaaaaaaaab" }.find("aaab").value(), 6ull);
+    EXPECT_EQ(UString { "abababababc" }.find("ababc").value(), 6ull);
+
+    return {};
+}
+
+// Compare with the naive algorithm on random strings over a small alphabet,
+// where there are a lot of partial matches and periodic needles.
+TEST_CASE(find_random) {
+    auto random_string = [](size_t size) {
+        std::vector<uint32_t> result(size);
+        for (auto& cp : result) {
+            cp = 'a' + rand() % 3;
+        }
+        return result;
+    };
+    auto naive_find = [](std::span<uint32_t const> haystack, std::span<uint32_t const> needle, size_t start) -> std::optional<size_t> {
+        auto it = std::search(haystack.begin() + start, haystack.end(), needle.begin(), needle.end());
+        if (it == haystack.end() && !needle.empty())
+            return {};
+        return it - haystack.begin();
+    };
+
+    for (size_t s = 0; s < 2000; s++) {
+        auto haystack = random_string(rand() % 100);
+        auto needle = random_string(1 + rand() % 8);
+        UStringSearcher searcher { needle };
+        size_t start = haystack.empty() ? 0 : rand() % haystack.size();
+        EXPECT(searcher.find(haystack, start) == naive_find(haystack, needle, start));
+
+        // find_end() returns end iterator if not found.
+        auto last = std::find_end(haystack.begin(), haystack.end(), needle.begin(), needle.end());
+        EXPECT_EQ(searcher.rfind(haystack).value_or(haystack.size()), static_cast<size_t>(last - haystack.begin()));
+    }
+
     return {};
 }
 
+TEST_CASE(rfind) {
+    UString haystack { "abcabcabc" };
+    EXPECT_EQ(haystack.rfind("abc").value(), 6ull);
+    EXPECT_EQ(haystack.rfind("abc", 8).value(), 3ull);
+    EXPECT_EQ(haystack.rfind("abc", 3).value(), 0ull);
+    EXPECT_EQ(haystack.rfind("abc", 2).has_value(), false);
+    EXPECT_EQ(haystack.rfind("c").value(), 8ull);
+    EXPECT_EQ(haystack.rfind("xyz").has_value(), false);
+    EXPECT_EQ(haystack.rfind("").value(), 9ull);
+
+    return {};
+}
+
+TEST_CASE(find_all) {
+    EXPECT(UString { "abcabcabc" }.find_all("abc") == std::vector<size_t> { 0, 3, 6 });
+    EXPECT(UString { "aaaa" }.find_all("aa") == std::vector<size_t> { 0, 2 });
+    EXPECT(UString { "abc" }.find_all("x").empty());
+    EXPECT(UString { "ab" }.find_all("") == std::vector<size_t> { 0, 1, 2 });
+
+    return {};
+}
+
+static UString const& search_benchmark_haystack() {
+    static UString haystack { std::string(1000000, 'a') };
+    return haystack;
+}
+
+// Worst case for the naive algorithm: O(n*m) comparisons.
+BENCHMARK(find_periodic_needle) {
+    static UString needle = UString { std::string(1000, 'a') } + "b";
+    (void)search_benchmark_haystack().find(needle);
+}
+
+BENCHMARK(for_each_split_long_separator) {
+    static UString haystack = [] {
+        UStringBuilder builder;
+        for (size_t s = 0; s < 10000; s++) {
+            builder.append(UString { "some field value" });
+            builder.append(UString { " <-- separator --> " });
+        }
+        return builder.release_string();
+    }();
+    size_t count = 0;
+    haystack.for_each_split(" <-- separator --> ", [&](std::span<uint32_t const>) { count++; });
+}
+
 TEST_CASE(find_one_of) {
     UString haystack { "abcabcabc" };
     EXPECT_EQ(haystack.find_one_of({ 'a' }, 0), 0);
@@ -261,6 +834,15 @@ TEST_CASE(for_each_split) {
         EXPECT(!failed && index == 4);
     }
 
+    {
+        // Multi-codepoint separator
+        std::vector<UString> parts;
+        UString { "a, bc, def" }.for_each_split(", ", [&](std::span<uint32_t const> span) {
+            parts.push_back(UString { span });
+        });
+        EXPECT(parts == std::vector<UString> { "a", "bc", "def" });
+    }
+
     return {};
 }
 
@@ -2,6 +2,7 @@
 
 #include "Util/UStringBuilder.hpp"
 #include <algorithm>
+#include <fmt/format.h>
 
 TEST_CASE(append) {
     Util::UStringBuilder builder;
@@ -32,3 +33,54 @@ TEST_CASE(reserve_release) {
     EXPECT(std::find_if_not(string.begin(), string.end(), [](uint32_t cp) { return cp == ' '; }) == string.end());
     return {};
 }
+
+TEST_CASE(append_utf8) {
+    Util::UStringBuilder builder;
+    builder.append(std::string_view { "zażółć " });
+    builder.append(std::string { "gęślą" });
+    builder.append(" jaźń");
+    builder.append(std::string_view { "\xff!" }, '?');
+    EXPECT_EQ(builder.build().encode(), "zażółć gęślą jaźń?!");
+    EXPECT_EQ(builder.codepoints().size(), 19u);
+    return {};
+}
+
+TEST_CASE(appendff_long) {
+    Util::UStringBuilder builder;
+    builder.appendff("{}|{:>1000}|ł", "ą", 'x');
+    auto string = builder.release_string();
+    EXPECT_EQ(string.size(), 1004u);
+    EXPECT_EQ(string.encode(), "ą|" + std::string(999, ' ') + "x|ł");
+    return {};
+}
+
+// Build a report with many small appends.
+constexpr size_t ReportLineCount = 10000;
+
+BENCHMARK(report_ustring_builder) {
+    Util::UStringBuilder builder;
+    for (size_t s = 0; s < ReportLineCount; s++) {
+        builder.append("Item ");
+        builder.appendff("{}: {:.3f}", s, s * 0.5);
+        builder.append('\n');
+    }
+    (void)builder.release_string();
+}
+
+BENCHMARK(report_std_string) {
+    std::string string;
+    for (size_t s = 0; s < ReportLineCount; s++) {
+        string += "Item ";
+        string += fmt::format("{}: {:.3f}", s, s * 0.5);
+        string += '\n';
+    }
+}
+
+BENCHMARK(report_fmt_memory_buffer) {
+    fmt::memory_buffer buffer;
+    for (size_t s = 0; s < ReportLineCount; s++) {
+        buffer.append(std::string_view { "Item " });
+        fmt::format_to(std::back_inserter(buffer), "{}: {:.3f}", s, s * 0.5);
+        buffer.push_back('\n');
+    }
+}
@@ -0,0 +1,155 @@
+#include <Util/Testing.hpp>
+
+#include <Util/UStringRope.hpp>
+
+#include <random>
+#include <vector>
+
+static std::vector<Util::UString> lines_of(Util::UString const& string) {
+    std::vector<Util::UString> lines;
+    string.for_each_line([&](std::span<uint32_t const> line) { lines.push_back(Util::UString { line }); });
+    return lines;
+}
+
+static std::vector<Util::UString> lines_of(Util::UStringRope const& rope) {
+    std::vector<Util::UString> lines;
+    rope.for_each_line([&](std::span<uint32_t const> line) { lines.push_back(Util::UString { line }); });
+    return lines;
+}
+
+TEST_CASE(basic) {
+    Util::UStringRope rope;
+    EXPECT(rope.is_empty());
+    EXPECT_EQ(rope.line_count(), 1u);
+
+    rope.insert("world", 0);
+    rope.insert("hello ", 0);
+    rope.insert("!\nsecond line", rope.size());
+    EXPECT_EQ(rope.to_string().encode(), "hello world!\nsecond line");
+    EXPECT_EQ(rope.at(4), static_cast<uint32_t>('o'));
+    EXPECT_EQ(rope.line_count(), 2u);
+    EXPECT_EQ(rope.line_start(1), 13u);
+    EXPECT_EQ(rope.line(0).encode(), "hello world!");
+    EXPECT_EQ(rope.line(1).encode(), "second line");
+    EXPECT_EQ(rope.substring(6, 5).encode(), "world");
+
+    rope.erase(5, 6);
+    EXPECT_EQ(rope.to_string().encode(), "hello!\nsecond line");
+    rope.erase(0, rope.size());
+    EXPECT(rope.is_empty());
+    EXPECT_EQ(rope.to_string().encode(), "");
+    return {};
+}
+
+TEST_CASE(big_text) {
+    Util::UString line = "The quick brown fox jumps over the lazy dog\n";
+    Util::UString text;
+    for (size_t s = 0; s < 1000; s++) {
+        text = text + line;
+    }
+    Util::UStringRope rope { text };
+    EXPECT_EQ(rope.size(), text.size());
+    EXPECT_EQ(rope.line_count(), 1001u);
+    EXPECT_EQ(rope.to_string(), text);
+    EXPECT_EQ(rope.line(500).encode(), "The quick brown fox jumps over the lazy dog");
+    EXPECT_EQ(rope.line_start(500), 500 * line.size());
+    EXPECT_EQ(rope.line(1000).encode(), "");
+
+    // Insert a lot of text in the middle, so that the tree grows.
+    rope.insert(text, 123);
+    EXPECT_EQ(rope.to_string(), text.insert(text, 123));
+
+    // Erase almost everything, so that it shrinks.
+    rope.erase(10, rope.size() - 20);
+    EXPECT_EQ(rope.to_string(), text.insert(text, 123).erase(10, text.size() * 2 - 20));
+    return {};
+}
+
+TEST_CASE(for_each_line) {
+    for (auto const& string : { Util::UString {}, Util::UString { "\n" }, Util::UString { "a\n" }, Util::UString { "a\n\nb" }, Util::UString { "\n\na\n\n" } }) {
+        EXPECT(lines_of(Util::UStringRope { string }) == lines_of(string));
+    }
+
+    // Lines spanning multiple chunks
+    Util::UString text;
+    for (size_t s = 0; s < 100; s++) {
+        text = text + Util::UString { std::string(s * 37, 'x') } + "\n";
+    }
+    EXPECT(lines_of(Util::UStringRope { text }) == lines_of(text));
+    return {};
+}
+
+TEST_CASE(random_edits) {
+    std::mt19937 random { 1234 };
+    Util::UString expected;
+    Util::UStringRope rope;
+    for (size_t s = 0; s < 5000; s++) {
+        if (expected.size() > 0 && random() % 3 == 0) {
+            auto start = random() % expected.size();
+            auto size = random() % 3000;
+            expected = expected.erase(start, size);
+            rope.erase(start, size);
+        }
+        else {
+            auto where = random() % (expected.size() + 1);
+            std::string inserted(random() % 2000, 'a');
+            for (auto& c : inserted) {
+                c = "abc\n"[random() % 4];
+            }
+            expected = expected.insert(Util::UString { inserted }, where);
+            rope.insert(Util::UString { inserted }, where);
+        }
+        EXPECT_EQ(rope.size(), expected.size());
+        if (s % 100 == 0) {
+            EXPECT_EQ(rope.to_string(), expected);
+            EXPECT(lines_of(rope) == lines_of(expected));
+            if (!expected.is_empty()) {
+                auto index = random() % expected.size();
+                EXPECT_EQ(rope.at(index), expected.at(index));
+                auto start = random() % expected.size();
+                auto size = random() % (expected.size() - start);
+                EXPECT_EQ(rope.substring(start, size), expected.substring(start, size));
+            }
+            auto line = random() % rope.line_count();
+            auto start = line == 0 ? 0 : *expected.find("\n", 0) + 1;
+            if (line > 0) {
+                for (size_t l = 1; l < line; l++) {
+                    start = *expected.find("\n", start) + 1;
+                }
+            }
+            EXPECT_EQ(rope.line_start(line), start);
+        }
+    }
+    return {};
+}
+
+// Simulate typing and deleting at random places of a big document.
+constexpr size_t EditBenchmarkSize = 1024 * 1024;
+
+static Util::UString const& edit_benchmark_document() {
+    static Util::UString document = [] {
+        std::string text;
+        for (size_t s = 0; text.size() < EditBenchmarkSize; s++) {
+            text += "Line " + std::to_string(s) + " of the document\n";
+        }
+        return Util::UString { text };
+    }();
+    return document;
+}
+
+BENCHMARK(random_edit_rope) {
+    static Util::UStringRope rope { edit_benchmark_document() };
+    static std::mt19937 random { 1234 };
+    auto where = random() % rope.size();
+    rope.insert("x", where);
+    rope.erase(random() % rope.size());
+    (void)rope.line(random() % rope.line_count());
+}
+
+BENCHMARK(random_edit_ustring) {
+    static Util::UString string = edit_benchmark_document();
+    static std::mt19937 random { 1234 };
+    auto where = random() % string.size();
+    string = string.insert("x", where);
+    string = string.erase(random() % string.size());
+}
@@ -0,0 +1,353 @@
+#include <Util/Testing.hpp>
+
+#include <Util/Stream.hpp>
+#include <Util/Varint.hpp>
+
+#include <limits>
+#include <random>
+#include <vector>
+
+using Util::Varint::zigzag_decode;
+using Util::Varint::zigzag_encode;
+
+static std::vector<uint8_t> encode(uint64_t value) {
+    uint8_t data[Util::Varint::MaxSize];
+    auto size = Util::Varint::encode(value, data);
+    return { data, data + size };
+}
+
+TEST_CASE(encode) {
+    EXPECT(encode(0) == std::vector<uint8_t> { 0 });
+    EXPECT(encode(127) == std::vector<uint8_t> { 0x7f });
+    EXPECT(encode(128) == (std::vector<uint8_t> { 0x80, 0x01 }));
+    EXPECT(encode(300) == (std::vector<uint8_t> { 0xac, 0x02 }));
+    EXPECT(encode(std::numeric_limits<uint64_t>::max()) == (std::vector<uint8_t> { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 }));
+
+    for (unsigned bits = 0; bits <= 64; bits++) {
+        uint64_t value = bits == 64 ? ~uint64_t { 0 } : (uint64_t { 1 } << bits) - 1;
+        EXPECT_EQ(encode(value).size(), Util::Varint::encoded_size(value));
+    }
+    return {};
+}
+
+TEST_CASE(decode) {
+    std::mt19937_64 random { 1234 };
+    for (unsigned bits = 0; bits <= 64; bits++) {
+        for (size_t s = 0; s < 100; s++) {
+            auto value = bits == 0 ? 0 : random() >> (64 - bits);
+            auto encoded = encode(value);
+
+            // With and without padding (so that both the fast and the slow
+            // path are used).
+            auto decoded = Util::Varint::decode(encoded).value();
+            EXPECT_EQ(decoded.value, value);
+            EXPECT_EQ(decoded.size, encoded.size());
+            encoded.resize(encoded.size() + 16, 0xaa);
+            decoded = Util::Varint::decode(encoded).value();
+            EXPECT_EQ(decoded.value, value);
+            EXPECT_EQ(decoded.size, encoded.size() - 16);
+        }
+    }
+
+    // Incomplete
+    EXPECT_EQ(Util::Varint::decode({})->size, 0u);
+    std::vector<uint8_t> incomplete { 0x80, 0x80, 0x80 };
+    EXPECT_EQ(Util::Varint::decode(incomplete)->size, 0u);
+
+    // Too big
+    std::vector<uint8_t> overflow { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02 };
+    EXPECT(!Util::Varint::decode(overflow));
+    std::vector<uint8_t> too_long(11, 0x80);
+    EXPECT(!Util::Varint::decode(too_long));
+
+    // Overlong, in both paths
+    for (size_t size = 2; size <= Util::Varint::MaxSize; size++) {
+        std::vector<uint8_t> overlong(size, 0x80);
+        overlong.back() = 0x00;
+        EXPECT(!Util::Varint::decode(overlong));
+        overlong.resize(size + 16, 0xaa);
+        EXPECT(!Util::Varint::decode(overlong));
+    }
+    std::vector<uint8_t> zero { 0x00 };
+    EXPECT_EQ(Util::Varint::decode(zero)->value, 0u);
+    return {};
+}
+
+TEST_CASE(zigzag) {
+    EXPECT_EQ(zigzag_encode(0), 0u);
+    EXPECT_EQ(zigzag_encode(-1), 1u);
+    EXPECT_EQ(zigzag_encode(1), 2u);
+    EXPECT_EQ(zigzag_encode(-64), 127u);
+    EXPECT_EQ(zigzag_encode(std::numeric_limits<int64_t>::max()), std::numeric_limits<uint64_t>::max() - 1);
+    EXPECT_EQ(zigzag_encode(std::numeric_limits<int64_t>::min()), std::numeric_limits<uint64_t>::max());
+    for (int64_t value : { int64_t { 0 }, int64_t { -5 }, int64_t { 1000 }, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max() }) {
+        EXPECT_EQ(zigzag_decode(zigzag_encode(value)), value);
+    }
+    return {};
+}
+
+// Small values, e.g counts or enum tags.
+static std::vector<uint64_t> small_values(size_t count) {
+    std::mt19937_64 random { 1234 };
+    std::vector<uint64_t> values(count);
+    for (auto& value : values) {
+        value = random() % 100;
+    }
+    return values;
+}
+
+// Values of all magnitudes, e.g ids or sizes.
+static std::vector<uint64_t> mixed_values(size_t count) {
+    std::mt19937_64 random { 1234 };
+    std::vector<uint64_t> values(count);
+    for (auto& value : values) {
+        value = random() >> (random() % 64);
+    }
+    return values;
+}
+
+// Differences between consecutive timestamps with jitter, zigzag encoded.
+static std::vector<uint64_t> delta_values(size_t count) {
+    std::mt19937_64 random { 1234 };
+    std::normal_distribution<double> jitter { 0, 1000 };
+    std::vector<uint64_t> values(count);
+    for (auto& value : values) {
+        value = zigzag_encode(static_cast<int64_t>(jitter(random)));
+    }
+    return values;
+}
+
+static Util::Buffer encode_values(std::span<uint64_t const> values) {
+    Util::WritableMemoryStream out;
+    MUST(Writer { out }.write_varint_array(values));
+    return out.release_buffer();
+}
+
+TEST_CASE(read_write) {
+    auto values = mixed_values(10000);
+    Util::WritableMemoryStream out;
+    Writer writer { out };
+    EXPECT_NO_ERROR(writer.write_varint(300));
+    EXPECT_NO_ERROR(writer.write_zigzag(-300));
+    EXPECT_NO_ERROR(writer.write_varint_array(values));
+    for (auto value : values) {
+        EXPECT_NO_ERROR(writer.write_varint(value));
+    }
+    EXPECT_NO_ERROR(writer.write_varint(std::numeric_limits<uint64_t>::max()));
+
+    auto in = Util::ReadableMemoryStream::borrow(out.data());
+    BinaryReader reader { in };
+    EXPECT_EQ(MUST(reader.read_varint()), 300u);
+    EXPECT_EQ(MUST(reader.read_zigzag()), -300);
+    std::vector<uint64_t> read(values.size());
+    EXPECT_NO_ERROR(reader.read_varint_array(read));
+    EXPECT(read == values);
+    for (auto value : values) {
+        EXPECT_EQ(MUST(reader.read_varint()), value);
+    }
+    EXPECT_EQ(MUST(reader.read_varint()), std::numeric_limits<uint64_t>::max());
+    EXPECT(reader.read_varint().is_error());
+
+    uint8_t overlong[] { 0x81, 0x80, 0x00 };
+    auto overlong_stream = Util::ReadableMemoryStream::borrow(overlong);
+    auto error = BinaryReader { overlong_stream }.read_varint();
+    EXPECT(error.is_error() && error.release_error().error == EILSEQ);
+    return {};
+}
+
+TEST_CASE(read_across_buffers) {
+    auto values = mixed_values(10000);
+    auto data = encode_values(values);
+    auto stream = Util::WritableFileStream::open("/tmp/essautil-varint-test", { .truncate = true }).release_value();
+    EXPECT_NO_ERROR(Writer { stream }.write_all(data.span()));
+
+    // File streams are read into small buffers, so that values are split
+    // between them.
+    auto in = MUST(Util::ReadableFileStream::open("/tmp/essautil-varint-test"));
+    BinaryReader reader { in };
+    std::vector<uint64_t> read(values.size() / 2);
+    EXPECT_NO_ERROR(reader.read_varint_array(read));
+    EXPECT(std::equal(read.begin(), read.end(), values.begin()));
+    for (size_t s = values.size() / 2; s < values.size(); s++) {
+        EXPECT_EQ(MUST(reader.read_varint()), values[s]);
+    }
+    EXPECT(reader.read_varint_array(read).is_error());
+
+    // Truncated value
+    uint8_t truncated[] { 0x80, 0x80 };
+    auto truncated_in = Util::ReadableMemoryStream::borrow(truncated);
+    BinaryReader truncated_reader { truncated_in };
+    EXPECT(truncated_reader.read_varint().is_error());
+    return {};
+}
+
+TEST_CASE(encoded_sizes) {
+    // Fixed 64-bit encoding would take 8 bytes per value.
+    constexpr size_t Count = 100000;
+    EXPECT_EQ(encode_values(small_values(Count)).size(), Count);
+    EXPECT(encode_values(mixed_values(Count)).size() < Count * 11 / 2);
+    EXPECT(encode_values(delta_values(Count)).size() < Count * 5 / 2);
+    return {};
+}
+
+constexpr size_t VarintBenchmarkCount = 1'000'000;
+
+static uint64_t volatile varint_sink;
+
+static void benchmark_write_fixed(std::vector<uint64_t> const& values) {
+    Util::WritableMemoryStream out;
+    out.reserve(values.size() * 8);
+    Util::BufferedWriter buffered { out };
+    Writer writer { buffered };
+    for (auto value : values) {
+        MUST(writer.write_little_endian(value));
+    }
+    MUST(buffered.flush());
+    varint_sink = out.data().size();
+}
+
+static void benchmark_write_varint(std::vector<uint64_t> const& values) {
+    Util::WritableMemoryStream out;
+    out.reserve(values.size() * 8);
+    Util::BufferedWriter buffered { out };
+    Writer writer { buffered };
+    for (auto value : values) {
+        MUST(writer.write_varint(value));
+    }
+    MUST(buffered.flush());
+    varint_sink = out.data().size();
+}
+
+static void benchmark_write_varint_array(std::vector<uint64_t> const& values) {
+    Util::WritableMemoryStream out;
+    out.reserve(values.size() * 8);
+    MUST(Writer { out }.write_varint_array(values));
+    varint_sink = out.data().size();
+}
+
+// Decoding byte by byte, as it would be done with BufferedReader::get().
+static OsErrorOr<uint64_t> read_varint_per_byte(BinaryReader& reader) {
+    uint64_t value = 0;
+    for (size_t s = 0; s < Util::Varint::MaxSize; s++) {
+        auto byte = TRY(reader.get());
+        if (!byte) {
+            return OsError { 0, "EOF" };
+        }
+        value |= static_cast<uint64_t>(*byte & 0x7f) << (s * 7);
+        if (!(*byte & 0x80)) {
+            return value;
+        }
+    }
+    return OsError { EILSEQ, "Overflow" };
+}
+
+template<class Read>
+static void benchmark_read(Util::Buffer const& data, Read&& read) {
+    auto in = Util::ReadableMemoryStream::borrow(data.span());
+    BinaryReader reader { in };
+    static std::vector<uint64_t> values(VarintBenchmarkCount);
+    read(reader, std::span { values });
+    varint_sink = values.back();
+}
+
+static std::vector<uint64_t> const& benchmark_small_values() {
+    static auto values = small_values(VarintBenchmarkCount);
+    return values;
+}
+
+static std::vector<uint64_t> const& benchmark_mixed_values() {
+    static auto values = mixed_values(VarintBenchmarkCount);
+    return values;
+}
+
+static Util::Buffer const& benchmark_fixed_data() {
+    static Util::Buffer data = [] {
+        Util::WritableMemoryStream out;
+        MUST(Writer { out }.write_little_endian_array<uint64_t>(benchmark_mixed_values()));
+        return out.release_buffer();
+    }();
+    return data;
+}
+
+static Util::Buffer const& benchmark_small_data() {
+    static auto data = encode_values(benchmark_small_values());
+    return data;
+}
+
+static Util::Buffer const& benchmark_mixed_data() {
+    static auto data = encode_values(benchmark_mixed_values());
+    return data;
+}
+
+// Throughput is in values (not bytes), to compare encodings.
+BENCHMARK_THROUGHPUT(write_fixed_mixed, VarintBenchmarkCount) {
+    benchmark_write_fixed(benchmark_mixed_values());
+}
+
+BENCHMARK_THROUGHPUT(write_varint_small, VarintBenchmarkCount) {
+    benchmark_write_varint(benchmark_small_values());
+}
+
+BENCHMARK_THROUGHPUT(write_varint_mixed, VarintBenchmarkCount) {
+    benchmark_write_varint(benchmark_mixed_values());
+}
+
+BENCHMARK_THROUGHPUT(write_varint_array_small, VarintBenchmarkCount) {
+    benchmark_write_varint_array(benchmark_small_values());
+}
+
+BENCHMARK_THROUGHPUT(write_varint_array_mixed, VarintBenchmarkCount) {
+    benchmark_write_varint_array(benchmark_mixed_values());
+}
+
+BENCHMARK_THROUGHPUT(read_fixed_mixed, VarintBenchmarkCount) {
+    benchmark_read(benchmark_fixed_data(), [](BinaryReader& reader, std::span<uint64_t> values) {
+        for (auto& value : values) {
+            value = MUST(reader.read_little_endian<uint64_t>());
+        }
+    });
+}
+
+BENCHMARK_THROUGHPUT(read_varint_per_byte_small, VarintBenchmarkCount) {
+    benchmark_read(benchmark_small_data(), [](BinaryReader& reader, std::span<uint64_t> values) {
+        for (auto& value : values) {
+            value = MUST(read_varint_per_byte(reader));
+        }
+    });
+}
+
+BENCHMARK_THROUGHPUT(read_varint_per_byte_mixed, VarintBenchmarkCount) {
+    benchmark_read(benchmark_mixed_data(), [](BinaryReader& reader, std::span<uint64_t> values) {
+        for (auto& value : values) {
+            value = MUST(read_varint_per_byte(reader));
+        }
+    });
+}
+
+BENCHMARK_THROUGHPUT(read_varint_small, VarintBenchmarkCount) {
+    benchmark_read(benchmark_small_data(), [](BinaryReader& reader, std::span<uint64_t> values) {
+        for (auto& value : values) {
+            value = MUST(reader.read_varint());
+        }
+    });
+}
+
+BENCHMARK_THROUGHPUT(read_varint_mixed, VarintBenchmarkCount) {
+    benchmark_read(benchmark_mixed_data(), [](BinaryReader& reader, std::span<uint64_t> values) {
+        for (auto& value : values) {
+            value = MUST(reader.read_varint());
+        }
+    });
+}
+
+BENCHMARK_THROUGHPUT(read_varint_array_small, VarintBenchmarkCount) {
+    benchmark_read(benchmark_small_data(), [](BinaryReader& reader, std::span<uint64_t> values) {
+        MUST(reader.read_varint_array(values));
+    });
+}
+
+BENCHMARK_THROUGHPUT(read_varint_array_mixed, VarintBenchmarkCount) {
+    benchmark_read(benchmark_mixed_data(), [](BinaryReader& reader, std::span<uint64_t> values) {
+        MUST(reader.read_varint_array(values));
+    });
+}
@@ -0,0 +1,54 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+
+namespace Util {
+
+Arena::Arena(size_t chunk_size, std::pmr::memory_resource* upstream)
+    : m_chunk_size(chunk_size)
+    , m_upstream(upstream) {
+}
+
+Arena::~Arena() {
+    for (auto const& chunk : m_chunks) {
+        m_upstream->deallocate(chunk.data, chunk.size, alignof(std::max_align_t));
+    }
+}
+
+void Arena::reset() {
+    m_position = {};
+}
+
+size_t Arena::reserved_bytes() const {
+    size_t size = 0;
+    for (auto const& chunk : m_chunks) {
+        size += chunk.size;
+    }
+    return size;
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+    while (true) {
+        // Chunks that don't fit the allocation are skipped until reset.
+        while (m_position.chunk < m_chunks.size()) {
+            auto const& chunk = m_chunks[m_position.chunk];
+            auto address = reinterpret_cast<uintptr_t>(chunk.data) + m_position.offset;
+            auto start = m_position.offset + (alignment - address % alignment) % alignment;
+            if (start + bytes <= chunk.size) {
+                m_position.offset = start + bytes;
+                m_position.used_bytes += bytes;
+                return chunk.data + start;
+            }
+            m_position.chunk++;
+            m_position.offset = 0;
+        }
+
+        // Allocations bigger than chunk size get their own chunk.
+        auto size = std::max(m_chunk_size, bytes + alignment);
+        m_chunks.push_back({ .data = static_cast<uint8_t*>(m_upstream->allocate(size, alignof(std::max_align_t))), .size = size });
+        m_position.chunk = m_chunks.size() - 1;
+        m_position.offset = 0;
+    }
+}
+
+}
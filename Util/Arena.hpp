@@ -0,0 +1,79 @@
+#pragma once
+
+#include "NonCopyable.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace Util {
+
+// Bump allocator. Allocation just advances a pointer in the current chunk,
+// and deallocation does nothing; everything is freed at once with reset()
+// or when a Scope ends. Chunks are kept for reuse until the arena is
+// destroyed. This is not thread safe.
+class Arena : public std::pmr::memory_resource
+    , public NonCopyable {
+public:
+    static constexpr size_t DefaultChunkSize = 64 * 1024;
+
+    explicit Arena(size_t chunk_size = DefaultChunkSize, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+    ~Arena();
+
+    Arena(Arena&&) = delete;
+    Arena& operator=(Arena&&) = delete;
+
+    // Free everything allocated from the arena.
+    void reset();
+
+    // Bytes allocated since the last reset, not counting padding.
+    size_t used_bytes() const { return m_position.used_bytes; }
+
+    // Bytes allocated from upstream.
+    size_t reserved_bytes() const;
+
+    class Scope;
+
+private:
+    struct Chunk {
+        uint8_t* data;
+        size_t size;
+    };
+
+    struct Position {
+        size_t chunk = 0;
+        size_t offset = 0;
+        size_t used_bytes = 0;
+    };
+
+    virtual void* do_allocate(size_t bytes, size_t alignment) override;
+    virtual void do_deallocate(void*, size_t, size_t) override { }
+    virtual bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        return this == &other;
+    }
+
+    size_t m_chunk_size;
+    std::pmr::memory_resource* m_upstream;
+    std::vector<Chunk> m_chunks;
+    Position m_position;
+};
+
+// Frees everything allocated from the arena during its lifetime.
+class Arena::Scope : public NonCopyable {
+public:
+    explicit Scope(Arena& arena)
+        : m_arena(arena)
+        , m_position(arena.m_position) { }
+
+    ~Scope() { m_arena.m_position = m_position; }
+
+    Scope(Scope&&) = delete;
+    Scope& operator=(Scope&&) = delete;
+
+private:
+    Arena& m_arena;
+    Arena::Position m_position;
+};
+
+}
@@ -1,5 +1,7 @@
 #include "Buffer.hpp"
 #include <algorithm>
+#include <cassert>
+#include <functional>
 #include <fmt/core.h>
 #include <unistd.h>
 #include <utility>
@@ -7,7 +9,7 @@
 namespace Util {
 
 Buffer::~Buffer() {
-    delete[] m_data;
+    free_storage();
 }
 
 Buffer::Buffer(Buffer const& other) {
@@ -18,27 +20,36 @@ Buffer::Buffer(Buffer const& other) {
 Buffer& Buffer::operator=(Buffer const& other) {
     if (this == &other)
         return *this;
+    m_size = 0;
     resize_uninitialized(other.m_size);
     std::copy(other.m_data, other.m_data + other.m_size, m_data);
     return *this;
 }
 
 Buffer::Buffer(Buffer&& other) {
-    delete[] m_data;
     m_data = std::exchange(other.m_data, nullptr);
     m_size = std::exchange(other.m_size, 0);
+    m_capacity = std::exchange(other.m_capacity, 0);
+    m_resource = other.m_resource;
 }
 
 Buffer& Buffer::operator=(Buffer&& other) {
     if (this == &other)
         return *this;
-    delete[] m_data;
+    if (*resource() != *other.resource()) {
+        // Storage can't be freed to a different resource.
+        return *this = other;
+    }
+    free_storage();
     m_data = std::exchange(other.m_data, nullptr);
     m_size = std::exchange(other.m_size, 0);
+    m_capacity = std::exchange(other.m_capacity, 0);
+    m_resource = other.m_resource;
     return *this;
 }
 
-Buffer::Buffer(std::span<uint8_t const> data) {
+Buffer::Buffer(std::span<uint8_t const> data, std::pmr::memory_resource* resource)
+    : m_resource(resource) {
     resize_uninitialized(data.size());
     std::copy(data.begin(), data.end(), m_data);
 }
@@ -48,35 +59,24 @@ Buffer::Buffer(std::initializer_list<uint8_t> data) {
     std::copy(data.begin(), data.end(), m_data);
 }
 
-Buffer Buffer::uninitialized(size_t size) {
-    return Buffer(size);
+Buffer Buffer::uninitialized(size_t size, std::pmr::memory_resource* resource) {
+    Buffer buffer { resource };
+    buffer.resize_uninitialized(size);
+    return buffer;
 }
 
-Buffer Buffer::filled(size_t size, uint8_t byte) {
-    Buffer buffer(size);
+Buffer Buffer::filled(size_t size, uint8_t byte, std::pmr::memory_resource* resource) {
+    auto buffer = uninitialized(size, resource);
     std::fill(buffer.m_data, buffer.m_data + buffer.m_size, byte);
     return buffer;
 }
 
 void Buffer::clear() {
-    resize_uninitialized(0);
-}
-
-void Buffer::append(uint8_t byte) {
-    if (m_size == 0) {
-        ensure_capacity(1);
-    }
-    else if (m_size + 1 > m_capacity) {
-        ensure_capacity(m_capacity * 2);
-    }
-    assert(m_capacity >= m_size + 1);
-    m_size++;
-    m_data[m_size - 1] = byte;
+    m_size = 0;
 }
 
 void Buffer::append(std::span<uint8_t const> data) {
-    resize_uninitialized(m_size + data.size());
-    std::copy(data.begin(), data.end(), &m_data[m_size - data.size()]);
+    insert(m_size, data);
 }
 
 UString Buffer::decode_infallible(UString::Encoding encoding, uint32_t replacement) const {
@@ -92,36 +92,61 @@ void Buffer::insert(size_t position, uint8_t byte) {
 }
 
 void Buffer::insert(size_t position, std::span<uint8_t const> data) {
-    // FIXME: This makes an unnecessary copy.
-    resize_uninitialized(m_size + data.size());
-    std::copy(begin() + position, end() - data.size(), begin() + position + data.size());
-    std::copy(data.begin(), data.end(), begin() + position);
+    assert(position <= m_size);
+    auto new_size = m_size + data.size();
+    if (new_size > m_capacity) {
+        // Copy to new storage around the inserted data, so that everything
+        // is copied only once. This is also correct if `data` is a part of
+        // this buffer.
+        auto new_capacity = std::max(new_size, m_capacity * 2);
+        auto new_data = allocate(new_capacity);
+        std::copy(m_data, m_data + position, new_data);
+        std::copy(data.begin(), data.end(), new_data + position);
+        std::copy(m_data + position, m_data + m_size, new_data + position + data.size());
+        free_storage();
+        m_data = new_data;
+        m_size = new_size;
+        m_capacity = new_capacity;
+        return;
+    }
+
+    if (position < m_size && std::less_equal {}(m_data, data.data()) && std::less {}(data.data(), m_data + m_size)) {
+        // Inserting a part of this buffer, which would be overwritten when
+        // making space for it.
+        Buffer copy { data };
+        insert(position, copy.span());
+        return;
+    }
+    std::copy_backward(m_data + position, m_data + m_size, m_data + new_size);
+    std::copy(data.begin(), data.end(), m_data + position);
+    m_size = new_size;
 }
 
 void Buffer::take_from_back(size_t s) {
-    resize_uninitialized(m_size - s);
+    assert(s <= m_size);
+    m_size -= s;
 }
 
 void Buffer::resize_uninitialized(size_t size) {
-    reallocate(size);
+    if (size > m_capacity) {
+        grow(size);
+    }
     m_size = size;
 }
 
-void Buffer::reallocate(size_t capacity) {
-
-    auto old_storage = m_data;
-    if (capacity > 0) {
-        auto old_capacity = m_capacity;
+void Buffer::grow(size_t size) {
+    reallocate(std::max(size, m_capacity * 2));
+}
 
-        m_data = new uint8_t[capacity];
-        if (old_storage) {
-            std::copy(old_storage, old_storage + std::min(capacity, old_capacity), m_data);
-        }
-    }
-    else {
-        m_data = nullptr;
+void Buffer::reallocate(size_t capacity) {
+    if (capacity == m_capacity) {
+        return;
     }
-    delete[] old_storage;
+    auto new_data = capacity > 0 ? allocate(capacity) : nullptr;
+    m_size = std::min(m_size, capacity);
+    std::copy(m_data, m_data + m_size, new_data);
+    free_storage();
+    m_data = new_data;
     m_capacity = capacity;
 }
 
@@ -132,6 +157,23 @@ void Buffer::ensure_capacity(size_t capacity) {
     reallocate(capacity);
 }
 
+std::pmr::memory_resource* Buffer::allocation_resource() {
+    if (!m_resource) {
+        m_resource = current_memory_resource();
+    }
+    return m_resource;
+}
+
+uint8_t* Buffer::allocate(size_t capacity) {
+    return static_cast<uint8_t*>(allocation_resource()->allocate(capacity, 1));
+}
+
+void Buffer::free_storage() {
+    if (m_data) {
+        m_resource->deallocate(m_data, m_capacity, 1);
+    }
+}
+
 bool Buffer::operator==(Buffer const& other) const {
     if (m_size != other.m_size)
         return false;
@@ -1,32 +1,46 @@
 #pragma once
 
+#include "MemoryResource.hpp"
 #include "UString.hpp"
 
 #include <cstddef>
 #include <cstdint>
 #include <fmt/format.h>
+#include <memory_resource>
 #include <span>
 
 namespace Util {
 
+// Growable array of bytes. Growing is amortized (capacity grows
+// geometrically), and shrinking or clearing never reallocates.
+//
+// Memory is allocated from a std::pmr::memory_resource, which can be used
+// to allocate from an arena or a pool. By default, this is
+// current_memory_resource() at the time of first allocation (i.e
+// new/delete, unless changed). Like for std::pmr containers, copies use
+// the default resource, and moving between buffers with different
+// resources copies.
 class Buffer {
 public:
     Buffer() = default;
+    explicit Buffer(std::pmr::memory_resource* resource)
+        : m_resource(resource) { }
     ~Buffer();
     Buffer(Buffer const&);
     Buffer& operator=(Buffer const&);
     Buffer(Buffer&&);
     Buffer& operator=(Buffer&&);
 
-    Buffer(std::span<uint8_t const>);
+    Buffer(std::span<uint8_t const>, std::pmr::memory_resource* = nullptr);
     Buffer(std::initializer_list<uint8_t>);
-    static Buffer uninitialized(size_t size);
-    static Buffer filled(size_t size, uint8_t byte = 0);
+    static Buffer uninitialized(size_t size, std::pmr::memory_resource* = nullptr);
+    static Buffer filled(size_t size, uint8_t byte = 0, std::pmr::memory_resource* = nullptr);
 
     std::span<uint8_t> span() { return { m_data, m_size }; }
     std::span<uint8_t const> span() const { return { m_data, m_size }; }
     size_t size() const { return m_size; }
     size_t capacity() const { return m_capacity; }
+    std::pmr::memory_resource* resource() const { return m_resource ? m_resource : current_memory_resource(); }
     auto begin() { return m_data; }
     auto begin() const { return m_data; }
     auto end() { return m_data + m_size; }
@@ -36,7 +50,12 @@ public:
     uint8_t& operator[](size_t idx) { return m_data[idx]; }
 
     void clear();
-    void append(uint8_t);
+    void append(uint8_t byte) {
+        if (m_size == m_capacity) {
+            grow(m_size + 1);
+        }
+        m_data[m_size++] = byte;
+    }
     void append(std::span<uint8_t const>);
     void resize_uninitialized(size_t);
     void insert(size_t position, uint8_t byte);
@@ -44,8 +63,12 @@ public:
     void insert(size_t position, std::initializer_list<uint8_t> bytes) {
         insert(position, std::span<uint8_t const> { bytes });
     }
+
+    // Set capacity to exactly `capacity`. If it's less than size, the
+    // buffer is truncated.
     void reallocate(size_t capacity);
     void ensure_capacity(size_t capacity);
+    void shrink_to_fit() { reallocate(m_size); }
 
     UString decode_infallible(UString::Encoding = UString::Encoding::Utf8, uint32_t replacement = 0xfffd) const;
     ErrorOr<UString, UString::DecodingErrorTag> decode(UString::Encoding = UString::Encoding::Utf8) const;
@@ -56,12 +79,19 @@ public:
     bool operator==(Buffer const& other) const;
 
 private:
-    explicit Buffer(size_t size)
-        : m_size(size) { resize_uninitialized(size); }
+    std::pmr::memory_resource* allocation_resource();
+    uint8_t* allocate(size_t capacity);
+    void free_storage();
+
+    // Make space for at least `size` bytes, growing geometrically.
+    void grow(size_t size);
 
     uint8_t* m_data { nullptr };
     size_t m_size { 0 };
     size_t m_capacity { 0 };
+
+    // Null until the first allocation if not given explicitly.
+    std::pmr::memory_resource* m_resource { nullptr };
 };
 
 }
@@ -0,0 +1,36 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define ESSA_ARCH_X86
+#endif
+
+namespace Util {
+
+enum class CpuFeature {
+    SSE2,
+    SSSE3,
+    SSE42,
+    AVX2,
+};
+
+// Check if CPU that we are running on supports the feature. This is used
+// for selecting SIMD implementations at runtime. Always false on non-x86.
+inline bool cpu_supports(CpuFeature feature) {
+#ifdef ESSA_ARCH_X86
+    __builtin_cpu_init();
+    switch (feature) {
+    case CpuFeature::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case CpuFeature::SSSE3:
+        return __builtin_cpu_supports("ssse3");
+    case CpuFeature::SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case CpuFeature::AVX2:
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    (void)feature;
+    return false;
+}
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "MemoryResource.hpp"
 #include "NonCopyable.hpp"
 #include "Vector.hpp"
 #include <algorithm>
@@ -16,7 +17,9 @@ public:
     static constexpr size_t SizeX = X;
     static constexpr size_t SizeY = Y;
 
-    DynamicArray2D(Type const& v = {}) {
+    // If resource is null, current_memory_resource() is used.
+    DynamicArray2D(Type const& v = {}, std::pmr::memory_resource* resource = nullptr)
+        : m_resource(resource ? resource : current_memory_resource()) {
         fill(v);
     }
 
@@ -29,20 +32,20 @@ public:
     DynamicArray2D& operator=(DynamicArray2D&& arr) {
         if (this == &arr)
             return *this;
-        if (m_storage)
-            delete[] m_storage;
+        Detail::free_array(m_resource, m_storage, size());
         m_storage = std::exchange(arr.m_storage, nullptr);
+        m_resource = arr.m_resource;
         return *this;
     }
 
-    ~DynamicArray2D() { delete[] m_storage; }
+    ~DynamicArray2D() { Detail::free_array(m_resource, m_storage, size()); }
 
     Util::Vector2<size_t> dimensions() const { return { SizeX, SizeY }; }
     size_t size() const { return SizeX * SizeY; }
 
     void fill(Type const& fill) {
         if (!m_storage)
-            m_storage = new Type[size()];
+            m_storage = Detail::allocate_array<Type>(m_resource, size());
         std::fill(m_storage, m_storage + size(), fill);
     }
 
@@ -80,6 +83,7 @@ private:
     size_t coords_to_index(size_t x, size_t y) const { return y * SizeX + x; }
 
     Type* m_storage = nullptr;
+    std::pmr::memory_resource* m_resource = nullptr;
 };
 
 }
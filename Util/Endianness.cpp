@@ -0,0 +1,138 @@
+#include "Endianness.hpp"
+
+#include "Config.hpp"
+#include "CpuFeatures.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#ifdef ESSA_ARCH_X86
+#    include <immintrin.h>
+#endif
+
+namespace Util::Detail {
+
+template<class T>
+static void swap_endianness_scalar(uint8_t const* input, uint8_t* output, size_t count) {
+    for (size_t s = 0; s < count; s++) {
+        T value;
+        std::memcpy(&value, input + s * sizeof(T), sizeof(T));
+        value = Util::swap_endianness(value);
+        std::memcpy(output + s * sizeof(T), &value, sizeof(T));
+    }
+}
+
+// Swap as many bytes as possible, in blocks. Returns count of bytes
+// processed; the rest is left for the scalar loop.
+using SwapFunction = size_t (*)(uint8_t const* input, uint8_t* output, size_t size, size_t element_size);
+
+static size_t swap_none(uint8_t const*, uint8_t*, size_t, size_t) {
+    return 0;
+}
+
+#ifdef ESSA_ARCH_X86
+
+// Shuffle that reverses every element of a 16-byte block.
+static uint8_t const* reverse_mask(size_t element_size) {
+    alignas(16) static uint8_t const masks[3][16] {
+        { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+        { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+        { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 },
+    };
+    switch (element_size) {
+    case 2:
+        return masks[0];
+    case 4:
+        return masks[1];
+    case 8:
+        return masks[2];
+    }
+    ESSA_UNREACHABLE;
+}
+
+[[gnu::target("ssse3")]] static size_t swap_ssse3(uint8_t const* input, uint8_t* output, size_t size, size_t element_size) {
+    auto const mask = _mm_load_si128(reinterpret_cast<__m128i const*>(reverse_mask(element_size)));
+    size_t s = 0;
+    for (; s + 64 <= size; s += 64) {
+        auto in = reinterpret_cast<__m128i const*>(input + s);
+        auto out = reinterpret_cast<__m128i*>(output + s);
+        auto a = _mm_loadu_si128(in + 0);
+        auto b = _mm_loadu_si128(in + 1);
+        auto c = _mm_loadu_si128(in + 2);
+        auto d = _mm_loadu_si128(in + 3);
+        _mm_storeu_si128(out + 0, _mm_shuffle_epi8(a, mask));
+        _mm_storeu_si128(out + 1, _mm_shuffle_epi8(b, mask));
+        _mm_storeu_si128(out + 2, _mm_shuffle_epi8(c, mask));
+        _mm_storeu_si128(out + 3, _mm_shuffle_epi8(d, mask));
+    }
+    for (; s + 16 <= size; s += 16) {
+        auto block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input + s));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + s), _mm_shuffle_epi8(block, mask));
+    }
+    return s;
+}
+
+[[gnu::target("avx2")]] static size_t swap_avx2(uint8_t const* input, uint8_t* output, size_t size, size_t element_size) {
+    // vpshufb shuffles within 128-bit lanes, so the same mask is used for
+    // both of them.
+    auto const mask = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const*>(reverse_mask(element_size))));
+    size_t s = 0;
+    for (; s + 128 <= size; s += 128) {
+        auto in = reinterpret_cast<__m256i const*>(input + s);
+        auto out = reinterpret_cast<__m256i*>(output + s);
+        auto a = _mm256_loadu_si256(in + 0);
+        auto b = _mm256_loadu_si256(in + 1);
+        auto c = _mm256_loadu_si256(in + 2);
+        auto d = _mm256_loadu_si256(in + 3);
+        _mm256_storeu_si256(out + 0, _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256(out + 1, _mm256_shuffle_epi8(b, mask));
+        _mm256_storeu_si256(out + 2, _mm256_shuffle_epi8(c, mask));
+        _mm256_storeu_si256(out + 3, _mm256_shuffle_epi8(d, mask));
+    }
+    for (; s + 32 <= size; s += 32) {
+        auto block = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + s));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + s), _mm256_shuffle_epi8(block, mask));
+    }
+    return s;
+}
+
+#endif
+
+static SwapFunction swap_function() {
+    static SwapFunction const function = [] {
+#ifdef ESSA_ARCH_X86
+        if (cpu_supports(CpuFeature::AVX2)) {
+            return swap_avx2;
+        }
+        if (cpu_supports(CpuFeature::SSSE3)) {
+            return swap_ssse3;
+        }
+#endif
+        return swap_none;
+    }();
+    return function;
+}
+
+void swap_endianness(void const* input, void* output, size_t count, size_t element_size) {
+    auto in = static_cast<uint8_t const*>(input);
+    auto out = static_cast<uint8_t*>(output);
+    auto size = count * element_size;
+    auto swapped = swap_function()(in, out, size, element_size);
+    in += swapped;
+    out += swapped;
+    count -= swapped / element_size;
+    switch (element_size) {
+    case 2:
+        swap_endianness_scalar<uint16_t>(in, out, count);
+        return;
+    case 4:
+        swap_endianness_scalar<uint32_t>(in, out, count);
+        return;
+    case 8:
+        swap_endianness_scalar<uint64_t>(in, out, count);
+        return;
+    }
+    assert(false);
+}
+
+}
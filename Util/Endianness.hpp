@@ -1,6 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <span>
+#include <type_traits>
 
 namespace Util {
 
@@ -44,4 +50,91 @@ constexpr T convert_from_little_to_host_endian(T value) {
     return convert_from_host_to_little_endian(value);
 }
 
+namespace Detail {
+
+// Reverse bytes of `count` elements of `element_size` (2, 4 or 8) bytes.
+// `input` and `output` may be the same. Uses SSSE3 or AVX2 if the CPU
+// supports it (selected at runtime).
+void swap_endianness(void const* input, void* output, size_t count, size_t element_size);
+
+}
+
+template<class T>
+concept EndianConvertible = (std::integral<T> || std::floating_point<T>)&&(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+
+// Swap bytes of every element of an array, in place.
+template<EndianConvertible T>
+void swap_endianness(std::span<T> values) {
+    if constexpr (sizeof(T) > 1) {
+        Detail::swap_endianness(values.data(), values.data(), values.size(), sizeof(T));
+    }
+}
+
+// Write values with swapped bytes to `output`, which must be of the same
+// size.
+template<EndianConvertible T>
+void swap_endianness(std::span<std::type_identity_t<T> const> input, std::span<T> output) {
+    if constexpr (sizeof(T) > 1) {
+        Detail::swap_endianness(input.data(), output.data(), input.size(), sizeof(T));
+    }
+    else {
+        std::copy(input.begin(), input.end(), output.begin());
+    }
+}
+
+// Array versions of the conversions above, in place and copying.
+template<EndianConvertible T>
+void convert_from_host_to_big_endian(std::span<T> values) {
+    if constexpr (std::endian::native != std::endian::big) {
+        swap_endianness(values);
+    }
+}
+
+template<EndianConvertible T>
+void convert_from_host_to_big_endian(std::span<std::type_identity_t<T> const> input, std::span<T> output) {
+    if constexpr (std::endian::native != std::endian::big) {
+        swap_endianness<T>(input, output);
+    }
+    else {
+        std::copy(input.begin(), input.end(), output.begin());
+    }
+}
+
+template<EndianConvertible T>
+void convert_from_host_to_little_endian(std::span<T> values) {
+    if constexpr (std::endian::native != std::endian::little) {
+        swap_endianness(values);
+    }
+}
+
+template<EndianConvertible T>
+void convert_from_host_to_little_endian(std::span<std::type_identity_t<T> const> input, std::span<T> output) {
+    if constexpr (std::endian::native != std::endian::little) {
+        swap_endianness<T>(input, output);
+    }
+    else {
+        std::copy(input.begin(), input.end(), output.begin());
+    }
+}
+
+template<EndianConvertible T>
+void convert_from_big_to_host_endian(std::span<T> values) {
+    convert_from_host_to_big_endian(values);
+}
+
+template<EndianConvertible T>
+void convert_from_big_to_host_endian(std::span<std::type_identity_t<T> const> input, std::span<T> output) {
+    convert_from_host_to_big_endian<T>(input, output);
+}
+
+template<EndianConvertible T>
+void convert_from_little_to_host_endian(std::span<T> values) {
+    convert_from_host_to_little_endian(values);
+}
+
+template<EndianConvertible T>
+void convert_from_little_to_host_endian(std::span<std::type_identity_t<T> const> input, std::span<T> output) {
+    convert_from_host_to_little_endian<T>(input, output);
+}
+
 }
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "NonCopyable.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace Util {
+
+// Pool of objects of a single type. Memory is allocated from upstream in
+// chunks of ObjectsPerChunk objects, and freed objects are reused, so
+// creating and destroying objects doesn't usually allocate. All objects
+// must be destroyed before the pool. This is not thread safe.
+//
+// The pool is also a memory resource, which serves allocations that fit
+// in a T from the pool, and other ones from upstream.
+template<class T, size_t ObjectsPerChunk = 256>
+class FixedPool : public std::pmr::memory_resource
+    , public NonCopyable {
+public:
+    explicit FixedPool(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : m_upstream(upstream) { }
+
+    ~FixedPool() {
+        assert(m_object_count == 0);
+        for (auto chunk : m_chunks) {
+            m_upstream->deallocate(chunk, sizeof(Slot) * ObjectsPerChunk, alignof(Slot));
+        }
+    }
+
+    FixedPool(FixedPool&&) = delete;
+    FixedPool& operator=(FixedPool&&) = delete;
+
+    template<class... Args>
+    T* create(Args&&... args) {
+        return new (allocate_slot()) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        free_slot(object);
+    }
+
+    // Count of objects (or other allocations) that are currently in use.
+    size_t object_count() const { return m_object_count; }
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void* allocate_slot() {
+        if (!m_free_list) {
+            allocate_chunk();
+        }
+        auto slot = m_free_list;
+        m_free_list = slot->next;
+        m_object_count++;
+        return slot;
+    }
+
+    void free_slot(void* pointer) {
+        auto slot = static_cast<Slot*>(pointer);
+        slot->next = m_free_list;
+        m_free_list = slot;
+        m_object_count--;
+    }
+
+    void allocate_chunk() {
+        auto chunk = static_cast<Slot*>(m_upstream->allocate(sizeof(Slot) * ObjectsPerChunk, alignof(Slot)));
+        m_chunks.push_back(chunk);
+        for (size_t s = ObjectsPerChunk; s > 0; s--) {
+            chunk[s - 1].next = m_free_list;
+            m_free_list = &chunk[s - 1];
+        }
+    }
+
+    static bool fits_in_slot(size_t bytes, size_t alignment) {
+        return bytes <= sizeof(Slot) && alignment <= alignof(Slot);
+    }
+
+    virtual void* do_allocate(size_t bytes, size_t alignment) override {
+        return fits_in_slot(bytes, alignment) ? allocate_slot() : m_upstream->allocate(bytes, alignment);
+    }
+
+    virtual void do_deallocate(void* pointer, size_t bytes, size_t alignment) override {
+        if (fits_in_slot(bytes, alignment)) {
+            free_slot(pointer);
+        }
+        else {
+            m_upstream->deallocate(pointer, bytes, alignment);
+        }
+    }
+
+    virtual bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* m_upstream;
+    std::vector<Slot*> m_chunks;
+    Slot* m_free_list = nullptr;
+    size_t m_object_count = 0;
+};
+
+}
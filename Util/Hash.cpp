@@ -0,0 +1,219 @@
+#include "Hash.hpp"
+
+#include "CpuFeatures.hpp"
+#include "Endianness.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+#ifdef ESSA_ARCH_X86
+#    include <immintrin.h>
+#endif
+
+namespace Util {
+
+template<class T>
+static T load_little_endian(uint8_t const* pointer) {
+    T value;
+    std::memcpy(&value, pointer, sizeof(value));
+    return convert_from_little_to_host_endian(value);
+}
+
+// Reversed polynomial of CRC-32C.
+constexpr uint32_t Crc32cPolynomial = 0x82f63b78;
+
+// Tables for processing 8 bytes at once ("slicing-by-8"). Table k gives
+// CRC of a byte followed by k zero bytes.
+static constexpr auto crc32c_tables = [] {
+    std::array<std::array<uint32_t, 256>, 8> tables {};
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        auto crc = byte;
+        for (size_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (crc & 1 ? Crc32cPolynomial : 0);
+        }
+        tables[0][byte] = crc;
+    }
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        for (size_t k = 1; k < 8; k++) {
+            auto previous = tables[k - 1][byte];
+            tables[k][byte] = (previous >> 8) ^ tables[0][previous & 0xff];
+        }
+    }
+    return tables;
+}();
+
+static uint32_t crc32c_update_scalar(uint32_t crc, uint8_t const* data, size_t size) {
+    auto const& t = crc32c_tables;
+    size_t s = 0;
+    for (; s + 8 <= size; s += 8) {
+        auto low = load_little_endian<uint32_t>(data + s) ^ crc;
+        auto high = load_little_endian<uint32_t>(data + s + 4);
+        crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+            ^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+    }
+    for (; s < size; s++) {
+        crc = (crc >> 8) ^ t[0][(crc ^ data[s]) & 0xff];
+    }
+    return crc;
+}
+
+#ifdef ESSA_ARCH_X86
+
+[[gnu::target("sse4.2")]] static uint32_t crc32c_update_sse42(uint32_t crc, uint8_t const* data, size_t size) {
+    size_t s = 0;
+#    ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; s + 8 <= size; s += 8) {
+        uint64_t value;
+        std::memcpy(&value, data + s, sizeof(value));
+        crc64 = _mm_crc32_u64(crc64, value);
+    }
+    crc = crc64;
+#    endif
+    for (; s < size; s++) {
+        crc = _mm_crc32_u8(crc, data[s]);
+    }
+    return crc;
+}
+
+#endif
+
+using Crc32cUpdateFunction = uint32_t (*)(uint32_t crc, uint8_t const* data, size_t size);
+
+static Crc32cUpdateFunction crc32c_update() {
+    static Crc32cUpdateFunction const function = [] {
+#ifdef ESSA_ARCH_X86
+        if (cpu_supports(CpuFeature::SSE42)) {
+            return crc32c_update_sse42;
+        }
+#endif
+        return crc32c_update_scalar;
+    }();
+    return function;
+}
+
+uint32_t Crc32c::compute(std::span<uint8_t const> data, uint32_t crc) {
+    return ~crc32c_update()(~crc, data.data(), data.size());
+}
+
+uint32_t Crc32c::compute_scalar(std::span<uint8_t const> data, uint32_t crc) {
+    return ~crc32c_update_scalar(~crc, data.data(), data.size());
+}
+
+// See https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md. The
+// 4 lanes are independent, so they are processed in parallel by the CPU.
+namespace XxHash64Detail {
+
+constexpr uint64_t Prime1 = 0x9e3779b185ebca87;
+constexpr uint64_t Prime2 = 0xc2b2ae3d27d4eb4f;
+constexpr uint64_t Prime3 = 0x165667b19e3779f9;
+constexpr uint64_t Prime4 = 0x85ebca77c2b2ae63;
+constexpr uint64_t Prime5 = 0x27d4eb2f165667c5;
+
+static uint64_t round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * Prime2;
+    accumulator = std::rotl(accumulator, 31);
+    return accumulator * Prime1;
+}
+
+static uint64_t merge_round(uint64_t accumulator, uint64_t lane) {
+    accumulator ^= round(0, lane);
+    return accumulator * Prime1 + Prime4;
+}
+
+static void process_stripes(uint64_t (&lanes)[4], uint8_t const* data, size_t stripe_count) {
+    auto lane0 = lanes[0];
+    auto lane1 = lanes[1];
+    auto lane2 = lanes[2];
+    auto lane3 = lanes[3];
+    for (size_t s = 0; s < stripe_count; s++, data += 32) {
+        lane0 = round(lane0, load_little_endian<uint64_t>(data));
+        lane1 = round(lane1, load_little_endian<uint64_t>(data + 8));
+        lane2 = round(lane2, load_little_endian<uint64_t>(data + 16));
+        lane3 = round(lane3, load_little_endian<uint64_t>(data + 24));
+    }
+    lanes[0] = lane0;
+    lanes[1] = lane1;
+    lanes[2] = lane2;
+    lanes[3] = lane3;
+}
+
+}
+
+uint64_t XxHash64::compute(std::span<uint8_t const> data, uint64_t seed) {
+    XxHash64 hasher { seed };
+    hasher.update(data);
+    return hasher.digest();
+}
+
+void XxHash64::reset() {
+    using namespace XxHash64Detail;
+    m_lanes[0] = m_seed + Prime1 + Prime2;
+    m_lanes[1] = m_seed + Prime2;
+    m_lanes[2] = m_seed;
+    m_lanes[3] = m_seed - Prime1;
+    m_total_size = 0;
+    m_pending_size = 0;
+}
+
+void XxHash64::update(std::span<uint8_t const> data) {
+    using namespace XxHash64Detail;
+    m_total_size += data.size();
+    if (m_pending_size > 0) {
+        auto size = std::min(data.size(), StripeSize - m_pending_size);
+        std::copy_n(data.begin(), size, m_pending + m_pending_size);
+        m_pending_size += size;
+        data = data.subspan(size);
+        if (m_pending_size < StripeSize) {
+            return;
+        }
+        process_stripes(m_lanes, m_pending, 1);
+        m_pending_size = 0;
+    }
+    auto stripe_count = data.size() / StripeSize;
+    process_stripes(m_lanes, data.data(), stripe_count);
+    data = data.subspan(stripe_count * StripeSize);
+    std::copy(data.begin(), data.end(), m_pending);
+    m_pending_size = data.size();
+}
+
+uint64_t XxHash64::digest() const {
+    using namespace XxHash64Detail;
+    uint64_t hash;
+    if (m_total_size >= StripeSize) {
+        hash = std::rotl(m_lanes[0], 1) + std::rotl(m_lanes[1], 7) + std::rotl(m_lanes[2], 12) + std::rotl(m_lanes[3], 18);
+        for (auto lane : m_lanes) {
+            hash = merge_round(hash, lane);
+        }
+    }
+    else {
+        hash = m_seed + Prime5;
+    }
+    hash += m_total_size;
+
+    size_t s = 0;
+    for (; s + 8 <= m_pending_size; s += 8) {
+        hash ^= round(0, load_little_endian<uint64_t>(m_pending + s));
+        hash = std::rotl(hash, 27) * Prime1 + Prime4;
+    }
+    if (s + 4 <= m_pending_size) {
+        hash ^= load_little_endian<uint32_t>(m_pending + s) * Prime1;
+        hash = std::rotl(hash, 23) * Prime2 + Prime3;
+        s += 4;
+    }
+    for (; s < m_pending_size; s++) {
+        hash ^= m_pending[s] * Prime5;
+        hash = std::rotl(hash, 11) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace Util {
+
+// Incremental hash of a sequence of bytes. The result doesn't depend on how
+// the data is split into update() calls.
+class Hasher {
+public:
+    virtual ~Hasher() = default;
+
+    virtual void update(std::span<uint8_t const>) = 0;
+
+    // Hash of everything passed so far. This doesn't reset the state, so
+    // more data can be added.
+    virtual uint64_t digest() const = 0;
+
+    virtual void reset() = 0;
+};
+
+// CRC-32C (Castagnoli), as used by iSCSI, ext4 and others. Uses the SSE4.2
+// crc32 instruction if the CPU supports it (selected at runtime).
+class Crc32c : public Hasher {
+public:
+    static uint32_t compute(std::span<uint8_t const> data, uint32_t crc = 0);
+    static uint32_t compute(std::string_view data, uint32_t crc = 0) {
+        return compute({ reinterpret_cast<uint8_t const*>(data.data()), data.size() }, crc);
+    }
+
+    // Same as compute(), but never uses SSE4.2. Used as a fallback on CPUs
+    // that don't support it, and as a reference for benchmarks.
+    static uint32_t compute_scalar(std::span<uint8_t const> data, uint32_t crc = 0);
+
+    virtual void update(std::span<uint8_t const> data) override { m_crc = compute(data, m_crc); }
+    virtual uint64_t digest() const override { return m_crc; }
+    virtual void reset() override { m_crc = 0; }
+
+private:
+    uint32_t m_crc = 0;
+};
+
+// 64-bit xxHash. It isn't a checksum like CRC, but it is faster than
+// Crc32c::compute_scalar() on any CPU, and has fewer collisions.
+class XxHash64 : public Hasher {
+public:
+    explicit XxHash64(uint64_t seed = 0)
+        : m_seed(seed) {
+        reset();
+    }
+
+    static uint64_t compute(std::span<uint8_t const> data, uint64_t seed = 0);
+    static uint64_t compute(std::string_view data, uint64_t seed = 0) {
+        return compute({ reinterpret_cast<uint8_t const*>(data.data()), data.size() }, seed);
+    }
+
+    virtual void update(std::span<uint8_t const>) override;
+    virtual uint64_t digest() const override;
+    virtual void reset() override;
+
+private:
+    static constexpr size_t StripeSize = 32;
+
+    uint64_t m_seed;
+    uint64_t m_lanes[4];
+    uint64_t m_total_size = 0;
+
+    // Data that doesn't fill a whole stripe yet.
+    uint8_t m_pending[StripeSize];
+    size_t m_pending_size = 0;
+};
+
+}
@@ -0,0 +1,20 @@
+#include "MemoryResource.hpp"
+
+namespace Util {
+
+static thread_local std::pmr::memory_resource* s_current_memory_resource = nullptr;
+
+std::pmr::memory_resource* current_memory_resource() {
+    return s_current_memory_resource ? s_current_memory_resource : std::pmr::get_default_resource();
+}
+
+ScopedMemoryResource::ScopedMemoryResource(std::pmr::memory_resource& resource)
+    : m_previous(s_current_memory_resource) {
+    s_current_memory_resource = &resource;
+}
+
+ScopedMemoryResource::~ScopedMemoryResource() {
+    s_current_memory_resource = m_previous;
+}
+
+}
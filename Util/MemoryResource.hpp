@@ -0,0 +1,55 @@
+#pragma once
+
+#include "NonCopyable.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+namespace Util {
+
+// Resource that containers of this library (Buffer, UString,
+// UStringBuilder, MultidimensionalArray) allocate from if one isn't given
+// explicitly. This is std::pmr::get_default_resource(), unless overridden
+// for the current thread with a ScopedMemoryResource.
+std::pmr::memory_resource* current_memory_resource();
+
+// Make containers allocate from a resource (e.g an Arena) on the current
+// thread while this object is alive. Containers remember the resource they
+// allocated from, so they must not outlive it. Note that copies of UStrings
+// share storage; make a copy of the data (e.g `UString { string.span() }`)
+// to keep a string for longer.
+class ScopedMemoryResource : public NonCopyable {
+public:
+    explicit ScopedMemoryResource(std::pmr::memory_resource&);
+    ~ScopedMemoryResource();
+
+    ScopedMemoryResource(ScopedMemoryResource&&) = delete;
+    ScopedMemoryResource& operator=(ScopedMemoryResource&&) = delete;
+
+private:
+    std::pmr::memory_resource* m_previous;
+};
+
+namespace Detail {
+
+// Like new T[count] and delete[], but using a resource.
+template<class T>
+T* allocate_array(std::pmr::memory_resource* resource, size_t count) {
+    auto array = static_cast<T*>(resource->allocate(count * sizeof(T), alignof(T)));
+    std::uninitialized_default_construct_n(array, count);
+    return array;
+}
+
+template<class T>
+void free_array(std::pmr::memory_resource* resource, T* array, size_t count) {
+    if (!array) {
+        return;
+    }
+    std::destroy_n(array, count);
+    resource->deallocate(array, count * sizeof(T), alignof(T));
+}
+
+}
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "MemoryResource.hpp"
 #include "NonCopyable.hpp"
 #include "Vector.hpp"
 #include <algorithm>
@@ -22,8 +23,10 @@ public:
         return std::get<Dim>(std::tuple { Dimensions... });
     }
 
-    MultidimensionalArray(Type const& v = {}) {
-        m_storage = new Type[size()];
+    // If resource is null, current_memory_resource() is used.
+    MultidimensionalArray(Type const& v = {}, std::pmr::memory_resource* resource = nullptr)
+        : m_resource(resource ? resource : current_memory_resource()) {
+        m_storage = Detail::allocate_array<Type>(m_resource, size());
         fill(v);
     }
 
@@ -36,13 +39,13 @@ public:
     MultidimensionalArray& operator=(MultidimensionalArray&& arr) {
         if (this == &arr)
             return *this;
-        if (m_storage)
-            delete[] m_storage;
+        Detail::free_array(m_resource, m_storage, size());
         m_storage = std::exchange(arr.m_storage, nullptr);
+        m_resource = arr.m_resource;
         return *this;
     }
 
-    ~MultidimensionalArray() { delete[] m_storage; }
+    ~MultidimensionalArray() { Detail::free_array(m_resource, m_storage, size()); }
 
     Vector dimensions() const { return { Dimensions... }; }
     size_t size() const { return (Dimensions * ...); }
@@ -119,6 +122,7 @@ private:
     }
 
     Type* m_storage = nullptr;
+    std::pmr::memory_resource* m_resource = nullptr;
 };
 
 }
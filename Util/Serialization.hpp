@@ -0,0 +1,303 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "Endianness.hpp"
+#include "Error.hpp"
+#include "Stream/Reader.hpp"
+#include "Stream/Writer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Describes fields of a struct, so that it can be serialized with functions
+// from Util::Serialization. Use it in the namespace of the struct.
+// FieldsMacro is expected to be of the form
+// #define MY_RECORD_FIELDS(F)
+//    F(name)
+//    F(name)
+// Fields are stored in this order, packed, in little endian. They may be
+// arithmetic types, enums or other serializable structs.
+#define ESSA_SERIALIZABLE(Type, FieldsMacro)                                                   \
+    [[maybe_unused]] constexpr auto _essa_serializable_fields(Type const*) {                   \
+        using _Type = Type;                                                                    \
+        return std::tuple_cat(FieldsMacro(_ESSA_SERIALIZABLE_FIELD) std::tuple<> {});          \
+    }
+
+#define _ESSA_SERIALIZABLE_FIELD(Name) \
+    std::tuple { Util::Serialization::Field<&_Type::Name, offsetof(_Type, Name)> {} },
+
+namespace Util::Serialization {
+
+template<auto Member, size_t Offset>
+struct Field {
+    template<class C, class M>
+    static M member_type(M C::*);
+
+    using Type = decltype(member_type(Member));
+    static constexpr auto member = Member;
+
+    // Offset in memory (not in serialized data).
+    static constexpr size_t offset = Offset;
+};
+
+template<class T>
+concept Record = requires(T const* t) { _essa_serializable_fields(t); };
+
+template<class T>
+concept Scalar = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+template<Record T>
+constexpr auto fields_of() {
+    return _essa_serializable_fields(static_cast<T const*>(nullptr));
+}
+
+// Size of a value in serialized data.
+template<class T>
+constexpr size_t serialized_size() {
+    if constexpr (Scalar<T>) {
+        return sizeof(T);
+    }
+    else {
+        static_assert(Record<T>, "Field must be a scalar or a serializable struct");
+        return std::apply([](auto... fields) { return (serialized_size<typename decltype(fields)::Type>() + ... + 0); }, fields_of<T>());
+    }
+}
+
+// True if serialized data is exactly the memory representation of T, so
+// that arrays can be copied (or used in place) at once.
+template<class T>
+constexpr bool has_native_layout() {
+    if constexpr (std::is_same_v<T, bool>) {
+        // Not every byte is a valid bool.
+        return false;
+    }
+    else if constexpr (Scalar<T>) {
+        return std::endian::native == std::endian::little;
+    }
+    else {
+        if constexpr (!std::is_trivially_copyable_v<T> || sizeof(T) != serialized_size<T>()) {
+            return false;
+        }
+        else {
+            return std::apply([](auto... fields) {
+                size_t offset = 0;
+                return ((fields.offset == std::exchange(offset, offset + serialized_size<typename decltype(fields)::Type>())
+                            && has_native_layout<typename decltype(fields)::Type>())
+                    && ...);
+            },
+                fields_of<T>());
+        }
+    }
+}
+
+namespace Detail {
+
+template<class T>
+using UnsignedOfSize = std::conditional_t<sizeof(T) == 1, uint8_t, std::conditional_t<sizeof(T) == 2, uint16_t, std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+
+}
+
+// Write a value to `output`, which must have serialized_size<T>() bytes.
+template<class T>
+void encode(T const& value, uint8_t* output) {
+    if constexpr (Scalar<T>) {
+        auto converted = convert_from_host_to_little_endian(std::bit_cast<Detail::UnsignedOfSize<T>>(value));
+        std::memcpy(output, &converted, sizeof(T));
+    }
+    else {
+        std::apply([&](auto... fields) {
+            ((encode(value.*fields.member, output), output += serialized_size<typename decltype(fields)::Type>()), ...);
+        },
+            fields_of<T>());
+    }
+}
+
+// Read a value from `input`, which must have serialized_size<T>() bytes.
+template<class T>
+void decode(uint8_t const* input, T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        value = *input != 0;
+    }
+    else if constexpr (Scalar<T>) {
+        Detail::UnsignedOfSize<T> converted;
+        std::memcpy(&converted, input, sizeof(T));
+        value = std::bit_cast<T>(convert_from_little_to_host_endian(converted));
+    }
+    else {
+        std::apply([&](auto... fields) {
+            ((decode(input, value.*fields.member), input += serialized_size<typename decltype(fields)::Type>()), ...);
+        },
+            fields_of<T>());
+    }
+}
+
+template<auto A, auto B>
+constexpr bool is_same_member() {
+    if constexpr (std::is_same_v<decltype(A), decltype(B)>) {
+        return A == B;
+    }
+    else {
+        return false;
+    }
+}
+
+// Offset of a field of T in serialized data.
+template<Record T, auto Member>
+constexpr size_t serialized_offset() {
+    return std::apply([](auto... fields) {
+        size_t offset = 0;
+        std::optional<size_t> result;
+        ((is_same_member<decltype(fields)::member, Member>() ? void(result = offset) : void(), offset += serialized_size<typename decltype(fields)::Type>()), ...);
+        return result.value();
+    },
+        fields_of<T>());
+}
+
+// Array of records in serialized data, e.g in a mapped file. Records (or
+// single fields) are decoded on access, so nothing is copied up front.
+template<Record T>
+class RecordArrayView {
+public:
+    static constexpr size_t RecordSize = serialized_size<T>();
+
+    RecordArrayView() = default;
+
+    // Fails with EINVAL if size of the data isn't a multiple of the record
+    // size.
+    static OsErrorOr<RecordArrayView> create(std::span<uint8_t const> data) {
+        if (data.size() % RecordSize != 0) {
+            return OsError { EINVAL, "RecordArrayView::create" };
+        }
+        return RecordArrayView { data };
+    }
+
+    size_t size() const { return m_data.size() / RecordSize; }
+    bool is_empty() const { return m_data.empty(); }
+    std::span<uint8_t const> data() const { return m_data; }
+
+    T operator[](size_t index) const {
+        assert(index < size());
+        T value;
+        decode(m_data.data() + index * RecordSize, value);
+        return value;
+    }
+
+    // Decode a single field, e.g `view.get<&Record::field>(index)`.
+    template<auto Member>
+    auto get(size_t index) const {
+        assert(index < size());
+        typename Field<Member, 0>::Type value;
+        decode(m_data.data() + index * RecordSize + serialized_offset<T, Member>(), value);
+        return value;
+    }
+
+    // Records as they are, if T has native layout and the data is aligned
+    // for it.
+    std::optional<std::span<T const>> as_span() const {
+        if constexpr (has_native_layout<T>()) {
+            if (reinterpret_cast<uintptr_t>(m_data.data()) % alignof(T) == 0) {
+                return std::span { reinterpret_cast<T const*>(m_data.data()), size() };
+            }
+        }
+        return {};
+    }
+
+private:
+    explicit RecordArrayView(std::span<uint8_t const> data)
+        : m_data(data) { }
+
+    std::span<uint8_t const> m_data;
+};
+
+// Records are encoded in batches of this size, so that a stream gets big
+// writes instead of one per field.
+constexpr size_t BatchSize = 64 * 1024;
+
+template<class T>
+OsErrorOr<void> write(Writer& writer, T const& value) {
+    uint8_t data[serialized_size<T>()];
+    encode(value, data);
+    return writer.write_all(data);
+}
+
+template<Record T>
+OsErrorOr<void> write_array(Writer& writer, std::span<T const> values) {
+    if constexpr (has_native_layout<T>()) {
+        return writer.write_all({ reinterpret_cast<uint8_t const*>(values.data()), values.size_bytes() });
+    }
+    else {
+        constexpr size_t RecordSize = serialized_size<T>();
+        constexpr size_t RecordsPerBatch = std::max<size_t>(1, BatchSize / RecordSize);
+        auto batch = Buffer::uninitialized(std::min(values.size(), RecordsPerBatch) * RecordSize);
+        while (!values.empty()) {
+            auto count = std::min(values.size(), RecordsPerBatch);
+            for (size_t s = 0; s < count; s++) {
+                encode(values[s], batch.begin() + s * RecordSize);
+            }
+            TRY(writer.write_all(batch.span().first(count * RecordSize)));
+            values = values.subspan(count);
+        }
+        return {};
+    }
+}
+
+template<class T>
+OsErrorOr<T> read(BinaryReader& reader) {
+    uint8_t data[serialized_size<T>()];
+    if (!TRY(reader.read_all(data))) {
+        return OsError { 0, "EOF in Serialization::read" };
+    }
+    T value;
+    decode(data, value);
+    return value;
+}
+
+template<Record T>
+OsErrorOr<void> read_array(BinaryReader& reader, std::span<T> values) {
+    if constexpr (has_native_layout<T>()) {
+        if (!TRY(reader.read_all({ reinterpret_cast<uint8_t*>(values.data()), values.size_bytes() }))) {
+            return OsError { 0, "EOF in Serialization::read_array" };
+        }
+        return {};
+    }
+    else {
+        constexpr size_t RecordSize = serialized_size<T>();
+        constexpr size_t RecordsPerBatch = std::max<size_t>(1, BatchSize / RecordSize);
+        while (!values.empty()) {
+            auto count = std::min(values.size(), RecordsPerBatch);
+            auto data = TRY(reader.read_view(count * RecordSize));
+            if (!data) {
+                return OsError { 0, "EOF in Serialization::read_array" };
+            }
+            for (size_t s = 0; s < count; s++) {
+                decode(data->data() + s * RecordSize, values[s]);
+            }
+            values = values.subspan(count);
+        }
+        return {};
+    }
+}
+
+// View of the next `count` records. This doesn't copy if the stream is
+// backed by memory (e.g a ReadableMappedStream), otherwise the view is
+// valid only until the next read. Returns an empty optional on EOF.
+template<Record T>
+OsErrorOr<std::optional<RecordArrayView<T>>> read_array_view(BinaryReader& reader, size_t count) {
+    auto data = TRY(reader.read_view(count * serialized_size<T>()));
+    if (!data) {
+        return std::optional<RecordArrayView<T>> {};
+    }
+    return std::optional { MUST(RecordArrayView<T>::create(*data)) };
+}
+
+}
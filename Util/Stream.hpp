@@ -1,7 +1,15 @@
 #pragma once
 
+#include "Stream/AsyncFile.hpp"
+#include "Stream/BitStream.hpp"
+#include "Stream/Compression.hpp"
 #include "Stream/File.hpp"
+#include "Stream/HashingStream.hpp"
+#include "Stream/LineIndex.hpp"
+#include "Stream/MappedFile.hpp"
 #include "Stream/MemoryStream.hpp"
+#include "Stream/ParallelDecoder.hpp"
+#include "Stream/RandomAccessReader.hpp"
 #include "Stream/Reader.hpp"
 #include "Stream/StandardStreams.hpp"
 #include "Stream/Stream.hpp"
@@ -0,0 +1,539 @@
+#include "AsyncFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+namespace Util {
+
+namespace {
+
+struct Request {
+    enum class Type {
+        Read,
+        Write,
+    };
+    Type type;
+    int fd;
+    uint8_t* data;
+    size_t size;
+    size_t offset;
+    AsyncIOQueue::Callback callback;
+};
+
+OsErrorOr<size_t> perform_blocking(Request const& request) {
+    auto size = std::min(request.size, AsyncIOQueue::MaxTransferSize);
+    while (true) {
+        auto result = request.type == Request::Type::Read
+            ? ::pread(request.fd, request.data, size, request.offset)
+            : ::pwrite(request.fd, request.data, size, request.offset);
+        if (result >= 0) {
+            return static_cast<size_t>(result);
+        }
+        if (errno != EINTR) {
+            return OsError { errno, request.type == Request::Type::Read ? "AsyncIOQueue::read" : "AsyncIOQueue::write" };
+        }
+    }
+}
+
+// Count of operations that were submitted, but didn't complete yet.
+// NOTE: This uses atomic wait instead of std::condition_variable, because
+//       since GCC 12 condition_variable::wait() links to a symbol with
+//       version GLIBCXX_3.4.30, and the library then fails to load with an
+//       older libstdc++ (e.g one bundled with a Python distribution).
+//       Atomic wait is implemented in headers.
+class PendingCounter {
+public:
+    void add() { m_count.fetch_add(1); }
+
+    void complete(size_t count = 1) {
+        if (count > 0 && m_count.fetch_sub(count) == count) {
+            m_count.notify_all();
+        }
+    }
+
+    void wait_for_zero() {
+        while (auto count = m_count.load()) {
+            m_count.wait(count);
+        }
+    }
+
+private:
+    std::atomic<size_t> m_count = 0;
+};
+
+class ThreadPoolQueue : public AsyncIOQueue {
+public:
+    explicit ThreadPoolQueue(size_t thread_count) {
+        for (size_t s = 0; s < std::max<size_t>(thread_count, 1); s++) {
+            m_threads.emplace_back([this] { run_worker(); });
+        }
+    }
+
+    virtual ~ThreadPoolQueue() override {
+        // Workers exit when they are woken up without a request.
+        m_work_available.release(m_threads.size());
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    virtual Backend backend() const override { return Backend::ThreadPool; }
+
+    virtual void submit_read(int fd, std::span<uint8_t> data, size_t offset, Callback callback) override {
+        submit({ Request::Type::Read, fd, data.data(), data.size(), offset, std::move(callback) });
+    }
+
+    virtual void submit_write(int fd, std::span<uint8_t const> data, size_t offset, Callback callback) override {
+        submit({ Request::Type::Write, fd, const_cast<uint8_t*>(data.data()), data.size(), offset, std::move(callback) });
+    }
+
+    virtual void wait_for_all() override {
+        m_pending.wait_for_zero();
+    }
+
+private:
+    void submit(Request request) {
+        {
+            std::lock_guard lock { m_mutex };
+            m_requests.push_back(std::move(request));
+            m_pending.add();
+        }
+        m_work_available.release();
+    }
+
+    void run_worker() {
+        while (true) {
+            m_work_available.acquire();
+            std::unique_lock lock { m_mutex };
+            if (m_requests.empty()) {
+                // Exiting, and there is nothing more to do.
+                return;
+            }
+            auto request = std::move(m_requests.front());
+            m_requests.pop_front();
+            lock.unlock();
+
+            request.callback(perform_blocking(request));
+            m_pending.complete();
+        }
+    }
+
+    std::mutex m_mutex;
+    // Released once for every request, and once for every thread on exit.
+    std::counting_semaphore<> m_work_available { 0 };
+    std::deque<Request> m_requests;
+    PendingCounter m_pending;
+    std::vector<std::thread> m_threads;
+};
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+// Submissions are made by the calling thread, and a separate thread waits
+// for completions and calls callbacks. At most as many requests as the
+// completion queue can hold are in flight; the rest wait in a queue and are
+// submitted by the completion thread.
+class IoUringQueue : public AsyncIOQueue {
+public:
+    static OsErrorOr<std::unique_ptr<IoUringQueue>> create(size_t queue_depth) {
+        io_uring_params params {};
+        auto fd = io_uring_setup(queue_depth, &params);
+        if (fd < 0) {
+            return OsError { errno, "io_uring_setup" };
+        }
+        auto queue = std::unique_ptr<IoUringQueue>(new IoUringQueue(fd));
+        TRY(queue->map_rings(params));
+        TRY(queue->check_supported_operations());
+        queue->m_completion_thread = std::thread { [queue = queue.get()] { queue->run_completion_thread(); } };
+        return queue;
+    }
+
+    virtual ~IoUringQueue() override {
+        if (m_completion_thread.joinable()) {
+            wait_for_all();
+            {
+                std::lock_guard lock { m_mutex };
+                // Request with null user_data wakes up and stops the thread.
+                // It exits by itself if the ring is broken. Otherwise there
+                // is no other way to stop it, so this must not fail.
+                if (!m_error) {
+                    MUST(push_sqe(IORING_OP_NOP, -1, nullptr, 0, 0, 0));
+                }
+            }
+            m_completion_thread.join();
+        }
+        if (m_sqes) {
+            munmap(m_sqes, m_sqes_size);
+        }
+        if (m_cq_ring && m_cq_ring != m_sq_ring) {
+            munmap(m_cq_ring, m_cq_ring_size);
+        }
+        if (m_sq_ring) {
+            munmap(m_sq_ring, m_sq_ring_size);
+        }
+        ::close(m_fd);
+    }
+
+    virtual Backend backend() const override { return Backend::IoUring; }
+
+    virtual void submit_read(int fd, std::span<uint8_t> data, size_t offset, Callback callback) override {
+        submit(new Request { Request::Type::Read, fd, data.data(), data.size(), offset, std::move(callback) });
+    }
+
+    virtual void submit_write(int fd, std::span<uint8_t const> data, size_t offset, Callback callback) override {
+        submit(new Request { Request::Type::Write, fd, const_cast<uint8_t*>(data.data()), data.size(), offset, std::move(callback) });
+    }
+
+    virtual void wait_for_all() override {
+        m_pending.wait_for_zero();
+    }
+
+private:
+    explicit IoUringQueue(int fd)
+        : m_fd(fd) { }
+
+    OsErrorOr<void> map_rings(io_uring_params const& params) {
+        m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+        }
+
+        auto map = [&](size_t size, off_t offset) -> OsErrorOr<uint8_t*> {
+            auto pointer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+            if (pointer == MAP_FAILED) {
+                return OsError { errno, "IoUringQueue: mmap" };
+            }
+            return static_cast<uint8_t*>(pointer);
+        };
+        m_sq_ring = TRY(map(m_sq_ring_size, IORING_OFF_SQ_RING));
+        m_cq_ring = single_mmap ? m_sq_ring : TRY(map(m_cq_ring_size, IORING_OFF_CQ_RING));
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = reinterpret_cast<io_uring_sqe*>(TRY(map(m_sqes_size, IORING_OFF_SQES)));
+
+        m_sq_tail = reinterpret_cast<unsigned*>(m_sq_ring + params.sq_off.tail);
+        m_sq_mask = *reinterpret_cast<unsigned*>(m_sq_ring + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned*>(m_sq_ring + params.sq_off.array);
+        m_cq_head = reinterpret_cast<unsigned*>(m_cq_ring + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned*>(m_cq_ring + params.cq_off.tail);
+        m_cq_mask = *reinterpret_cast<unsigned*>(m_cq_ring + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(m_cq_ring + params.cq_off.cqes);
+        m_max_in_flight = params.cq_entries;
+        return {};
+    }
+
+    // IORING_OP_READ/WRITE were added later than io_uring itself.
+    OsErrorOr<void> check_supported_operations() {
+        constexpr size_t OpCount = 64;
+        std::vector<uint8_t> memory(sizeof(io_uring_probe) + OpCount * sizeof(io_uring_probe_op));
+        auto probe = reinterpret_cast<io_uring_probe*>(memory.data());
+        if (io_uring_register(m_fd, IORING_REGISTER_PROBE, probe, OpCount) < 0) {
+            return OsError { errno, "IoUringQueue: probe" };
+        }
+        for (auto op : { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_NOP }) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return OsError { ENOTSUP, "IoUringQueue: read/write not supported" };
+            }
+        }
+        return {};
+    }
+
+    void submit(Request* request) {
+        m_pending.add();
+        std::optional<OsError> error;
+        {
+            std::lock_guard lock { m_mutex };
+            if (m_error) {
+                error = m_error;
+            }
+            else if (m_in_flight.size() >= m_max_in_flight) {
+                m_waiting.push_back(request);
+                return;
+            }
+            else if (auto result = push_request(request); result.is_error()) {
+                error = result.release_error();
+            }
+        }
+        if (error) {
+            fail(request, *error);
+        }
+    }
+
+    // Complete a request that didn't complete in the ring with an error.
+    // Must be called with m_mutex unlocked, because the callback may
+    // submit more requests.
+    void fail(Request* request, OsError error) {
+        request->callback(error);
+        delete request;
+        m_pending.complete();
+    }
+
+    // Must be called with m_mutex locked.
+    OsErrorOr<void> push_request(Request* request) {
+        TRY(push_sqe(request->type == Request::Type::Read ? IORING_OP_READ : IORING_OP_WRITE,
+            request->fd, request->data, request->size, request->offset, reinterpret_cast<uint64_t>(request)));
+        m_in_flight.insert(request);
+        return {};
+    }
+
+    // Must be called with m_mutex locked.
+    OsErrorOr<void> push_sqe(uint8_t opcode, int fd, uint8_t* data, size_t size, size_t offset, uint64_t user_data) {
+        // Every entry is submitted right away, so there is always space.
+        auto tail = *m_sq_tail;
+        auto index = tail & m_sq_mask;
+        auto& sqe = m_sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = std::min(size, AsyncIOQueue::MaxTransferSize);
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        m_sq_array[index] = index;
+        std::atomic_ref { *m_sq_tail }.store(tail + 1, std::memory_order_release);
+
+        while (io_uring_enter(m_fd, 1, 0, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                // The entry wasn't consumed, so take it back.
+                auto error = errno;
+                std::atomic_ref { *m_sq_tail }.store(tail, std::memory_order_release);
+                return OsError { error, "io_uring_enter" };
+            }
+        }
+        return {};
+    }
+
+    void run_completion_thread() {
+        std::vector<std::pair<Request*, int>> completions;
+        std::vector<std::pair<Request*, OsError>> failed;
+        while (true) {
+            if (io_uring_enter(m_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                fail_all(OsError { errno, "io_uring_enter" });
+                return;
+            }
+
+            auto head = *m_cq_head;
+            auto tail = std::atomic_ref { *m_cq_tail }.load(std::memory_order_acquire);
+            bool exiting = false;
+            completions.clear();
+            while (head != tail) {
+                auto const& cqe = m_cqes[head & m_cq_mask];
+                auto request = reinterpret_cast<Request*>(cqe.user_data);
+                if (request) {
+                    completions.emplace_back(request, cqe.res);
+                }
+                else {
+                    exiting = true;
+                }
+                head++;
+            }
+            std::atomic_ref { *m_cq_head }.store(head, std::memory_order_release);
+
+            failed.clear();
+            {
+                std::lock_guard lock { m_mutex };
+                for (auto [request, res] : completions) {
+                    m_in_flight.erase(request);
+                }
+                while (!m_waiting.empty() && m_in_flight.size() < m_max_in_flight) {
+                    auto request = m_waiting.front();
+                    m_waiting.pop_front();
+                    if (auto result = push_request(request); result.is_error()) {
+                        failed.emplace_back(request, result.release_error());
+                    }
+                }
+            }
+
+            for (auto [request, res] : completions) {
+                if (res < 0) {
+                    request->callback(OsError { -res, request->type == Request::Type::Read ? "AsyncIOQueue::read" : "AsyncIOQueue::write" });
+                }
+                else {
+                    request->callback(static_cast<size_t>(res));
+                }
+                delete request;
+            }
+            m_pending.complete(completions.size());
+            for (auto& [request, error] : failed) {
+                fail(request, error);
+            }
+            if (exiting) {
+                return;
+            }
+        }
+    }
+
+    // Completions can't be waited for anymore, so fail all requests that
+    // didn't complete, and every request submitted later. Operations that
+    // the kernel already started may still finish, but the ring is broken
+    // only by bugs (e.g a bad fd), so this is just to not hang.
+    void fail_all(OsError error) {
+        std::vector<Request*> requests;
+        {
+            std::lock_guard lock { m_mutex };
+            m_error = error;
+            requests.assign(m_in_flight.begin(), m_in_flight.end());
+            requests.insert(requests.end(), m_waiting.begin(), m_waiting.end());
+            m_in_flight.clear();
+            m_waiting.clear();
+        }
+        for (auto request : requests) {
+            fail(request, error);
+        }
+    }
+
+    int m_fd;
+
+    uint8_t* m_sq_ring = nullptr;
+    size_t m_sq_ring_size = 0;
+    uint8_t* m_cq_ring = nullptr;
+    size_t m_cq_ring_size = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqes_size = 0;
+
+    unsigned* m_sq_tail = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned* m_sq_array = nullptr;
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+
+    std::mutex m_mutex;
+    PendingCounter m_pending;
+    // Requests submitted to the ring, at most m_max_in_flight.
+    std::unordered_set<Request*> m_in_flight;
+    size_t m_max_in_flight = 0;
+    std::deque<Request*> m_waiting;
+    // Set if the ring is broken, then all requests fail with it.
+    std::optional<OsError> m_error;
+    std::thread m_completion_thread;
+};
+
+}
+
+OsErrorOr<std::unique_ptr<AsyncIOQueue>> AsyncIOQueue::create() {
+    auto io_uring = create_io_uring();
+    if (!io_uring.is_error()) {
+        return io_uring.release_value();
+    }
+    return create_thread_pool();
+}
+
+OsErrorOr<std::unique_ptr<AsyncIOQueue>> AsyncIOQueue::create_io_uring(size_t queue_depth) {
+    return std::unique_ptr<AsyncIOQueue> { TRY(IoUringQueue::create(queue_depth)) };
+}
+
+OsErrorOr<std::unique_ptr<AsyncIOQueue>> AsyncIOQueue::create_thread_pool(size_t thread_count) {
+    return std::unique_ptr<AsyncIOQueue> { std::make_unique<ThreadPoolQueue>(thread_count) };
+}
+
+OsErrorOr<AsyncFile> AsyncFile::open(AsyncIOQueue& queue, std::string const& file_name, OpenOptions options) {
+    auto flags = options.write ? (O_RDWR | O_CREAT | (options.truncate ? O_TRUNC : 0)) : O_RDONLY;
+    auto fd = ::open(file_name.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return OsError { errno, "AsyncFile::open" };
+    }
+    return AsyncFile { queue, fd };
+}
+
+OsErrorOr<AsyncFile> AsyncFile::open(AsyncIOQueue& queue, std::string const& file_name) {
+    return open(queue, file_name, {});
+}
+
+void AsyncFile::read_at(std::span<uint8_t> data, size_t offset, AsyncIOQueue::Callback callback) {
+    m_queue->submit_read(fd(), data, offset, std::move(callback));
+}
+
+std::future<OsErrorOr<size_t>> AsyncFile::read_at(std::span<uint8_t> data, size_t offset) {
+    auto promise = std::make_shared<std::promise<OsErrorOr<size_t>>>();
+    auto future = promise->get_future();
+    read_at(data, offset, [promise](OsErrorOr<size_t> result) { promise->set_value(std::move(result)); });
+    return future;
+}
+
+void AsyncFile::write_at(std::span<uint8_t const> data, size_t offset, AsyncIOQueue::Callback callback) {
+    m_queue->submit_write(fd(), data, offset, std::move(callback));
+}
+
+std::future<OsErrorOr<size_t>> AsyncFile::write_at(std::span<uint8_t const> data, size_t offset) {
+    auto promise = std::make_shared<std::promise<OsErrorOr<size_t>>>();
+    auto future = promise->get_future();
+    write_at(data, offset, [promise](OsErrorOr<size_t> result) { promise->set_value(std::move(result)); });
+    return future;
+}
+
+namespace {
+
+struct ReadBufferState {
+    AsyncIOQueue& queue;
+    int fd;
+    size_t offset;
+    Buffer buffer;
+    size_t bytes_read = 0;
+    std::promise<OsErrorOr<Buffer>> promise;
+};
+
+// Read the rest of the buffer, one operation at a time, until it is full
+// or the end of file is reached.
+void read_rest(std::shared_ptr<ReadBufferState> state) {
+    auto rest = state->buffer.span().subspan(state->bytes_read);
+    state->queue.submit_read(state->fd, rest, state->offset + state->bytes_read, [state](OsErrorOr<size_t> result) {
+        if (result.is_error()) {
+            state->promise.set_value(result.release_error());
+            return;
+        }
+        auto bytes = result.release_value();
+        state->bytes_read += bytes;
+        if (bytes == 0 || state->bytes_read == state->buffer.size()) {
+            state->buffer.resize_uninitialized(state->bytes_read);
+            state->promise.set_value(std::move(state->buffer));
+            return;
+        }
+        read_rest(state);
+    });
+}
+
+}
+
+std::future<OsErrorOr<Buffer>> AsyncFile::read_buffer_at(size_t offset, size_t size) {
+    auto state = std::make_shared<ReadBufferState>(*m_queue, fd(), offset, Buffer::uninitialized(size));
+    auto future = state->promise.get_future();
+    read_rest(std::move(state));
+    return future;
+}
+
+OsErrorOr<std::future<OsErrorOr<Buffer>>> AsyncFile::read_all() {
+    struct stat st;
+    if (fstat(fd(), &st) < 0) {
+        return OsError { errno, "AsyncFile::read_all" };
+    }
+    return read_buffer_at(0, st.st_size);
+}
+
+}
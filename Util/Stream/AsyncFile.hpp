@@ -0,0 +1,92 @@
+#pragma once
+
+#include "../Buffer.hpp"
+#include "../Error.hpp"
+#include "../NonCopyable.hpp"
+#include "File.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <span>
+#include <string>
+
+namespace Util {
+
+// Executes file reads and writes asynchronously. Uses io_uring if the kernel
+// supports it, and a pool of threads doing pread/pwrite otherwise.
+// Completion callbacks are called on the queue's own thread(s), so they
+// should be short and must not wait for other operations.
+class AsyncIOQueue : public NonCopyable {
+public:
+    enum class Backend {
+        IoUring,
+        ThreadPool,
+    };
+
+    // Called with count of bytes transferred (which may be less than
+    // requested, like with read()/write()) or an error.
+    using Callback = std::function<void(OsErrorOr<size_t>)>;
+
+    // Most bytes transferred by a single operation (the same limit as
+    // Linux has for read()/write()). Bigger operations are short.
+    static constexpr size_t MaxTransferSize = 0x7ffff000;
+
+    // io_uring if available, thread pool otherwise.
+    static OsErrorOr<std::unique_ptr<AsyncIOQueue>> create();
+    static OsErrorOr<std::unique_ptr<AsyncIOQueue>> create_io_uring(size_t queue_depth = 256);
+    static OsErrorOr<std::unique_ptr<AsyncIOQueue>> create_thread_pool(size_t thread_count = 8);
+
+    // Waits for all operations to complete.
+    virtual ~AsyncIOQueue() = default;
+
+    virtual Backend backend() const = 0;
+
+    // Buffers must be valid until the callback is called.
+    virtual void submit_read(int fd, std::span<uint8_t>, size_t offset, Callback) = 0;
+    virtual void submit_write(int fd, std::span<uint8_t const>, size_t offset, Callback) = 0;
+
+    // Wait until all submitted operations complete (including callbacks).
+    virtual void wait_for_all() = 0;
+};
+
+// File that is read and written at explicit offsets through an AsyncIOQueue.
+// The queue must outlive the file, and the file must outlive its pending
+// operations.
+class AsyncFile : public File {
+public:
+    struct OpenOptions {
+        bool write = false;
+        bool truncate = false;
+    };
+    static OsErrorOr<AsyncFile> open(AsyncIOQueue&, std::string const& file_name, OpenOptions options);
+
+    // Open for reading only.
+    static OsErrorOr<AsyncFile> open(AsyncIOQueue&, std::string const& file_name);
+
+    AsyncIOQueue& queue() const { return *m_queue; }
+
+    void read_at(std::span<uint8_t>, size_t offset, AsyncIOQueue::Callback);
+    std::future<OsErrorOr<size_t>> read_at(std::span<uint8_t>, size_t offset);
+
+    void write_at(std::span<uint8_t const>, size_t offset, AsyncIOQueue::Callback);
+    std::future<OsErrorOr<size_t>> write_at(std::span<uint8_t const>, size_t offset);
+
+    // Read `size` bytes into a newly allocated Buffer. Short reads are
+    // continued, so the buffer is truncated only at the end of file.
+    std::future<OsErrorOr<Buffer>> read_buffer_at(size_t offset, size_t size);
+
+    // Read the whole file into a Buffer.
+    OsErrorOr<std::future<OsErrorOr<Buffer>>> read_all();
+
+private:
+    AsyncFile(AsyncIOQueue& queue, int fd)
+        : File(fd, true)
+        , m_queue(&queue) { }
+
+    AsyncIOQueue* m_queue;
+};
+
+}
@@ -0,0 +1,55 @@
+#include "BitStream.hpp"
+
+#include <cstring>
+
+namespace Util {
+
+OsErrorOr<void> BitWriter::flush_whole_bytes() {
+    auto bytes = m_bit_count / 8;
+    if (m_buffered_bytes + bytes > BufferSize) {
+        TRY(m_writer.write_all({ m_buffer, m_buffered_bytes }));
+        m_written_bytes += m_buffered_bytes;
+        m_buffered_bytes = 0;
+    }
+    auto value = convert_from_host_to_little_endian(m_bits);
+    std::memcpy(m_buffer + m_buffered_bytes, &value, bytes);
+    m_buffered_bytes += bytes;
+    m_bits = bytes == 8 ? 0 : m_bits >> (bytes * 8);
+    m_bit_count -= bytes * 8;
+    return {};
+}
+
+OsErrorOr<void> BitWriter::flush() {
+    m_bit_count = (m_bit_count + 7) / 8 * 8;
+    TRY(flush_whole_bytes());
+    TRY(m_writer.write_all({ m_buffer, m_buffered_bytes }));
+    m_written_bytes += m_buffered_bytes;
+    m_buffered_bytes = 0;
+    return {};
+}
+
+OsErrorOr<uint64_t> BitReader::read_bits(unsigned count) {
+    // Bits are taken from whole bytes, so that at most 7 are left over.
+    // For bigger counts, they wouldn't fit together in 64 bits.
+    if (count > 57) {
+        auto low = TRY(read_bits(32));
+        return low | (TRY(read_bits(count - 32)) << 32);
+    }
+    if (count > m_bit_count) {
+        auto bytes = (count - m_bit_count + 7) / 8;
+        auto data = TRY(m_reader.read_view(bytes));
+        if (!data) {
+            return OsError { 0, "EOF in BitReader::read_bits" };
+        }
+        uint64_t word = 0;
+        std::memcpy(&word, data->data(), bytes);
+        m_bits |= convert_from_little_to_host_endian(word) << m_bit_count;
+        m_bit_count += bytes * 8;
+    }
+    auto value = m_bits & ((uint64_t { 1 } << count) - 1);
+    m_bits >>= count;
+    m_bit_count -= count;
+    return value;
+}
+
+}
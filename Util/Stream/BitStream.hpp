@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Reader.hpp"
+#include "Writer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Util {
+
+// Packs values of any bit width (up to 64) tightly, least significant bit
+// first (as in DEFLATE). Bytes are written in chunks, and the last one is
+// padded with zeros by flush(). flush() must be called before destruction,
+// or the remaining bits are lost.
+class BitWriter {
+public:
+    explicit BitWriter(Writer& writer)
+        : m_writer(writer) { }
+
+    BitWriter(BitWriter const&) = delete;
+    BitWriter& operator=(BitWriter const&) = delete;
+
+    // Write `count` lowest bits of `value`. Higher bits must be zero.
+    OsErrorOr<void> write_bits(uint64_t value, unsigned count) {
+        if (count > 64 - m_bit_count) {
+            TRY(flush_whole_bytes());
+            if (count > 64 - m_bit_count) {
+                // At most 7 bits are left after flushing, so this happens
+                // only for counts above 56.
+                TRY(write_bits(value & 0xffffffff, 32));
+                return write_bits(value >> 32, count - 32);
+            }
+        }
+        if (count > 0) {
+            m_bits |= value << m_bit_count;
+            m_bit_count += count;
+        }
+        return {};
+    }
+
+    OsErrorOr<void> write_bit(bool value) { return write_bits(value, 1); }
+
+    // Pad the last byte with zeros and write everything out. Writing may
+    // continue after this, starting from a new byte.
+    OsErrorOr<void> flush();
+
+    // Count of bits written so far, including buffered ones and padding
+    // added by flush().
+    size_t bit_count() const { return m_written_bytes * 8 + m_buffered_bytes * 8 + m_bit_count; }
+
+private:
+    OsErrorOr<void> flush_whole_bytes();
+
+    static constexpr size_t BufferSize = 4096;
+
+    Writer& m_writer;
+    uint64_t m_bits = 0;
+    unsigned m_bit_count = 0;
+    uint8_t m_buffer[BufferSize];
+    size_t m_buffered_bytes = 0;
+    size_t m_written_bytes = 0;
+};
+
+// Reads data written by BitWriter. Only the byte that is currently read is
+// consumed from the reader, so after align_to_byte() the BinaryReader can
+// be used directly again.
+class BitReader {
+public:
+    explicit BitReader(BinaryReader& reader)
+        : m_reader(reader) { }
+
+    // Read `count` (up to 64) bits. Fails with an EOF error if there isn't
+    // enough data.
+    OsErrorOr<uint64_t> read_bits(unsigned count);
+
+    OsErrorOr<bool> read_bit() { return TRY(read_bits(1)) != 0; }
+
+    // Skip the rest of the current byte.
+    void align_to_byte() {
+        m_bit_count = 0;
+        m_bits = 0;
+    }
+
+private:
+    BinaryReader& m_reader;
+
+    // Bits of the last consumed byte that weren't read yet.
+    uint64_t m_bits = 0;
+    unsigned m_bit_count = 0;
+};
+
+}
@@ -0,0 +1,416 @@
+#include "Compression.hpp"
+
+#include "../Endianness.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+namespace Util {
+
+// See https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md. Every
+// sequence is a token (4 bits of literal length, 4 bits of match length),
+// literals, and a 16-bit offset of the match. Lengths of 15 and more are
+// continued in following bytes. The last sequence has only literals.
+namespace Lz4 {
+
+constexpr size_t MinMatch = 4;
+constexpr size_t MaxOffset = 65535;
+
+// The format requires that the last 5 bytes are literals and the last
+// match starts at least 12 bytes before the end.
+constexpr size_t LastLiterals = 5;
+constexpr size_t MatchStartLimit = 12;
+
+constexpr size_t HashBits = 12;
+
+// After this many failed match searches, positions start being skipped
+// faster, so incompressible data is processed quickly.
+constexpr size_t SkipTrigger = 6;
+
+static uint32_t load32(uint8_t const* pointer) {
+    uint32_t value;
+    std::memcpy(&value, pointer, sizeof(value));
+    return value;
+}
+
+static uint64_t load64(uint8_t const* pointer) {
+    uint64_t value;
+    std::memcpy(&value, pointer, sizeof(value));
+    return value;
+}
+
+static uint32_t hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - HashBits);
+}
+
+static uint8_t* write_length(uint8_t* output, size_t length) {
+    length -= 15;
+    while (length >= 255) {
+        *output++ = 255;
+        length -= 255;
+    }
+    *output++ = length;
+    return output;
+}
+
+static uint8_t* write_literals(uint8_t* output, std::span<uint8_t const> literals, uint8_t*& token) {
+    token = output++;
+    *token = std::min<size_t>(literals.size(), 15) << 4;
+    if (literals.size() >= 15) {
+        output = write_length(output, literals.size());
+    }
+    return std::copy(literals.begin(), literals.end(), output);
+}
+
+static size_t match_length(uint8_t const* input, size_t position, size_t candidate, size_t end) {
+    size_t length = MinMatch;
+    while (position + length + 8 <= end && load64(input + position + length) == load64(input + candidate + length)) {
+        length += 8;
+    }
+    while (position + length < end && input[position + length] == input[candidate + length]) {
+        length++;
+    }
+    return length;
+}
+
+}
+
+Lz4Codec const& Lz4Codec::the() {
+    static Lz4Codec codec;
+    return codec;
+}
+
+size_t Lz4Codec::max_compressed_size(size_t size) const {
+    return size + size / 255 + 16;
+}
+
+size_t Lz4Codec::compress(std::span<uint8_t const> input, std::span<uint8_t> output) const {
+    using namespace Lz4;
+    assert(output.size() >= max_compressed_size(input.size()));
+
+    auto in = input.data();
+    auto out = output.data();
+    uint8_t* token = nullptr;
+    size_t anchor = 0;
+
+    if (input.size() > MatchStartLimit) {
+        // Last seen position of every hash of 4 bytes. Candidates are always
+        // verified, so initial zeros are fine.
+        uint32_t table[1 << HashBits] {};
+        auto const match_start_limit = input.size() - MatchStartLimit;
+        auto const match_end_limit = input.size() - LastLiterals;
+
+        size_t position = 1;
+        while (position < match_start_limit) {
+            size_t candidate = 0;
+            size_t search_count = 1 << SkipTrigger;
+            while (true) {
+                auto& entry = table[hash(load32(in + position))];
+                candidate = entry;
+                entry = position;
+                if (position - candidate <= MaxOffset && load32(in + candidate) == load32(in + position)) {
+                    break;
+                }
+                position += search_count++ >> SkipTrigger;
+                if (position >= match_start_limit) {
+                    goto last_literals;
+                }
+            }
+
+            while (position > anchor && candidate > 0 && in[position - 1] == in[candidate - 1]) {
+                position--;
+                candidate--;
+            }
+            auto length = match_length(in, position, candidate, match_end_limit);
+
+            out = write_literals(out, input.subspan(anchor, position - anchor), token);
+            auto offset = position - candidate;
+            *out++ = offset & 0xff;
+            *out++ = offset >> 8;
+            *token |= std::min<size_t>(length - MinMatch, 15);
+            if (length - MinMatch >= 15) {
+                out = write_length(out, length - MinMatch);
+            }
+
+            position += length;
+            anchor = position;
+            if (position < match_start_limit) {
+                table[hash(load32(in + position - 2))] = position - 2;
+            }
+        }
+    }
+
+last_literals:
+    out = write_literals(out, input.subspan(anchor), token);
+    return out - output.data();
+}
+
+OsErrorOr<void> Lz4Codec::decompress(std::span<uint8_t const> input, std::span<uint8_t> output) const {
+    using namespace Lz4;
+    OsError corrupted { EILSEQ, "Lz4Codec::decompress" };
+
+    size_t in = 0;
+    size_t out = 0;
+    auto read_length = [&](size_t length) -> std::optional<size_t> {
+        if (length < 15) {
+            return length;
+        }
+        uint8_t byte = 0;
+        do {
+            if (in >= input.size()) {
+                return {};
+            }
+            byte = input[in++];
+            length += byte;
+        } while (byte == 255);
+        return length;
+    };
+
+    while (true) {
+        if (in >= input.size()) {
+            return corrupted;
+        }
+        auto token = input[in++];
+
+        auto literals = read_length(token >> 4);
+        if (!literals || *literals > input.size() - in || *literals > output.size() - out) {
+            return corrupted;
+        }
+        std::copy_n(input.begin() + in, *literals, output.begin() + out);
+        in += *literals;
+        out += *literals;
+        if (in == input.size()) {
+            break;
+        }
+
+        if (input.size() - in < 2) {
+            return corrupted;
+        }
+        size_t offset = input[in] | (input[in + 1] << 8);
+        in += 2;
+        auto length = read_length(token & 0xf);
+        if (offset == 0 || offset > out || !length || *length + MinMatch > output.size() - out) {
+            return corrupted;
+        }
+
+        // Matches may overlap the output they produce (e.g a run of one
+        // byte has offset 1), so copy in chunks that don't.
+        auto destination = output.data() + out;
+        auto source = destination - offset;
+        auto match = *length + MinMatch;
+        if (offset >= match) {
+            std::memcpy(destination, source, match);
+        }
+        else if (offset >= 8) {
+            for (size_t s = 0; s < match; s += 8) {
+                std::memcpy(destination + s, source + s, std::min<size_t>(8, match - s));
+            }
+        }
+        else {
+            for (size_t s = 0; s < match; s++) {
+                destination[s] = source[s];
+            }
+        }
+        out += match;
+    }
+    if (out != output.size()) {
+        return corrupted;
+    }
+    return {};
+}
+
+CompressingWritableStream::CompressingWritableStream(WritableStream& stream, CompressionCodec const& codec, size_t frame_size)
+    : m_stream(stream)
+    , m_codec(codec)
+    , m_frame_size(frame_size)
+    , m_compressed(Buffer::uninitialized(CompressionFrame::HeaderSize + std::max(frame_size, codec.max_compressed_size(frame_size)))) {
+    assert(frame_size > 0 && frame_size < CompressionFrame::StoredFlag);
+    m_frame.ensure_capacity(frame_size);
+}
+
+CompressingWritableStream::~CompressingWritableStream() {
+    auto result = finish();
+    if (result.is_error()) {
+        result.dump("CompressingWritableStream: Failed to finish on destruction");
+    }
+}
+
+OsErrorOr<void> CompressingWritableStream::finish() {
+    TRY(write_pending());
+    if (m_frame.size() > 0) {
+        compress_frame(m_frame.span());
+        m_frame.clear();
+        TRY(write_pending());
+    }
+    return {};
+}
+
+OsErrorOr<size_t> CompressingWritableStream::write(std::span<uint8_t const> data) {
+    TRY(write_pending());
+    auto size = data.size();
+    while (!data.empty()) {
+        // Full frames are compressed directly from the input.
+        if (m_frame.size() == 0 && data.size() >= m_frame_size) {
+            compress_frame(data.first(m_frame_size));
+            data = data.subspan(m_frame_size);
+        }
+        else {
+            auto chunk = data.first(std::min(data.size(), m_frame_size - m_frame.size()));
+            m_frame.append(chunk);
+            data = data.subspan(chunk.size());
+            if (m_frame.size() < m_frame_size) {
+                continue;
+            }
+            compress_frame(m_frame.span());
+            m_frame.clear();
+        }
+        // Everything so far is accepted, it's either written or in
+        // m_compressed waiting to be written by the next call.
+        if (auto result = write_pending(); result.is_error()) {
+            return size - data.size();
+        }
+    }
+    return size;
+}
+
+void CompressingWritableStream::compress_frame(std::span<uint8_t const> data) {
+    assert(m_pending_size == 0);
+    auto payload = m_compressed.span().subspan(CompressionFrame::HeaderSize);
+    auto compressed_size = m_codec.compress(data, payload);
+    uint32_t stored_size = compressed_size;
+    if (compressed_size >= data.size()) {
+        std::copy(data.begin(), data.end(), payload.begin());
+        compressed_size = data.size();
+        stored_size = compressed_size | CompressionFrame::StoredFlag;
+    }
+
+    auto uncompressed_size_le = convert_from_host_to_little_endian<uint32_t>(data.size());
+    auto stored_size_le = convert_from_host_to_little_endian(stored_size);
+    std::memcpy(m_compressed.begin(), &uncompressed_size_le, 4);
+    std::memcpy(m_compressed.begin() + 4, &stored_size_le, 4);
+
+    m_pending_offset = 0;
+    m_pending_size = CompressionFrame::HeaderSize + compressed_size;
+}
+
+OsErrorOr<void> CompressingWritableStream::write_pending() {
+    while (m_pending_offset < m_pending_size) {
+        auto written = TRY(m_stream.write(m_compressed.span().subspan(m_pending_offset, m_pending_size - m_pending_offset)));
+        m_pending_offset += written;
+        m_compressed_size += written;
+    }
+    m_pending_offset = 0;
+    m_pending_size = 0;
+    return {};
+}
+
+OsErrorOr<void> CompressingWritableStream::seek(ssize_t, SeekDirection) {
+    return OsError { ESPIPE, "CompressingWritableStream::seek" };
+}
+
+DecompressingReadableStream::DecompressingReadableStream(ReadableStream& stream, CompressionCodec const& codec, size_t max_frame_size)
+    : m_stream(stream)
+    , m_codec(codec)
+    , m_max_frame_size(max_frame_size) {
+}
+
+OsErrorOr<size_t> DecompressingReadableStream::read(std::span<uint8_t> data) {
+    if (data.empty()) {
+        return static_cast<size_t>(0);
+    }
+    while (m_frame_offset == m_frame.size()) {
+        if (!TRY(read_frame())) {
+            m_eof = true;
+            return static_cast<size_t>(0);
+        }
+    }
+    auto size = std::min(data.size(), m_frame.size() - m_frame_offset);
+    std::copy_n(m_frame.begin() + m_frame_offset, size, data.begin());
+    m_frame_offset += size;
+    return size;
+}
+
+bool DecompressingReadableStream::is_eof() const {
+    return m_eof;
+}
+
+OsErrorOr<void> DecompressingReadableStream::seek(ssize_t count, SeekDirection direction) {
+    if (direction != SeekDirection::FromCurrent || count < 0) {
+        return OsError { ESPIPE, "DecompressingReadableStream::seek" };
+    }
+    size_t remaining = count;
+    while (remaining > 0) {
+        if (m_frame_offset == m_frame.size() && !TRY(read_frame())) {
+            return OsError { EINVAL, "DecompressingReadableStream::seek" };
+        }
+        auto skipped = std::min(remaining, m_frame.size() - m_frame_offset);
+        m_frame_offset += skipped;
+        remaining -= skipped;
+    }
+    return {};
+}
+
+OsErrorOr<bool> DecompressingReadableStream::read_frame() {
+    OsError corrupted { EILSEQ, "DecompressingReadableStream::read" };
+
+    uint8_t header[CompressionFrame::HeaderSize];
+    auto header_size = TRY(read_from_stream(header));
+    if (header_size == 0) {
+        return false;
+    }
+    if (header_size < CompressionFrame::HeaderSize) {
+        return corrupted;
+    }
+    uint32_t uncompressed_size;
+    uint32_t stored_size;
+    std::memcpy(&uncompressed_size, header, 4);
+    std::memcpy(&stored_size, header + 4, 4);
+    uncompressed_size = convert_from_little_to_host_endian(uncompressed_size);
+    stored_size = convert_from_little_to_host_endian(stored_size);
+
+    auto is_stored = (stored_size & CompressionFrame::StoredFlag) != 0;
+    stored_size &= ~CompressionFrame::StoredFlag;
+    // Frames that don't compress are stored, so compressed ones are always
+    // smaller than their uncompressed size.
+    if (uncompressed_size >= CompressionFrame::StoredFlag || (is_stored ? stored_size != uncompressed_size : stored_size >= uncompressed_size)) {
+        return corrupted;
+    }
+    if (uncompressed_size > m_max_frame_size) {
+        return OsError { EINVAL, "DecompressingReadableStream::read" };
+    }
+
+    m_frame.resize_uninitialized(uncompressed_size);
+    m_frame_offset = 0;
+    if (is_stored) {
+        if (TRY(read_from_stream(m_frame.span())) < uncompressed_size) {
+            return corrupted;
+        }
+        return true;
+    }
+    m_compressed.resize_uninitialized(stored_size);
+    if (TRY(read_from_stream(m_compressed.span())) < stored_size) {
+        return corrupted;
+    }
+    if (auto result = m_codec.decompress(m_compressed.span(), m_frame.span()); result.is_error()) {
+        // Don't return garbage if the caller ignores the error.
+        m_frame.clear();
+        return result.release_error();
+    }
+    return true;
+}
+
+OsErrorOr<size_t> DecompressingReadableStream::read_from_stream(std::span<uint8_t> data) {
+    size_t bytes_read = 0;
+    while (bytes_read < data.size()) {
+        auto bytes = TRY(m_stream.read(data.subspan(bytes_read)));
+        if (bytes == 0) {
+            break;
+        }
+        bytes_read += bytes;
+    }
+    return bytes_read;
+}
+
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../Buffer.hpp"
+#include "../Error.hpp"
+#include "../NonCopyable.hpp"
+#include "Stream.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace Util {
+
+// Compresses independent blocks of data. Implement this to use another
+// compression algorithm with the compression streams.
+class CompressionCodec {
+public:
+    virtual ~CompressionCodec() = default;
+
+    // Upper bound on compressed size of `size` bytes of input.
+    virtual size_t max_compressed_size(size_t size) const = 0;
+
+    // `output` must be at least max_compressed_size(input.size()) bytes.
+    // Returns size of the compressed data.
+    virtual size_t compress(std::span<uint8_t const> input, std::span<uint8_t> output) const = 0;
+
+    // `output` must be exactly the size of the uncompressed data. Fails
+    // with EILSEQ if the data is corrupted.
+    virtual OsErrorOr<void> decompress(std::span<uint8_t const> input, std::span<uint8_t> output) const = 0;
+};
+
+// Fast LZ77 compression, compatible with the LZ4 block format. Its ratio
+// is lower than of deflate, but it compresses at hundreds of MB/s and
+// decompresses at GB/s, so it pays off even on fast disks.
+class Lz4Codec : public CompressionCodec {
+public:
+    static Lz4Codec const& the();
+
+    virtual size_t max_compressed_size(size_t size) const override;
+    virtual size_t compress(std::span<uint8_t const> input, std::span<uint8_t> output) const override;
+    virtual OsErrorOr<void> decompress(std::span<uint8_t const> input, std::span<uint8_t> output) const override;
+};
+
+// Compressed data is stored in frames, each of them prefixed with its
+// uncompressed and compressed sizes (32-bit little endian). If a frame
+// doesn't compress, it is stored as is, which is marked by the top bit of
+// the compressed size. So only one frame needs to be in memory at once.
+namespace CompressionFrame {
+
+constexpr size_t DefaultSize = 64 * 1024;
+
+// Largest frame that readers accept by default. Sizes are checked before
+// allocating, so that corrupted headers can't cause huge allocations.
+constexpr size_t DefaultMaxSize = 16 * 1024 * 1024;
+constexpr size_t HeaderSize = 8;
+constexpr uint32_t StoredFlag = 0x80000000;
+
+}
+
+// Compresses everything written to it into frames of `frame_size`
+// uncompressed bytes, and writes them to the underlying stream. Frames
+// bigger than CompressionFrame::DefaultMaxSize must be read with a bigger
+// `max_frame_size` of DecompressingReadableStream. The last
+// frame is written by finish() or on destruction, but errors can only be
+// printed then, so call finish() explicitly to handle them. Like
+// write(2), if writing to the underlying stream fails after some data was
+// accepted, write() returns the accepted count; the error is returned by
+// the next call, which retries writing the frame where it stopped.
+class CompressingWritableStream : public WritableStream
+    , public NonCopyable {
+public:
+    explicit CompressingWritableStream(WritableStream&, CompressionCodec const& = Lz4Codec::the(), size_t frame_size = CompressionFrame::DefaultSize);
+    virtual ~CompressingWritableStream();
+
+    // Compress and write buffered data as a (possibly short) frame.
+    OsErrorOr<void> finish();
+
+    // Count of bytes written to the underlying stream.
+    size_t compressed_size() const { return m_compressed_size; }
+
+    virtual OsErrorOr<size_t> write(std::span<uint8_t const>) override;
+
+    // Fails with ESPIPE, compressed streams can't be seeked.
+    virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override;
+
+private:
+    // Compress a frame into m_compressed, to be written by write_pending().
+    void compress_frame(std::span<uint8_t const>);
+    // Write the part of the last compressed frame that wasn't written yet.
+    OsErrorOr<void> write_pending();
+
+    WritableStream& m_stream;
+    CompressionCodec const& m_codec;
+    Buffer m_frame;
+    size_t m_frame_size;
+    Buffer m_compressed;
+    size_t m_pending_offset = 0;
+    size_t m_pending_size = 0;
+    size_t m_compressed_size = 0;
+};
+
+// Reads data written by CompressingWritableStream with the same codec.
+// Fails with EILSEQ if the data is corrupted or truncated, and with EINVAL
+// if a frame is bigger than `max_frame_size`.
+class DecompressingReadableStream : public ReadableStream
+    , public NonCopyable {
+public:
+    explicit DecompressingReadableStream(ReadableStream&, CompressionCodec const& = Lz4Codec::the(), size_t max_frame_size = CompressionFrame::DefaultMaxSize);
+
+    virtual OsErrorOr<size_t> read(std::span<uint8_t>) override;
+    virtual bool is_eof() const override;
+
+    // Only skipping forward (positive count from current position) is
+    // supported, by decompressing and discarding data. Fails with ESPIPE
+    // otherwise.
+    virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override;
+
+private:
+    // Returns false on end of the compressed data.
+    OsErrorOr<bool> read_frame();
+
+    // Read until the buffer is full or the stream ends.
+    OsErrorOr<size_t> read_from_stream(std::span<uint8_t>);
+
+    ReadableStream& m_stream;
+    CompressionCodec const& m_codec;
+    size_t m_max_frame_size;
+    Buffer m_frame;
+    size_t m_frame_offset = 0;
+    Buffer m_compressed;
+    bool m_eof = false;
+};
+
+}
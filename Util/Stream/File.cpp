@@ -3,11 +3,15 @@
 #include "../Config.hpp"
 #include "../Error.hpp"
 #include "../System.hpp"
-#include "Reader.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
 #include <fcntl.h>
 #include <string>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <utility>
 
@@ -52,6 +56,22 @@ OsErrorOr<void> File::seek(ssize_t count, SeekDirection direction) {
     return {};
 }
 
+OsErrorOr<size_t> File::read_at(size_t offset, std::span<uint8_t> data) const {
+    auto result = ::pread(m_fd, data.data(), data.size_bytes(), offset);
+    if (result < 0) {
+        return OsError { errno, "File::read_at" };
+    }
+    return static_cast<size_t>(result);
+}
+
+OsErrorOr<size_t> File::write_at(size_t offset, std::span<uint8_t const> data) {
+    auto result = ::pwrite(m_fd, data.data(), data.size_bytes(), offset);
+    if (result < 0) {
+        return OsError { errno, "File::write_at" };
+    }
+    return static_cast<size_t>(result);
+}
+
 ReadableFileStream ReadableFileStream::adopt_fd(int fd) {
     return ReadableFileStream { fd, true };
 }
@@ -78,13 +98,19 @@ OsErrorOr<Buffer> ReadableFileStream::read_file(std::string const& name, std::op
         return OsError { EFBIG, "read_file" };
     }
 
-    Buffer result;
+    // Read directly into a buffer of the final size, in as few syscalls as
+    // possible.
+    auto result = Buffer::uninitialized(file_size);
     auto stream = TRY(ReadableFileStream::open(name));
-    auto chunk = Buffer::uninitialized(4096);
-    BufferedReader reader { stream };
-    while (!stream.is_eof()) {
-        auto bytes_read = TRY(reader.read(chunk.span()));
-        result.append(chunk.span().subspan(0, bytes_read));
+    size_t offset = 0;
+    while (offset < result.size()) {
+        auto bytes_read = TRY(stream.read(result.span().subspan(offset)));
+        if (bytes_read == 0) {
+            // File was truncated after stat.
+            result.resize_uninitialized(offset);
+            break;
+        }
+        offset += bytes_read;
     }
     return result;
 }
@@ -93,7 +119,7 @@ OsErrorOr<size_t> ReadableFileStream::read(std::span<uint8_t> data) {
     // TODO: Buffering
     auto result = ::read(fd(), data.data(), data.size_bytes());
     if (result < 0) {
-        return OsError { .error = static_cast<error_t>(-result), .function = "FileStream::read_all" };
+        return OsError { .error = errno, .function = "FileStream::read_all" };
     }
     if (result == 0) {
         m_eof = true;
@@ -118,10 +144,25 @@ OsErrorOr<WritableFileStream> WritableFileStream::open(std::string const& file_n
 }
 
 OsErrorOr<size_t> WritableFileStream::write(std::span<uint8_t const> data) {
-    // TODO: Buffering
+    // NOTE: This is unbuffered, wrap it in a BufferedWriter for small writes.
     auto result = ::write(fd(), data.data(), data.size_bytes());
     if (result < 0) {
-        return OsError { .error = static_cast<error_t>(-result), .function = "FileStream::write_all" };
+        return OsError { .error = errno, .function = "FileStream::write_all" };
+    }
+    return static_cast<size_t>(result);
+}
+
+OsErrorOr<size_t> WritableFileStream::write_vectored(std::span<std::span<uint8_t const> const> buffers) {
+    // Buffers that don't fit are left for the next call, like with any
+    // partial write.
+    std::array<iovec, 64> iovecs;
+    size_t count = std::min<size_t>({ buffers.size(), iovecs.size(), IOV_MAX });
+    for (size_t s = 0; s < count; s++) {
+        iovecs[s] = { .iov_base = const_cast<uint8_t*>(buffers[s].data()), .iov_len = buffers[s].size() };
+    }
+    auto result = ::writev(fd(), iovecs.data(), count);
+    if (result < 0) {
+        return OsError { .error = errno, .function = "WritableFileStream::write_vectored" };
     }
     return static_cast<size_t>(result);
 }
@@ -25,6 +25,11 @@ public:
 
     OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent);
 
+    // Read/write at an absolute offset, without using or changing the file
+    // position, so these can be used from multiple threads at once.
+    OsErrorOr<size_t> read_at(size_t offset, std::span<uint8_t>) const;
+    OsErrorOr<size_t> write_at(size_t offset, std::span<uint8_t const>);
+
 private:
     int m_fd {};
     bool m_owned { false };
@@ -45,6 +50,7 @@ public:
     virtual bool is_eof() const override;
 
     virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override {
+        m_eof = false;
         return File::seek(count, direction);
     }
 
@@ -67,6 +73,7 @@ public:
     static OsErrorOr<WritableFileStream> open(std::string const& file_name, OpenOptions options);
 
     virtual OsErrorOr<size_t> write(std::span<uint8_t const>) override;
+    virtual OsErrorOr<size_t> write_vectored(std::span<std::span<uint8_t const> const>) override;
 
     virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override {
         return File::seek(count, direction);
@@ -0,0 +1,51 @@
+#include "HashingStream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+
+namespace Util {
+
+OsErrorOr<size_t> HashingReadableStream::read(std::span<uint8_t> data) {
+    auto bytes_read = TRY(m_stream.read(data));
+    m_hasher.update(data.first(bytes_read));
+    return bytes_read;
+}
+
+OsErrorOr<void> HashingReadableStream::seek(ssize_t count, SeekDirection direction) {
+    if (direction != SeekDirection::FromCurrent || count < 0) {
+        return OsError { ESPIPE, "HashingReadableStream::seek" };
+    }
+    uint8_t buffer[4096];
+    size_t remaining = count;
+    while (remaining > 0) {
+        auto bytes_read = TRY(read({ buffer, std::min(remaining, sizeof(buffer)) }));
+        if (bytes_read == 0) {
+            return OsError { EINVAL, "HashingReadableStream::seek" };
+        }
+        remaining -= bytes_read;
+    }
+    return {};
+}
+
+OsErrorOr<size_t> HashingWritableStream::write(std::span<uint8_t const> data) {
+    auto bytes_written = TRY(m_stream.write(data));
+    m_hasher.update(data.first(bytes_written));
+    return bytes_written;
+}
+
+OsErrorOr<size_t> HashingWritableStream::write_vectored(std::span<std::span<uint8_t const> const> buffers) {
+    auto bytes_written = TRY(m_stream.write_vectored(buffers));
+    auto remaining = bytes_written;
+    for (auto buffer : buffers) {
+        auto size = std::min(remaining, buffer.size());
+        m_hasher.update(buffer.first(size));
+        remaining -= size;
+    }
+    return bytes_written;
+}
+
+OsErrorOr<void> HashingWritableStream::seek(ssize_t, SeekDirection) {
+    return OsError { ESPIPE, "HashingWritableStream::seek" };
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../Hash.hpp"
+#include "Stream.hpp"
+
+namespace Util {
+
+// Passes data through to the underlying stream, updating a hash with
+// everything that was read, e.g to verify a file while parsing it.
+class HashingReadableStream : public ReadableStream {
+public:
+    HashingReadableStream(ReadableStream& stream, Hasher& hasher)
+        : m_stream(stream)
+        , m_hasher(hasher) { }
+
+    Hasher& hasher() const { return m_hasher; }
+
+    virtual OsErrorOr<size_t> read(std::span<uint8_t>) override;
+    virtual bool is_eof() const override { return m_stream.is_eof(); }
+
+    // Only skipping forward (positive count from current position) is
+    // supported, and skipped data is read and hashed too. Fails with ESPIPE
+    // otherwise.
+    virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override;
+
+private:
+    ReadableStream& m_stream;
+    Hasher& m_hasher;
+};
+
+// Passes data through to the underlying stream, updating a hash with
+// everything that was written.
+class HashingWritableStream : public WritableStream {
+public:
+    HashingWritableStream(WritableStream& stream, Hasher& hasher)
+        : m_stream(stream)
+        , m_hasher(hasher) { }
+
+    Hasher& hasher() const { return m_hasher; }
+
+    virtual OsErrorOr<size_t> write(std::span<uint8_t const>) override;
+    virtual OsErrorOr<size_t> write_vectored(std::span<std::span<uint8_t const> const>) override;
+
+    // Fails with ESPIPE, overwriting data would make the hash wrong.
+    virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override;
+
+private:
+    WritableStream& m_stream;
+    Hasher& m_hasher;
+};
+
+}
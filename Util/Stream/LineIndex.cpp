@@ -0,0 +1,321 @@
+#include "LineIndex.hpp"
+
+#include "../CpuFeatures.hpp"
+#include "Reader.hpp"
+#include "Writer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#ifdef ESSA_ARCH_X86
+#    include <immintrin.h>
+#endif
+
+namespace Util {
+
+// Newlines are found 64 bytes at a time, as a bitmask with a bit for every
+// byte, so that they can be counted with popcount and the rare interesting
+// ones (e.g every 1024th) located with countr_zero.
+constexpr size_t BlockSize = 64;
+
+// Compute masks for `block_count` whole blocks.
+using NewlineMasksFunction = void (*)(uint8_t const* data, size_t block_count, uint64_t* masks);
+
+static uint64_t newline_mask_scalar(uint8_t const* data, size_t size) {
+    uint64_t mask = 0;
+    for (size_t s = 0; s < size; s++) {
+        mask |= static_cast<uint64_t>(data[s] == '\n') << s;
+    }
+    return mask;
+}
+
+static void newline_masks_scalar(uint8_t const* data, size_t block_count, uint64_t* masks) {
+    for (size_t b = 0; b < block_count; b++) {
+        masks[b] = newline_mask_scalar(data + b * BlockSize, BlockSize);
+    }
+}
+
+#ifdef ESSA_ARCH_X86
+
+[[gnu::target("sse2")]] static void newline_masks_sse2(uint8_t const* data, size_t block_count, uint64_t* masks) {
+    auto const newline = _mm_set1_epi8('\n');
+    for (size_t b = 0; b < block_count; b++, data += BlockSize) {
+        uint64_t mask = 0;
+        for (size_t s = 0; s < BlockSize / 16; s++) {
+            auto bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + s * 16));
+            mask |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))) << (s * 16);
+        }
+        masks[b] = mask;
+    }
+}
+
+[[gnu::target("avx2")]] static void newline_masks_avx2(uint8_t const* data, size_t block_count, uint64_t* masks) {
+    auto const newline = _mm256_set1_epi8('\n');
+    for (size_t b = 0; b < block_count; b++, data += BlockSize) {
+        auto low = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data));
+        auto high = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + 32));
+        auto low_mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)));
+        auto high_mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)));
+        masks[b] = low_mask | (static_cast<uint64_t>(high_mask) << 32);
+    }
+}
+
+#endif
+
+static NewlineMasksFunction newline_masks() {
+    static NewlineMasksFunction const function = [] {
+#ifdef ESSA_ARCH_X86
+        if (cpu_supports(CpuFeature::AVX2)) {
+            return newline_masks_avx2;
+        }
+        if (cpu_supports(CpuFeature::SSE2)) {
+            return newline_masks_sse2;
+        }
+#endif
+        return newline_masks_scalar;
+    }();
+    return function;
+}
+
+// Call `callback(mask, offset)` for every block of `data`. The last one may
+// be partial.
+template<class Callback>
+static void for_each_newline_mask(std::span<uint8_t const> data, Callback&& callback) {
+    // Masks are computed for a few KiB at once, so that the function
+    // pointer isn't called for every block.
+    constexpr size_t ChunkBlocks = 64;
+    uint64_t masks[ChunkBlocks];
+    auto function = newline_masks();
+    size_t offset = 0;
+    while (data.size() - offset >= BlockSize) {
+        auto block_count = std::min((data.size() - offset) / BlockSize, ChunkBlocks);
+        function(data.data() + offset, block_count, masks);
+        for (size_t b = 0; b < block_count; b++) {
+            if (!callback(masks[b], offset)) {
+                return;
+            }
+            offset += BlockSize;
+        }
+    }
+    if (offset < data.size()) {
+        callback(newline_mask_scalar(data.data() + offset, data.size() - offset), offset);
+    }
+}
+
+LineIndex::Builder::Builder(size_t stride)
+    : m_stride(stride)
+    , m_next_indexed_newline(stride) {
+    assert(stride > 0);
+    m_offsets.push_back(0);
+}
+
+void LineIndex::Builder::process_newlines(uint64_t mask, uint64_t offset) {
+    auto count = static_cast<uint64_t>(std::popcount(mask));
+    if (m_newline_count + count < m_next_indexed_newline) {
+        m_newline_count += count;
+        return;
+    }
+    while (mask != 0) {
+        m_newline_count++;
+        if (m_newline_count == m_next_indexed_newline) {
+            m_offsets.push_back(offset + std::countr_zero(mask) + 1);
+            m_next_indexed_newline += m_stride;
+        }
+        mask &= mask - 1;
+    }
+}
+
+void LineIndex::Builder::append(std::span<uint8_t const> data) {
+    if (data.empty()) {
+        return;
+    }
+    for_each_newline_mask(data, [&](uint64_t mask, size_t offset) {
+        process_newlines(mask, m_data_size + offset);
+        return true;
+    });
+    m_data_size += data.size();
+    m_ends_with_newline = data.back() == '\n';
+}
+
+LineIndex LineIndex::Builder::finish() {
+    LineIndex index;
+    index.m_stride = m_stride;
+    index.m_data_size = m_data_size;
+    index.m_line_count = m_newline_count + (m_data_size > 0 && !m_ends_with_newline);
+    index.m_offsets = std::move(m_offsets);
+    if (index.m_offsets.size() > 1 && index.m_offsets.back() == m_data_size) {
+        // Newline at the end, which doesn't start a line.
+        index.m_offsets.pop_back();
+    }
+    return index;
+}
+
+LineIndex LineIndex::build(std::span<uint8_t const> data, size_t stride) {
+    Builder builder { stride };
+    builder.append(data);
+    return builder.finish();
+}
+
+OsErrorOr<LineIndex> LineIndex::build(ReadableStream& stream, size_t stride) {
+    Builder builder { stride };
+    if (auto memory = stream.peek_span()) {
+        builder.append(*memory);
+        TRY(stream.seek(memory->size()));
+        return builder.finish();
+    }
+    auto buffer = Buffer::uninitialized(64 * 1024);
+    while (true) {
+        auto read = TRY(stream.read(buffer.span()));
+        if (read == 0) {
+            break;
+        }
+        builder.append(buffer.span().first(read));
+    }
+    return builder.finish();
+}
+
+// "ESLI" in little endian
+constexpr uint32_t LineIndexMagic = 0x494c5345;
+constexpr uint8_t LineIndexVersion = 1;
+
+OsErrorOr<void> LineIndex::save(WritableStream& stream) const {
+    BufferedWriter buffered { stream };
+    Writer writer { buffered };
+    TRY(writer.write_little_endian(LineIndexMagic));
+    TRY(writer.write_little_endian(LineIndexVersion));
+    TRY(writer.write_varint(m_stride));
+    TRY(writer.write_varint(m_line_count));
+    TRY(writer.write_varint(m_data_size));
+    TRY(writer.write_varint(m_offsets.size()));
+
+    // Offsets are increasing, and lines are usually short, so deltas
+    // take only 2-3 bytes each.
+    uint64_t previous = 0;
+    for (auto offset : m_offsets) {
+        TRY(writer.write_varint(offset - previous));
+        previous = offset;
+    }
+    return buffered.flush();
+}
+
+OsErrorOr<LineIndex> LineIndex::load(ReadableStream& stream) {
+    BinaryReader reader { stream };
+    auto magic = reader.read_little_endian<uint32_t>();
+    if (magic.is_error() || magic.release_value() != LineIndexMagic) {
+        return OsError { EINVAL, "LineIndex::load" };
+    }
+    if (TRY(reader.read_little_endian<uint8_t>()) != LineIndexVersion) {
+        return OsError { EINVAL, "LineIndex::load" };
+    }
+
+    LineIndex index;
+    index.m_stride = TRY(reader.read_varint());
+    index.m_line_count = TRY(reader.read_varint());
+    index.m_data_size = TRY(reader.read_varint());
+    auto offset_count = TRY(reader.read_varint());
+    // There can't be more lines than bytes.
+    if (index.m_stride == 0 || index.m_line_count > index.m_data_size
+        || offset_count != std::max<uint64_t>(1, (index.m_line_count + index.m_stride - 1) / index.m_stride)) {
+        return OsError { EINVAL, "LineIndex::load" };
+    }
+
+    // The header isn't trusted, so offsets are read in chunks. Then a
+    // corrupted count fails at the end of data instead of allocating for
+    // all of them up front.
+    constexpr size_t ChunkSize = 64 * 1024;
+    while (index.m_offsets.size() < offset_count) {
+        auto start = index.m_offsets.size();
+        index.m_offsets.resize(start + std::min<uint64_t>(ChunkSize, offset_count - start));
+        TRY(reader.read_varint_array(std::span { index.m_offsets }.subspan(start)));
+    }
+    // Every offset is checked, a delta that wraps around would otherwise
+    // give offsets out of the data before the last one.
+    if (index.m_offsets[0] != 0) {
+        return OsError { EINVAL, "LineIndex::load" };
+    }
+    uint64_t offset = 0;
+    for (auto& delta : index.m_offsets) {
+        if (offset + delta < offset || offset + delta > index.m_data_size) {
+            return OsError { EINVAL, "LineIndex::load" };
+        }
+        offset += delta;
+        delta = offset;
+    }
+    return index;
+}
+
+uint64_t LineIndex::line_offset(std::span<uint8_t const> data, size_t index) const {
+    assert(data.size() == m_data_size);
+    assert(index <= m_line_count);
+    if (index == m_line_count) {
+        return m_data_size;
+    }
+
+    // Skip lines after the nearest indexed one.
+    auto start = m_offsets[index / m_stride];
+    auto to_skip = index % m_stride;
+    if (to_skip == 0) {
+        return start;
+    }
+    uint64_t result = m_data_size;
+    for_each_newline_mask(data.subspan(start), [&](uint64_t mask, size_t offset) {
+        auto count = static_cast<size_t>(std::popcount(mask));
+        if (count < to_skip) {
+            to_skip -= count;
+            return true;
+        }
+        for (size_t s = 1; s < to_skip; s++) {
+            mask &= mask - 1;
+        }
+        result = start + offset + std::countr_zero(mask) + 1;
+        return false;
+    });
+    return result;
+}
+
+std::span<uint8_t const> LineIndex::lines(std::span<uint8_t const> data, size_t first, size_t last) const {
+    last = std::min(last, m_line_count);
+    if (first >= last) {
+        return {};
+    }
+    auto begin = line_offset(data, first);
+
+    // Finding the end from the beginning is faster than going from the
+    // nearest indexed line if there are only a few lines between.
+    uint64_t end;
+    if (last - first == 1) {
+        auto newline = static_cast<uint8_t const*>(std::memchr(data.data() + begin, '\n', m_data_size - begin));
+        end = newline ? newline - data.data() : m_data_size;
+    }
+    else {
+        end = line_offset(data, last);
+        if (end > begin && data[end - 1] == '\n') {
+            end--;
+        }
+    }
+    return data.subspan(begin, end - begin);
+}
+
+std::span<uint8_t const> LineIndex::line(std::span<uint8_t const> data, size_t index) const {
+    assert(index < m_line_count);
+    return lines(data, index, index + 1);
+}
+
+std::vector<UString> LineIndex::line_strings(std::span<uint8_t const> data, size_t first, size_t last) const {
+    auto range = lines(data, first, last);
+    std::vector<UString> result;
+    size_t offset = 0;
+    for (size_t s = first; s < std::min(last, m_line_count); s++) {
+        auto rest = range.subspan(offset);
+        auto newline = static_cast<uint8_t const*>(std::memchr(rest.data(), '\n', rest.size()));
+        auto length = newline ? static_cast<size_t>(newline - rest.data()) : rest.size();
+        result.push_back(UString { rest.first(length) });
+        offset += length + 1;
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../Error.hpp"
+#include "../UString.hpp"
+#include "Stream.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Util {
+
+// Offsets of every `stride`-th line of a text, for jumping to any line
+// without reading everything before it. It is built by scanning the text
+// once, and takes 8 bytes per `stride` lines, so it can be kept in memory
+// (or saved next to the file) even for huge files.
+//
+// Lines are separated by '\n', like in TextReader::consume_line(). A '\n'
+// at the end doesn't start a new line. Accessing lines needs the data that
+// the index was built for, e.g mapped with MappedFile.
+class LineIndex {
+public:
+    static constexpr size_t DefaultStride = 1024;
+
+    // Builds an index from data given in parts, e.g while reading a file.
+    class Builder {
+    public:
+        explicit Builder(size_t stride = DefaultStride);
+
+        void append(std::span<uint8_t const>);
+        LineIndex finish();
+
+    private:
+        void process_newlines(uint64_t mask, uint64_t offset);
+
+        size_t m_stride;
+        std::vector<uint64_t> m_offsets;
+        uint64_t m_newline_count = 0;
+        uint64_t m_next_indexed_newline;
+        uint64_t m_data_size = 0;
+        bool m_ends_with_newline = false;
+    };
+
+    static LineIndex build(std::span<uint8_t const> data, size_t stride = DefaultStride);
+    static OsErrorOr<LineIndex> build(ReadableStream&, size_t stride = DefaultStride);
+
+    // Fails with EINVAL if the data isn't a saved index.
+    static OsErrorOr<LineIndex> load(ReadableStream&);
+    OsErrorOr<void> save(WritableStream&) const;
+
+    size_t line_count() const { return m_line_count; }
+    size_t stride() const { return m_stride; }
+
+    // Size of the data the index was built for. Compare it to the size of
+    // the file to detect that a saved index is out of date.
+    uint64_t data_size() const { return m_data_size; }
+
+    // Line `index` without the '\n'. `data` must be what the index was
+    // built for.
+    std::span<uint8_t const> line(std::span<uint8_t const> data, size_t index) const;
+
+    // Lines [first, last), with '\n' between them but not after the last
+    // one. Empty if first >= last.
+    std::span<uint8_t const> lines(std::span<uint8_t const> data, size_t first, size_t last) const;
+
+    UString line_string(std::span<uint8_t const> data, size_t index) const { return UString { line(data, index) }; }
+    std::vector<UString> line_strings(std::span<uint8_t const> data, size_t first, size_t last) const;
+
+    // Offset of the beginning of line `index` (line_count() for the end of
+    // data).
+    uint64_t line_offset(std::span<uint8_t const> data, size_t index) const;
+
+private:
+    LineIndex() = default;
+
+    size_t m_stride = DefaultStride;
+    size_t m_line_count = 0;
+    uint64_t m_data_size = 0;
+
+    // Offset of line `i * m_stride`.
+    std::vector<uint64_t> m_offsets;
+};
+
+}
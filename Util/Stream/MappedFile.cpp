@@ -0,0 +1,129 @@
+#include "MappedFile.hpp"
+
+#include "../Config.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace Util {
+
+OsErrorOr<MappedFile> MappedFile::map(std::string const& file_name) {
+    auto fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return OsError { errno, "MappedFile::map" };
+    }
+    auto file = map_fd(fd);
+    ::close(fd);
+    return file;
+}
+
+OsErrorOr<MappedFile> MappedFile::map_fd(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return OsError { errno, "MappedFile::map_fd" };
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return OsError { ENODEV, "MappedFile::map_fd" };
+    }
+    // Empty mappings are not allowed.
+    if (st.st_size == 0) {
+        return MappedFile { nullptr, 0 };
+    }
+    auto data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return OsError { errno, "MappedFile::map_fd" };
+    }
+    return MappedFile { static_cast<uint8_t const*>(data), static_cast<size_t>(st.st_size) };
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+    : m_data(std::exchange(other.m_data, nullptr))
+    , m_size(std::exchange(other.m_size, 0)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+    if (this == &other) {
+        return *this;
+    }
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    return *this;
+}
+
+static int access_pattern_to_c(MappedFile::AccessPattern pattern) {
+    switch (pattern) {
+    case MappedFile::AccessPattern::Normal:
+        return MADV_NORMAL;
+    case MappedFile::AccessPattern::Sequential:
+        return MADV_SEQUENTIAL;
+    case MappedFile::AccessPattern::Random:
+        return MADV_RANDOM;
+    case MappedFile::AccessPattern::WillNeed:
+        return MADV_WILLNEED;
+    }
+    ESSA_UNREACHABLE;
+}
+
+OsErrorOr<void> MappedFile::advise(AccessPattern pattern) {
+    if (!m_data) {
+        return {};
+    }
+    if (madvise(const_cast<uint8_t*>(m_data), m_size, access_pattern_to_c(pattern)) < 0) {
+        return OsError { errno, "MappedFile::advise" };
+    }
+    return {};
+}
+
+OsErrorOr<ReadableMappedStream> ReadableMappedStream::open(std::string const& file_name) {
+    auto file = TRY(MappedFile::map(file_name));
+    TRY(file.advise(MappedFile::AccessPattern::Sequential));
+    TRY(file.advise(MappedFile::AccessPattern::WillNeed));
+    return ReadableMappedStream { std::move(file) };
+}
+
+OsErrorOr<size_t> ReadableMappedStream::read(std::span<uint8_t> data) {
+    auto remaining = remaining_data();
+    auto bytes_to_read = std::min(remaining.size(), data.size());
+    std::copy(remaining.begin(), remaining.begin() + bytes_to_read, data.begin());
+    m_offset += bytes_to_read;
+    return bytes_to_read;
+}
+
+bool ReadableMappedStream::is_eof() const {
+    return m_offset >= m_file.size();
+}
+
+OsErrorOr<void> ReadableMappedStream::seek(ssize_t count, SeekDirection direction) {
+    auto new_offset = [&]() -> ssize_t {
+        switch (direction) {
+        case SeekDirection::FromCurrent:
+            return (ssize_t)m_offset + count;
+        case SeekDirection::FromStart:
+            return count;
+        case SeekDirection::FromEnd:
+            return (ssize_t)m_file.size() + count;
+        }
+        ESSA_UNREACHABLE;
+    }();
+    if (new_offset < 0 || new_offset > (ssize_t)m_file.size()) {
+        return OsError { EINVAL, "ReadableMappedStream::seek" };
+    }
+    m_offset = new_offset;
+    return {};
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../Error.hpp"
+#include "../NonCopyable.hpp"
+#include "Stream.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace Util {
+
+// Read-only memory mapping of a whole file. This allows accessing big files
+// without copying them into memory.
+class MappedFile : public NonCopyable {
+public:
+    static OsErrorOr<MappedFile> map(std::string const& file_name);
+
+    // The fd can be closed after mapping.
+    static OsErrorOr<MappedFile> map_fd(int fd);
+
+    ~MappedFile();
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+
+    std::span<uint8_t const> data() const { return { m_data, m_size }; }
+    size_t size() const { return m_size; }
+
+    enum class AccessPattern {
+        Normal,
+        Sequential,
+        Random,
+        WillNeed,
+    };
+
+    // Hint the kernel how the mapping will be accessed (madvise).
+    OsErrorOr<void> advise(AccessPattern);
+
+private:
+    MappedFile(uint8_t const* data, size_t size)
+        : m_data(data)
+        , m_size(size) { }
+
+    uint8_t const* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+class ReadableMappedStream : public ReadableStream {
+public:
+    // Maps the file and advises the kernel that it will be read
+    // sequentially.
+    static OsErrorOr<ReadableMappedStream> open(std::string const& file_name);
+
+    explicit ReadableMappedStream(MappedFile file)
+        : m_file(std::move(file)) { }
+
+    MappedFile const& file() const { return m_file; }
+
+    // Data that wasn't read yet. This can be used instead of read() to
+    // avoid copying.
+    std::span<uint8_t const> remaining_data() const { return m_file.data().subspan(m_offset); }
+
+    virtual OsErrorOr<size_t> read(std::span<uint8_t>) override;
+    virtual bool is_eof() const override;
+    virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override;
+    virtual std::optional<std::span<uint8_t const>> peek_span() const override { return remaining_data(); }
+
+private:
+    MappedFile m_file;
+    size_t m_offset = 0;
+};
+
+}
@@ -1,11 +1,57 @@
 #include "MemoryStream.hpp"
 
+#include <algorithm>
 #include <cerrno>
+#include <utility>
 
 namespace Util {
 
 ReadableMemoryStream::ReadableMemoryStream(std::span<uint8_t const> data)
-    : m_data { data } {
+    : ReadableMemoryStream(data, true) {
+}
+
+ReadableMemoryStream::ReadableMemoryStream(std::span<uint8_t const> data, bool owned) {
+    if (owned) {
+        m_owned_data = Buffer { data };
+        m_data = m_owned_data.span();
+    }
+    else {
+        m_data = data;
+    }
+}
+
+ReadableMemoryStream::ReadableMemoryStream(ReadableMemoryStream const& other)
+    : m_owned_data(other.m_owned_data)
+    , m_data(other.owns_data() ? m_owned_data.span() : other.m_data)
+    , m_offset(other.m_offset) {
+}
+
+ReadableMemoryStream& ReadableMemoryStream::operator=(ReadableMemoryStream const& other) {
+    if (this == &other) {
+        return *this;
+    }
+    m_owned_data = other.m_owned_data;
+    m_data = other.owns_data() ? m_owned_data.span() : other.m_data;
+    m_offset = other.m_offset;
+    return *this;
+}
+
+ReadableMemoryStream::ReadableMemoryStream(ReadableMemoryStream&& other)
+    : m_owned_data(std::move(other.m_owned_data))
+    , m_data(owns_data() ? m_owned_data.span() : other.m_data)
+    , m_offset(std::exchange(other.m_offset, 0)) {
+    other.m_data = {};
+}
+
+ReadableMemoryStream& ReadableMemoryStream::operator=(ReadableMemoryStream&& other) {
+    if (this == &other) {
+        return *this;
+    }
+    m_owned_data = std::move(other.m_owned_data);
+    m_data = owns_data() ? m_owned_data.span() : other.m_data;
+    m_offset = std::exchange(other.m_offset, 0);
+    other.m_data = {};
+    return *this;
 }
 
 OsErrorOr<size_t> ReadableMemoryStream::read(std::span<uint8_t> data) {
@@ -40,13 +86,41 @@ OsErrorOr<void> ReadableMemoryStream::seek(ssize_t count, SeekDirection directio
     return {};
 }
 
+Buffer WritableMemoryStream::release_buffer() {
+    m_offset = 0;
+    return std::move(m_data);
+}
+
 OsErrorOr<size_t> WritableMemoryStream::write(std::span<uint8_t const> data) {
-    m_data.append(data);
+    if (m_offset > m_data.size()) {
+        auto old_size = m_data.size();
+        m_data.resize_uninitialized(m_offset);
+        std::fill(m_data.begin() + old_size, m_data.end(), 0);
+    }
+    auto overwritten = std::min(data.size(), m_data.size() - m_offset);
+    std::copy_n(data.begin(), overwritten, m_data.begin() + m_offset);
+    m_data.append(data.subspan(overwritten));
+    m_offset += data.size();
     return data.size();
 }
 
-OsErrorOr<void> WritableMemoryStream::seek(ssize_t, SeekDirection) {
-    return OsError { ENOTSUP, "WritableMemoryStream::seek: TODO" };
+OsErrorOr<void> WritableMemoryStream::seek(ssize_t count, SeekDirection direction) {
+    auto new_offset = [&]() -> ssize_t {
+        switch (direction) {
+        case SeekDirection::FromCurrent:
+            return (ssize_t)m_offset + count;
+        case SeekDirection::FromStart:
+            return count;
+        case SeekDirection::FromEnd:
+            return (ssize_t)m_data.size() + count;
+        }
+        ESSA_UNREACHABLE;
+    }();
+    if (new_offset < 0) {
+        return OsError { EINVAL, "WritableMemoryStream::seek" };
+    }
+    m_offset = new_offset;
+    return {};
 }
 
 }
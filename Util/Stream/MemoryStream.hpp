@@ -3,14 +3,26 @@
 #include "../Buffer.hpp"
 #include "Stream.hpp"
 
+#include <string>
+#include <string_view>
 #include <vector>
 
 namespace Util {
 
 class ReadableMemoryStream : public ReadableStream {
 public:
+    // Copies the data.
     explicit ReadableMemoryStream(std::span<uint8_t const> data);
 
+    // Uses the data without copying, it must outlive the stream.
+    static ReadableMemoryStream borrow(std::span<uint8_t const> data) {
+        return ReadableMemoryStream { data, false };
+    }
+
+    static ReadableMemoryStream borrow_string(std::string_view str) {
+        return borrow({ reinterpret_cast<uint8_t const*>(str.data()), str.size() });
+    }
+
     template<size_t S>
     static ReadableMemoryStream from_string(char const (&data)[S]) {
         return ReadableMemoryStream { { reinterpret_cast<uint8_t const*>(data), S - 1 } };
@@ -24,24 +36,53 @@ public:
         return ReadableMemoryStream { { reinterpret_cast<uint8_t const*>(str.c_str()), str.size() } };
     }
 
+    // Copies of an owning stream own a copy of the data, copies of a
+    // borrowing one borrow the same data. The offset is kept.
+    ReadableMemoryStream(ReadableMemoryStream const&);
+    ReadableMemoryStream& operator=(ReadableMemoryStream const&);
+    ReadableMemoryStream(ReadableMemoryStream&&);
+    ReadableMemoryStream& operator=(ReadableMemoryStream&&);
+
     virtual OsErrorOr<size_t> read(std::span<uint8_t>) override;
     virtual bool is_eof() const override;
     virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override;
+    virtual std::optional<std::span<uint8_t const>> peek_span() const override { return m_data.subspan(m_offset); }
 
 private:
-    Buffer m_data;
+    ReadableMemoryStream(std::span<uint8_t const> data, bool owned);
+
+    bool owns_data() const { return m_owned_data.size() > 0; }
+
+    // Empty if the data is borrowed. Otherwise m_data points into it, so
+    // it has to be updated whenever the buffer is copied or moved (moving
+    // between different memory resources copies).
+    Buffer m_owned_data;
+    std::span<uint8_t const> m_data;
     size_t m_offset = 0;
 };
 
 class WritableMemoryStream : public WritableStream {
 public:
     std::span<uint8_t const> data() const { return m_data.span(); }
+    size_t offset() const { return m_offset; }
+
+    // Allocate space for `size` bytes in total, so that writing them
+    // doesn't reallocate.
+    void reserve(size_t size) { m_data.ensure_capacity(size); }
 
+    // Take the written data without copying, leaving the stream empty.
+    Buffer release_buffer();
+
+    // Writing before the end overwrites existing data, like for files.
     virtual OsErrorOr<size_t> write(std::span<uint8_t const>) override;
+
+    // Seeking past the end is allowed, the gap is filled with zeros on next
+    // write.
     virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override;
 
 private:
     Buffer m_data;
+    size_t m_offset = 0;
 };
 
 }
@@ -0,0 +1,192 @@
+#include "ParallelDecoder.hpp"
+
+#include "../Buffer.hpp"
+#include "../Utf8.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+namespace Util {
+
+// Call `function(index, thread_index)` for every index in [0, count) on up
+// to `thread_count` threads, including the calling one. Indices are taken
+// one by one, so that threads that get faster ones (e.g cached by the
+// kernel) do more of them. Stops at the first error.
+template<class Function>
+static OsErrorOr<void> parallel_for(size_t count, size_t thread_count, Function&& function) {
+    std::atomic<size_t> next_index = 0;
+    std::mutex error_mutex;
+    std::optional<OsError> error;
+    auto worker = [&](size_t thread_index) {
+        while (true) {
+            auto index = next_index.fetch_add(1, std::memory_order_relaxed);
+            if (index >= count) {
+                return;
+            }
+            auto result = function(index, thread_index);
+            if (result.is_error()) {
+                std::lock_guard lock { error_mutex };
+                if (!error) {
+                    error = result.error();
+                }
+                next_index = count;
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t s = 1; s < std::min(thread_count, count); s++) {
+        threads.emplace_back(worker, s);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        return *error;
+    }
+    return {};
+}
+
+static bool is_continuation_byte(uint8_t byte) {
+    return (byte & 0b1100'0000) == 0b1000'0000;
+}
+
+// In valid UTF-8, every byte except continuation bytes starts a codepoint.
+static size_t count_codepoints(std::span<uint8_t const> data) {
+    size_t count = 0;
+    for (auto byte : data) {
+        count += !is_continuation_byte(byte);
+    }
+    return count;
+}
+
+// Move a chunk boundary past continuation bytes, so that it doesn't split
+// a sequence. A sequence that started before `offset` can't reach further
+// than MaxPendingBytes after it, so chunks are decoded exactly as if the
+// data was decoded at once.
+static size_t chunk_start(std::span<uint8_t const> data, size_t offset) {
+    auto end = std::min(data.size(), offset + Utf8::StreamingDecoder::MaxPendingBytes);
+    while (offset < end && is_continuation_byte(data[offset])) {
+        offset++;
+    }
+    return offset;
+}
+
+OsErrorOr<ParallelDecodeResult> decode_file_parallel(File const& file, ParallelDecodeOptions options) {
+    using Clock = std::chrono::steady_clock;
+    auto start_time = Clock::now();
+
+    struct stat st;
+    if (fstat(file.fd(), &st) < 0) {
+        return OsError { errno, "decode_file_parallel" };
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        return ParallelDecodeResult {};
+    }
+
+    auto thread_count = options.thread_count > 0 ? options.thread_count : std::max(1u, std::thread::hardware_concurrency());
+    auto chunk_size = std::max<size_t>(options.chunk_size, Utf8::StreamingDecoder::MaxPendingBytes);
+    auto chunk_count = (size + chunk_size - 1) / chunk_size;
+
+    ParallelDecodeResult result;
+    auto data = Buffer::uninitialized(size);
+    std::vector<size_t> starts(chunk_count + 1);
+    std::vector<size_t> codepoint_counts(chunk_count);
+    TRY(parallel_for(chunk_count, thread_count, [&](size_t index, size_t) -> OsErrorOr<void> {
+        auto offset = index * chunk_size;
+        auto chunk = data.span().subspan(offset, std::min(chunk_size, size - offset));
+        size_t bytes_read = 0;
+        while (bytes_read < chunk.size()) {
+            auto bytes = TRY(file.read_at(offset + bytes_read, chunk.subspan(bytes_read)));
+            if (bytes == 0) {
+                // File was truncated while reading.
+                return OsError { EIO, "decode_file_parallel" };
+            }
+            bytes_read += bytes;
+        }
+
+        // Continuation bytes that are moved to the previous chunk aren't
+        // counted anyway, so counting the whole chunk gives the same result.
+        codepoint_counts[index] = count_codepoints(chunk);
+        starts[index] = index == 0 ? 0 : chunk_start(data.span(), offset);
+        return {};
+    }));
+    starts[chunk_count] = size;
+    auto read_time = Clock::now();
+    result.timings.read = read_time - start_time;
+
+    std::vector<size_t> offsets(chunk_count + 1);
+    for (size_t s = 0; s < chunk_count; s++) {
+        offsets[s + 1] = offsets[s] + codepoint_counts[s];
+    }
+    auto total_codepoints = offsets[chunk_count];
+    std::unique_ptr<uint32_t[]> codepoints { new uint32_t[total_codepoints] };
+
+    std::atomic<bool> counts_match = true;
+    std::atomic<bool> valid = true;
+    std::vector<std::vector<uint32_t>> scratch_buffers(thread_count);
+    MUST(parallel_for(chunk_count, thread_count, [&](size_t index, size_t thread_index) -> OsErrorOr<void> {
+        auto input = data.span().subspan(starts[index], starts[index + 1] - starts[index]);
+        std::string_view input_string { reinterpret_cast<char const*>(input.data()), input.size() };
+        std::span<uint32_t> output { codepoints.get() + offsets[index], codepoint_counts[index] };
+        Utf8::DecodeResult decoded;
+        if (output.size() == input.size()) {
+            // No multibyte sequences, so the decoder has enough space and
+            // writes exactly one codepoint for every byte.
+            decoded = Utf8::decode(output, input_string, options.replacement);
+        }
+        else {
+            // The decoder needs space for a codepoint per byte, so decode
+            // into a buffer of the thread first.
+            auto& scratch = scratch_buffers[thread_index];
+            scratch.resize(std::max(scratch.size(), input.size()));
+            decoded = Utf8::decode(scratch, input_string, options.replacement);
+            if (decoded.codepoints == output.size()) {
+                std::copy_n(scratch.begin(), decoded.codepoints, output.begin());
+            }
+        }
+        if (decoded.codepoints != output.size()) {
+            counts_match = false;
+        }
+        if (!decoded.valid) {
+            valid = false;
+        }
+        return {};
+    }));
+
+    if (counts_match) {
+        result.string = UString::take_ownership({ codepoints.release(), total_codepoints });
+        result.valid = valid;
+    }
+    else {
+        // Stray continuation bytes (each replaced with a codepoint) make
+        // the counts wrong. This happens only for malformed data, so just
+        // decode everything again.
+        codepoints.reset();
+        std::unique_ptr<uint32_t[]> buffer { new uint32_t[size] };
+        auto decoded = Utf8::decode({ buffer.get(), size }, { reinterpret_cast<char const*>(data.begin()), size }, options.replacement);
+        result.string = UString { std::span<uint32_t const> { buffer.get(), decoded.codepoints } };
+        result.valid = decoded.valid;
+    }
+    auto end_time = Clock::now();
+    result.timings.decode = end_time - read_time;
+    result.timings.total = end_time - start_time;
+    return result;
+}
+
+OsErrorOr<ParallelDecodeResult> decode_file_parallel(std::string const& file_name, ParallelDecodeOptions options) {
+    auto file = TRY(ReadableFileStream::open(file_name));
+    return decode_file_parallel(file, options);
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../Error.hpp"
+#include "../UString.hpp"
+#include "File.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Util {
+
+struct ParallelDecodeOptions {
+    // 0 means std::thread::hardware_concurrency().
+    size_t thread_count = 0;
+
+    // Files are split into chunks of this size, which are read and decoded
+    // independently.
+    size_t chunk_size = 256 * 1024;
+
+    uint32_t replacement = 0xfffd;
+};
+
+// Wall time of every stage. Stages are done one after another, by all
+// threads at once.
+struct ParallelDecodeTimings {
+    // Reading chunks (with pread) and counting codepoints in them.
+    std::chrono::nanoseconds read {};
+
+    // Decoding chunks into their places in the result.
+    std::chrono::nanoseconds decode {};
+
+    std::chrono::nanoseconds total {};
+};
+
+struct ParallelDecodeResult {
+    UString string;
+
+    // False if the file wasn't valid UTF-8 (see Utf8::DecodeResult).
+    bool valid = true;
+
+    ParallelDecodeTimings timings;
+};
+
+// Read a whole UTF-8 file and decode it using multiple threads. The result
+// is the same as of decoding ReadableFileStream::read_file() at once.
+//
+// Sizes of chunks in codepoints are counted while reading, so that the
+// result is allocated once and chunks are decoded in parallel into their
+// places in it. Counting this way is exact only for valid UTF-8, so if a
+// file turns out to be malformed, it is decoded again on a single thread.
+OsErrorOr<ParallelDecodeResult> decode_file_parallel(File const&, ParallelDecodeOptions = {});
+OsErrorOr<ParallelDecodeResult> decode_file_parallel(std::string const& file_name, ParallelDecodeOptions = {});
+
+}
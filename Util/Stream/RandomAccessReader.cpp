@@ -0,0 +1,95 @@
+#include "RandomAccessReader.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Util {
+
+RandomAccessReader::RandomAccessReader(File const& file, size_t block_size, size_t max_cached_blocks)
+    : m_file(file)
+    , m_block_size(block_size)
+    , m_max_cached_blocks(max_cached_blocks) {
+    assert(block_size > 0);
+    assert(max_cached_blocks > 0);
+}
+
+OsErrorOr<size_t> RandomAccessReader::read_at(size_t offset, std::span<uint8_t> data) {
+    size_t bytes_read = 0;
+    while (bytes_read < data.size()) {
+        auto position = offset + bytes_read;
+        auto offset_in_block = position % m_block_size;
+        auto copied = TRY(read_from_block(position / m_block_size, offset_in_block, data.subspan(bytes_read)));
+        bytes_read += copied;
+
+        // Only the last block is shorter than block size.
+        if (offset_in_block + copied < m_block_size) {
+            break;
+        }
+    }
+    return bytes_read;
+}
+
+RandomAccessReader::Statistics RandomAccessReader::statistics() const {
+    std::lock_guard lock { m_mutex };
+    return m_statistics;
+}
+
+static size_t copy_from_block(Buffer const& block, size_t offset_in_block, std::span<uint8_t> data) {
+    if (offset_in_block >= block.size()) {
+        return 0;
+    }
+    auto count = std::min(data.size(), block.size() - offset_in_block);
+    std::copy_n(block.begin() + offset_in_block, count, data.begin());
+    return count;
+}
+
+OsErrorOr<size_t> RandomAccessReader::read_from_block(size_t index, size_t offset_in_block, std::span<uint8_t> data) {
+    {
+        std::lock_guard lock { m_mutex };
+        auto it = m_block_lookup.find(index);
+        if (it != m_block_lookup.end()) {
+            m_statistics.hits++;
+            m_blocks.splice(m_blocks.begin(), m_blocks, it->second);
+            return copy_from_block(it->second->data, offset_in_block, data);
+        }
+        m_statistics.misses++;
+    }
+
+    // Load without holding the lock, so that other threads can use the
+    // cache meanwhile. If some other thread loads the same block at the
+    // same time, the first one to finish wins.
+    auto block = TRY(load_block(index));
+
+    std::lock_guard lock { m_mutex };
+    auto it = m_block_lookup.find(index);
+    if (it != m_block_lookup.end()) {
+        m_blocks.splice(m_blocks.begin(), m_blocks, it->second);
+    }
+    else {
+        m_blocks.push_front({ .index = index, .data = std::move(block) });
+        m_block_lookup.emplace(index, m_blocks.begin());
+        if (m_blocks.size() > m_max_cached_blocks) {
+            m_block_lookup.erase(m_blocks.back().index);
+            m_blocks.pop_back();
+        }
+    }
+    return copy_from_block(m_blocks.front().data, offset_in_block, data);
+}
+
+OsErrorOr<Buffer> RandomAccessReader::load_block(size_t index) const {
+    auto block = Buffer::uninitialized(m_block_size);
+    size_t size = 0;
+    while (size < block.size()) {
+        auto bytes_read = TRY(m_file.read_at(index * m_block_size + size, block.span().subspan(size)));
+        if (bytes_read == 0) {
+            break;
+        }
+        size += bytes_read;
+    }
+    if (size < block.size()) {
+        block.resize_uninitialized(size);
+    }
+    return block;
+}
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../Buffer.hpp"
+#include "../Error.hpp"
+#include "../NonCopyable.hpp"
+#include "File.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+namespace Util {
+
+// Reads a file at arbitrary offsets, caching recently used aligned blocks
+// of it, so that many small reads near each other don't need a syscall
+// each. It can be used from multiple threads at once. The file must
+// outlive the reader, and must not be written to while it is used.
+class RandomAccessReader : public NonCopyable {
+public:
+    static constexpr size_t DefaultBlockSize = 16 * 1024;
+    static constexpr size_t DefaultMaxCachedBlocks = 64;
+
+    explicit RandomAccessReader(File const& file, size_t block_size = DefaultBlockSize, size_t max_cached_blocks = DefaultMaxCachedBlocks);
+
+    size_t block_size() const { return m_block_size; }
+
+    // Returns count of bytes read, which is less than requested only if
+    // end of file was reached.
+    OsErrorOr<size_t> read_at(size_t offset, std::span<uint8_t>);
+
+    // Returns false if end of file was reached before filling the span.
+    OsErrorOr<bool> read_all_at(size_t offset, std::span<uint8_t> data) {
+        return TRY(read_at(offset, data)) == data.size();
+    }
+
+    struct Statistics {
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+    Statistics statistics() const;
+
+private:
+    struct CachedBlock {
+        size_t index;
+        Buffer data;
+    };
+
+    // Copies data from the block starting at `offset_in_block`. Returns
+    // count of bytes copied.
+    OsErrorOr<size_t> read_from_block(size_t index, size_t offset_in_block, std::span<uint8_t>);
+    OsErrorOr<Buffer> load_block(size_t index) const;
+
+    File const& m_file;
+    size_t m_block_size;
+    size_t m_max_cached_blocks;
+
+    mutable std::mutex m_mutex;
+
+    // Most recently used first.
+    std::list<CachedBlock> m_blocks;
+    std::unordered_map<size_t, std::list<CachedBlock>::iterator> m_block_lookup;
+    Statistics m_statistics;
+};
+
+}
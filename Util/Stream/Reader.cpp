@@ -1,8 +1,10 @@
 #include "Reader.hpp"
 
-namespace Util {
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 
-constexpr auto BufferSize = 4096;
+namespace Util {
 
 bool BufferedReader::is_eof() const {
     return m_stream.is_eof() && buffer_is_empty();
@@ -12,29 +14,81 @@ OsErrorOr<size_t> BufferedReader::read(std::span<uint8_t> data) {
     auto read = read_from_buffer(data);
     if (read < data.size() && !m_stream.is_eof()) {
         if (data.size() - read > BufferSize) {
-            return m_stream.read(data.subspan(read));
+            // Buffer is no longer adjacent to the stream position, so it
+            // can't be used for seeking back.
+            clear_buffer();
+            return read + TRY(read_from_stream(data.subspan(read)));
         }
         TRY(refill_buffer());
-        return read_from_buffer(data.subspan(read));
+        return read + read_from_buffer(data.subspan(read));
     }
 
     return read;
 }
 
 size_t BufferedReader::read_from_buffer(std::span<uint8_t> data) {
-    if (buffer_is_empty())
-        return 0;
-    auto to_read = std::min(m_buffer.size() - m_buffer_offset, data.size());
-    std::copy(m_buffer.begin() + m_buffer_offset, m_buffer.begin() + m_buffer_offset + to_read, data.begin());
+    auto buffered = buffered_data();
+    auto to_read = std::min(buffered.size(), data.size());
+    std::copy_n(buffered.begin(), to_read, data.begin());
     m_buffer_offset += to_read;
     return to_read;
 }
 
+void BufferedReader::clear_buffer() {
+    m_buffered = {};
+    m_buffer_offset = 0;
+}
+
 OsErrorOr<size_t> BufferedReader::refill_buffer() {
-    m_buffer.resize_uninitialized(BufferSize);
+    // Everything buffered was consumed, so nothing is left if reading fails.
+    clear_buffer();
+    if (auto memory = m_stream.peek_span()) {
+        // Use memory of the stream instead of copying it.
+        TRY(m_stream.seek(memory->size()));
+        m_buffered = *memory;
+        if (m_stream_position) {
+            *m_stream_position += m_buffered.size();
+        }
+        return m_buffered.size();
+    }
+    if (m_buffer.size() < BufferSize) {
+        m_buffer.resize_uninitialized(BufferSize);
+    }
+    auto read = TRY(read_from_stream(m_buffer.span()));
+    m_buffered = m_buffer.span().first(read);
+    return read;
+}
+
+OsErrorOr<size_t> BufferedReader::read_from_stream(std::span<uint8_t> data) {
+    auto read = TRY(m_stream.read(data));
+    if (m_stream_position) {
+        *m_stream_position += read;
+    }
+    return read;
+}
+
+OsErrorOr<size_t> BufferedReader::fill_buffer(size_t size) {
+    auto remaining = buffered_data();
+    if (m_stream.peek_span()) {
+        // Everything that the stream had is already buffered.
+        if (remaining.empty()) {
+            return refill_buffer();
+        }
+        return static_cast<size_t>(0);
+    }
+    // The remaining data may overlap the start of the buffer.
+    if (!remaining.empty() && remaining.data() != m_buffer.begin()) {
+        std::memmove(m_buffer.begin(), remaining.data(), remaining.size());
+    }
+    if (m_buffer.size() < std::max(size, BufferSize)) {
+        m_buffer.resize_uninitialized(std::max(size, BufferSize));
+    }
+    // Point at the moved data before reading, so that it stays consistent
+    // if reading fails.
+    m_buffered = m_buffer.span().first(remaining.size());
     m_buffer_offset = 0;
-    auto read = TRY(m_stream.read(m_buffer.span()));
-    m_buffer.resize_uninitialized(read);
+    auto read = TRY(read_from_stream(m_buffer.span().subspan(remaining.size())));
+    m_buffered = m_buffer.span().first(remaining.size() + read);
     return read;
 }
 
@@ -62,92 +116,233 @@ OsErrorOr<std::optional<uint8_t>> BufferedReader::peek() {
         TRY(refill_buffer());
     }
     if (!buffer_is_empty()) {
-        return m_buffer[m_buffer_offset];
+        return m_buffered[m_buffer_offset];
     }
     return std::optional<uint8_t> {};
 }
 
+OsErrorOr<std::span<uint8_t const>> BufferedReader::peek_span() {
+    if (buffer_is_empty()) {
+        TRY(refill_buffer());
+    }
+    return buffered_data();
+}
+
+OsErrorOr<std::optional<std::span<uint8_t const>>> BufferedReader::read_view(size_t size) {
+    while (buffered_data().size() < size) {
+        if (TRY(fill_buffer(size)) == 0) {
+            return std::optional<std::span<uint8_t const>> {};
+        }
+    }
+    auto data = buffered_data().first(size);
+    discard_buffered_data(size);
+    return data;
+}
+
 OsErrorOr<void> BufferedReader::seek(ssize_t offset, SeekDirection dir) {
+    auto buffered = static_cast<ssize_t>(buffered_data().size());
+
+    // Offset relative to the current read position, if it can be computed.
+    std::optional<ssize_t> relative_offset;
     if (dir == SeekDirection::FromCurrent) {
-        offset -= m_buffer.size() - m_buffer_offset;
+        relative_offset = offset;
+    }
+    else if (dir == SeekDirection::FromStart && m_stream_position) {
+        relative_offset = offset - (static_cast<ssize_t>(*m_stream_position) - buffered);
+    }
+    if (relative_offset && *relative_offset >= -static_cast<ssize_t>(m_buffer_offset) && *relative_offset <= buffered) {
+        m_buffer_offset += *relative_offset;
+        return {};
+    }
+
+    if (dir == SeekDirection::FromCurrent) {
+        offset -= buffered;
+    }
+    clear_buffer();
+    auto result = m_stream.seek(offset, dir);
+    if (result.is_error()) {
+        m_stream_position = {};
+        return result;
+    }
+    switch (dir) {
+    case SeekDirection::FromStart:
+        m_stream_position = offset;
+        break;
+    case SeekDirection::FromCurrent:
+        if (m_stream_position) {
+            *m_stream_position += offset;
+        }
+        break;
+    case SeekDirection::FromEnd:
+        m_stream_position = {};
+        break;
+    }
+    return {};
+}
+
+OsErrorOr<uint64_t> BinaryReader::read_varint() {
+    while (true) {
+        auto decoded = Varint::decode(buffered_data());
+        if (!decoded) {
+            return OsError { EILSEQ, "read_varint" };
+        }
+        if (decoded->size > 0) {
+            discard_buffered_data(decoded->size);
+            return decoded->value;
+        }
+        // The value is split between buffers (or there is no data).
+        if (TRY(fill_buffer(Varint::MaxSize)) == 0) {
+            return OsError { 0, "EOF in read_varint" };
+        }
     }
-    m_buffer_offset = m_buffer.size();
-    m_buffer = {};
-    return m_stream.seek(offset, dir);
+}
+
+OsErrorOr<void> BinaryReader::read_varint_array(std::span<uint64_t> values) {
+    size_t s = 0;
+    while (s < values.size()) {
+        // Decode without checking for the end of buffer as long as there
+        // is room for the longest value.
+        auto data = buffered_data();
+        size_t offset = 0;
+        while (s < values.size() && data.size() - offset >= Varint::MaxSize) {
+            auto decoded = Varint::decode(data.subspan(offset));
+            if (!decoded) {
+                discard_buffered_data(offset);
+                return OsError { EILSEQ, "read_varint_array" };
+            }
+            values[s++] = decoded->value;
+            offset += decoded->size;
+        }
+        discard_buffered_data(offset);
+        if (s < values.size()) {
+            values[s++] = TRY(read_varint());
+        }
+    }
+    return {};
 }
 
 OsErrorOr<Buffer> BinaryReader::read_until(uint8_t delim) {
     Buffer result;
     while (true) {
-        auto ch = TRY(get());
-        if (!ch || *ch == delim) {
+        auto data = buffered_data();
+        if (data.empty()) {
+            if (TRY(refill_buffer()) == 0) {
+                break;
+            }
+            continue;
+        }
+        auto found = static_cast<uint8_t const*>(std::memchr(data.data(), delim, data.size()));
+        auto count = found ? static_cast<size_t>(found - data.data()) : data.size();
+        result.append(data.first(count));
+        if (found) {
+            discard_buffered_data(count + 1);
             break;
         }
-        result.append(*ch);
+        discard_buffered_data(count);
     }
     return result;
 }
 
-OsErrorOr<std::optional<uint32_t>> TextReader::consume() {
-    auto cp = TRY(consume_impl());
-    if (!cp) {
-        return cp;
-    }
-    if (*cp == '\n') {
-        m_location.line++;
-        m_location.column = 0;
-    }
-    else {
-        m_location.column++;
+OsErrorOr<std::optional<std::span<uint8_t const>>> BinaryReader::read_until_view(uint8_t delim) {
+    size_t searched = 0;
+    while (true) {
+        auto data = buffered_data();
+        auto found = data.size() > searched ? static_cast<uint8_t const*>(std::memchr(data.data() + searched, delim, data.size() - searched)) : nullptr;
+        if (found) {
+            auto count = static_cast<size_t>(found - data.data());
+            discard_buffered_data(count + 1);
+            return data.first(count);
+        }
+        searched = data.size();
+        if (data.size() >= BufferSize && !stream().peek_span()) {
+            return std::optional<std::span<uint8_t const>> {};
+        }
+        if (TRY(fill_buffer()) == 0) {
+            // EOF, like read_until() return what is left.
+            data = buffered_data();
+            discard_buffered_data(data.size());
+            return data;
+        }
     }
-    m_location.offset++;
-
-    return cp;
 }
 
-OsErrorOr<std::optional<uint32_t>> TextReader::consume_impl() {
-    if (m_peeked_codepoint) {
-        auto codepoint = *m_peeked_codepoint;
-        m_peeked_codepoint = {};
-        return codepoint;
-    }
-    std::vector<uint8_t> buffer;
-    while (true) {
-        auto c = TRY(get());
-        if (!c) {
-            return std::optional<uint32_t> {};
+OsErrorOr<bool> TextReader::decode_if_needed() {
+    while (m_decoded_offset >= m_decoded_size) {
+        m_decoded_offset = 0;
+        m_decoded_size = 0;
+
+        auto bytes = buffered_data();
+        if (bytes.empty()) {
+            if (TRY(refill_buffer()) == 0) {
+                m_decoded.resize(std::max(m_decoded.size(), Utf8::StreamingDecoder::MaxPendingBytes));
+                m_decoded_size = m_decoder.finish(m_decoded).codepoints;
+                return m_decoded_size > 0;
+            }
+            bytes = buffered_data();
         }
-        buffer.push_back(*c);
 
-        // Check if we can already decode the codepoint.
-        auto decoded = Util::UString::decode(buffer);
-        if (!decoded.is_error()) {
-            assert(decoded.value().size() == 1);
-            return decoded.release_value().at(0);
+        // Data borrowed from memory streams may be huge, so decode it in
+        // chunks.
+        bytes = bytes.first(std::min(bytes.size(), BufferSize));
+        m_decoded.resize(std::max(m_decoded.size(), bytes.size() + Utf8::StreamingDecoder::MaxPendingBytes));
+        switch (m_encoding) {
+        case UString::Encoding::ASCII:
+            std::copy(bytes.begin(), bytes.end(), m_decoded.begin());
+            m_decoded_size = bytes.size();
+            break;
+        case UString::Encoding::Utf8:
+            m_decoded_size = m_decoder.decode(m_decoded, { reinterpret_cast<char const*>(bytes.data()), bytes.size() }).codepoints;
+            break;
         }
+        discard_buffered_data(bytes.size());
     }
+    return true;
+}
+
+void TextReader::consume_decoded(size_t count) {
+    auto codepoints = decoded_codepoints().first(count);
+    auto last_newline = std::find(codepoints.rbegin(), codepoints.rend(), '\n');
+    if (last_newline != codepoints.rend()) {
+        m_location.line += std::count(codepoints.begin(), codepoints.end(), '\n');
+        m_location.column = last_newline - codepoints.rbegin();
+    }
+    else {
+        m_location.column += count;
+    }
+    m_location.offset += count;
+    m_decoded_offset += count;
+}
+
+OsErrorOr<std::optional<uint32_t>> TextReader::consume() {
+    if (!TRY(decode_if_needed())) {
+        return std::optional<uint32_t> {};
+    }
+    auto codepoint = m_decoded[m_decoded_offset];
+    consume_decoded(1);
+    return codepoint;
 }
 
 OsErrorOr<std::optional<uint32_t>> TextReader::peek() {
-    if (m_peeked_codepoint) {
-        return m_peeked_codepoint;
+    if (!TRY(decode_if_needed())) {
+        return std::optional<uint32_t> {};
     }
-    m_peeked_codepoint = TRY(consume_impl());
-    return m_peeked_codepoint;
+    return m_decoded[m_decoded_offset];
 }
 
 OsErrorOr<UString> TextReader::consume_until(uint32_t delim) {
-    Buffer result;
-    while (true) {
-        auto ch = TRY(consume());
-        if (!ch || *ch == delim) {
+    UStringBuilder result;
+    while (TRY(decode_if_needed())) {
+        auto codepoints = decoded_codepoints();
+        auto end = std::find(codepoints.begin(), codepoints.end(), delim);
+        auto count = static_cast<size_t>(end - codepoints.begin());
+        result.append(codepoints.first(count));
+        if (count < codepoints.size()) {
+            consume_decoded(count + 1);
             break;
         }
-        result.append(*ch);
+        consume_decoded(count);
     }
-    return result.decode(m_encoding).map_error([&](auto) {
-        return OsError { .error = 0, .function = "consume_until: Decoding failed" };
-    });
+    return result.release_string();
 }
 
 OsErrorOr<UString> TextReader::consume_line() {
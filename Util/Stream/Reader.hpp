@@ -4,13 +4,20 @@
 #include "../Endianness.hpp"
 #include "../SourceLocation.hpp"
 #include "../UString.hpp"
+#include "../UStringBuilder.hpp"
+#include "../Utf8.hpp"
+#include "../Varint.hpp"
 #include "Stream.hpp"
+#include <algorithm>
 #include <type_traits>
+#include <vector>
 
 namespace Util {
 
 class BufferedReader {
 public:
+    static constexpr size_t BufferSize = 4096;
+
     explicit BufferedReader(ReadableStream& stream)
         : m_stream(stream) {
     }
@@ -22,17 +29,49 @@ public:
     OsErrorOr<bool> read_all(std::span<uint8_t>);
     OsErrorOr<std::optional<uint8_t>> get();
     OsErrorOr<std::optional<uint8_t>> peek();
+
+    // Buffered data (refilled if there is none), without consuming it. It
+    // is empty only on EOF, and valid until the next read. For streams that
+    // are backed by memory, this is all remaining data.
+    OsErrorOr<std::span<uint8_t const>> peek_span();
+
+    // Consume `size` bytes and return a view of them, valid until the next
+    // read. This copies only if the stream isn't backed by memory. Returns
+    // an empty optional (and doesn't consume anything) on EOF.
+    OsErrorOr<std::optional<std::span<uint8_t const>>> read_view(size_t size);
+
+    // Seeking to a position that is within the buffer doesn't touch the
+    // stream. For FromStart, this works only if the position of the stream
+    // is known, i.e after any FromStart seek.
     OsErrorOr<void> seek(ssize_t offset, SeekDirection = SeekDirection::FromCurrent);
 
+protected:
+    // Direct access to the buffer, for readers that process data in bulk.
+    std::span<uint8_t const> buffered_data() const { return m_buffered.subspan(m_buffer_offset); }
+    void discard_buffered_data(size_t count) { m_buffer_offset += count; }
+    OsErrorOr<size_t> refill_buffer();
+
+    // Move unread data to the beginning of the buffer and read as much as
+    // fits after it, growing the buffer to at least `size`. Returns count
+    // of bytes read.
+    OsErrorOr<size_t> fill_buffer(size_t size = BufferSize);
+
 private:
-    bool buffer_is_empty() const { return m_buffer_offset >= m_buffer.size(); }
+    bool buffer_is_empty() const { return m_buffer_offset >= m_buffered.size(); }
+    void clear_buffer();
     [[nodiscard]] size_t read_from_buffer(std::span<uint8_t>);
-    OsErrorOr<size_t> refill_buffer();
+    OsErrorOr<size_t> read_from_stream(std::span<uint8_t>);
 
     ReadableStream& m_stream;
 
+    // Buffered data is either a part of m_buffer, or memory of the stream
+    // if it supports peek_span().
     Buffer m_buffer;
+    std::span<uint8_t const> m_buffered;
     size_t m_buffer_offset = 0;
+
+    // Position of the stream (so, of the end of the buffer), if known.
+    std::optional<size_t> m_stream_position;
 };
 
 class BinaryReader : public BufferedReader {
@@ -78,6 +117,32 @@ public:
         requires(sizeof(FP) == 8)
     OsErrorOr<FP> read_big_endian() { return std::bit_cast<FP>(TRY(read_big_endian<uint64_t>())); }
 
+    // Read a whole array at once and convert it in place, which is much
+    // faster than reading elements one by one.
+    template<EndianConvertible T>
+    OsErrorOr<void> read_little_endian_array(std::span<T> values) {
+        if (!TRY(read_all({ reinterpret_cast<uint8_t*>(values.data()), values.size_bytes() })))
+            return OsError { 0, "EOF in read_little_endian_array" };
+        convert_from_little_to_host_endian(values);
+        return {};
+    }
+
+    template<EndianConvertible T>
+    OsErrorOr<void> read_big_endian_array(std::span<T> values) {
+        if (!TRY(read_all({ reinterpret_cast<uint8_t*>(values.data()), values.size_bytes() })))
+            return OsError { 0, "EOF in read_big_endian_array" };
+        convert_from_big_to_host_endian(values);
+        return {};
+    }
+
+    // Read a value written by Writer::write_varint(). Values are decoded
+    // directly from the buffer, several bytes at once. Fails with EILSEQ
+    // if the value doesn't fit in 64 bits or is overlong (see
+    // Varint::decode()).
+    OsErrorOr<uint64_t> read_varint();
+    OsErrorOr<int64_t> read_zigzag() { return Varint::zigzag_decode(TRY(read_varint())); }
+    OsErrorOr<void> read_varint_array(std::span<uint64_t>);
+
     template<class T>
         requires(std::is_trivial_v<T>)
     OsErrorOr<T> read_struct() {
@@ -91,29 +156,51 @@ public:
     // This reads `delim` but doesn't include it in the buffer.
     OsErrorOr<Buffer> read_until(uint8_t delim);
 
+    // Same as read_until(), but returns a view into the internal buffer
+    // instead of copying. It is valid until the next read. Returns an empty
+    // optional (and doesn't read anything) if there is no `delim` within
+    // the next BufferSize bytes; read_until() must be used then. Streams
+    // backed by memory don't have this limit.
+    OsErrorOr<std::optional<std::span<uint8_t const>>> read_until_view(uint8_t delim);
+
     template<class Callback>
     OsErrorOr<Buffer> read_while(Callback&& callback) {
         Buffer result;
-        auto c = TRY(peek());
-        while (c && callback(*c)) {
-            result.append(*c);
-            TRY(get());
-            c = TRY(peek());
+        while (true) {
+            auto data = buffered_data();
+            if (data.empty()) {
+                if (TRY(refill_buffer()) == 0) {
+                    break;
+                }
+                continue;
+            }
+            auto end = std::find_if_not(data.begin(), data.end(), [&](uint8_t byte) { return callback(byte); });
+            auto count = static_cast<size_t>(end - data.begin());
+            result.append(data.first(count));
+            discard_buffered_data(count);
+            if (count < data.size()) {
+                break;
+            }
         }
         return result;
     }
 };
 
-class TextReader : public BufferedReader {
+// Input is decoded ahead of what was consumed, so byte-level reading and
+// seeking of BufferedReader isn't exposed; it would skip or rewind under
+// the decoded codepoints.
+class TextReader : private BufferedReader {
 public:
     explicit TextReader(ReadableStream& stream, UString::Encoding encoding = UString::Encoding::Utf8)
         : BufferedReader(stream)
         , m_encoding(encoding) { }
 
+    using BufferedReader::stream;
+
     SourceLocation location() { return m_location; }
 
     bool is_eof() const {
-        return BufferedReader::is_eof() && !m_peeked_codepoint;
+        return BufferedReader::is_eof() && m_decoded_offset >= m_decoded_size && !m_decoder.has_pending_bytes();
     }
 
     // Peek at single codepoint without removing it from stream.
@@ -127,14 +214,18 @@ public:
 
     template<class Callback>
     OsErrorOr<UString> consume_while(Callback&& callback) {
-        std::vector<uint32_t> result;
-        auto c = TRY(peek());
-        while (c && callback(*c)) {
-            result.push_back(*c);
-            TRY(consume());
-            c = TRY(peek());
+        UStringBuilder result;
+        while (TRY(decode_if_needed())) {
+            auto codepoints = decoded_codepoints();
+            auto end = std::find_if_not(codepoints.begin(), codepoints.end(), [&](uint32_t codepoint) { return callback(codepoint); });
+            auto count = static_cast<size_t>(end - codepoints.begin());
+            result.append(codepoints.first(count));
+            consume_decoded(count);
+            if (count < codepoints.size()) {
+                break;
+            }
         }
-        return UString { result };
+        return result.release_string();
     }
 
     OsErrorOr<UString> consume_line();
@@ -146,11 +237,22 @@ public:
     }
 
 private:
-    OsErrorOr<std::optional<uint32_t>> consume_impl();
+    // Codepoints are decoded a whole buffer at a time, so that bulk
+    // operations can work on runs of them.
+    std::span<uint32_t const> decoded_codepoints() const { return { m_decoded.data() + m_decoded_offset, m_decoded_size - m_decoded_offset }; }
+
+    // Decode the next chunk if all decoded codepoints were consumed.
+    // Returns false on EOF.
+    OsErrorOr<bool> decode_if_needed();
 
-    std::optional<uint32_t> m_peeked_codepoint;
+    // Remove codepoints from the decoded buffer, updating location.
+    void consume_decoded(size_t count);
+
+    std::vector<uint32_t> m_decoded;
+    size_t m_decoded_size = 0;
+    size_t m_decoded_offset = 0;
+    Utf8::StreamingDecoder m_decoder;
     SourceLocation m_location;
     UString::Encoding m_encoding {};
 };
-
 }
@@ -3,6 +3,7 @@
 #include "../Error.hpp"
 #include <cstddef>
 #include <cstdint>
+#include <optional>
 #include <span>
 
 namespace Util {
@@ -24,6 +25,10 @@ public:
     virtual bool is_eof() const = 0;
 
     virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) = 0;
+
+    // Streams backed by memory return all data that wasn't read yet, so
+    // that it can be used without copying. Use seek() to consume it.
+    virtual std::optional<std::span<uint8_t const>> peek_span() const { return {}; }
 };
 
 class WritableStream {
@@ -33,6 +38,29 @@ public:
     // Try to write data to buffer. Returns number of bytes written.
     virtual OsErrorOr<size_t> write(std::span<uint8_t const>) = 0;
 
+    // Try to write data from multiple buffers, in order. Returns number of
+    // bytes written (an error only if nothing was written). Streams that
+    // can do this in one operation (e.g files with writev) should override
+    // this.
+    virtual OsErrorOr<size_t> write_vectored(std::span<std::span<uint8_t const> const> buffers) {
+        size_t bytes_written = 0;
+        for (auto buffer : buffers) {
+            auto result = write(buffer);
+            if (result.is_error()) {
+                if (bytes_written > 0) {
+                    break;
+                }
+                return result;
+            }
+            auto bytes = result.release_value();
+            bytes_written += bytes;
+            if (bytes < buffer.size()) {
+                break;
+            }
+        }
+        return bytes_written;
+    }
+
     virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) = 0;
 };
 
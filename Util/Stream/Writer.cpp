@@ -1,9 +1,87 @@
 #include "Writer.hpp"
 
-#include <fmt/core.h>
+#include <algorithm>
+#include <cerrno>
+#include <fmt/format.h>
 
 namespace Util {
 
+BufferedWriter::BufferedWriter(WritableStream& stream, size_t buffer_size)
+    : m_stream(stream)
+    , m_buffer(Buffer::uninitialized(buffer_size)) {
+}
+
+BufferedWriter::~BufferedWriter() {
+    auto result = flush();
+    if (result.is_error()) {
+        result.dump("BufferedWriter: Failed to flush on destruction");
+    }
+}
+
+OsErrorOr<void> BufferedWriter::flush() {
+    TRY(write_through({}));
+    return {};
+}
+
+OsErrorOr<size_t> BufferedWriter::write_through(std::span<uint8_t const> data) {
+    std::span<uint8_t const> buffers[] = { m_buffer.span().first(m_buffered_size), data };
+    while (!buffers[0].empty() || !buffers[1].empty()) {
+        auto result = m_stream.write_vectored(buffers);
+        if (result.is_error() || result.value() == 0) {
+            // Buffered data is written first, so it's all written if a
+            // part of `data` is.
+            if (buffers[1].size() < data.size()) {
+                return data.size() - buffers[1].size();
+            }
+            if (result.is_error()) {
+                return result.release_error();
+            }
+            return OsError { EIO, "BufferedWriter::flush" };
+        }
+        auto bytes_written = result.release_value();
+        for (auto& buffer : buffers) {
+            auto consumed = std::min(bytes_written, buffer.size());
+            buffer = buffer.subspan(consumed);
+            bytes_written -= consumed;
+        }
+        // Keep what wasn't written yet, in case of an error.
+        m_buffered_size = buffers[0].size();
+        std::copy(buffers[0].begin(), buffers[0].end(), m_buffer.begin());
+        buffers[0] = m_buffer.span().first(m_buffered_size);
+    }
+    return data.size();
+}
+
+OsErrorOr<size_t> BufferedWriter::write(std::span<uint8_t const> data) {
+    auto size = data.size();
+    auto free_space = m_buffer.size() - m_buffered_size;
+    if (data.size() >= m_buffer.size()) {
+        return write_through(data);
+    }
+    if (data.size() > free_space) {
+        // Fill the buffer up, so that the stream always gets full chunks.
+        // If flushing fails, only these bytes are accepted; they stay in
+        // the buffer.
+        std::copy(data.begin(), data.begin() + free_space, m_buffer.begin() + m_buffered_size);
+        m_buffered_size += free_space;
+        data = data.subspan(free_space);
+        if (auto result = flush(); result.is_error()) {
+            if (free_space > 0) {
+                return free_space;
+            }
+            return result.release_error();
+        }
+    }
+    std::copy(data.begin(), data.end(), m_buffer.begin() + m_buffered_size);
+    m_buffered_size += data.size();
+    return size;
+}
+
+OsErrorOr<void> BufferedWriter::seek(ssize_t count, SeekDirection direction) {
+    TRY(flush());
+    return m_stream.seek(count, direction);
+}
+
 OsErrorOr<size_t> Writer::write(std::span<uint8_t const> data) {
     return m_stream.write(data);
 }
@@ -16,42 +94,29 @@ OsErrorOr<void> Writer::write_all(std::span<uint8_t const> data) {
     return {};
 }
 
+OsErrorOr<void> Writer::write_varint_array(std::span<uint64_t const> values) {
+    constexpr size_t ChunkSize = 4096;
+    uint8_t chunk[ChunkSize];
+    size_t size = 0;
+    for (auto value : values) {
+        if (size > ChunkSize - Varint::MaxSize) {
+            TRY(write_all({ chunk, size }));
+            size = 0;
+        }
+        size += Varint::encode(value, chunk + size);
+    }
+    return write_all({ chunk, size });
+}
+
 OsErrorOr<void> Writer::write(UString const& string) {
     auto encoded = string.encode(m_encoding);
     return write_all({ reinterpret_cast<uint8_t const*>(encoded.data()), encoded.size() });
 }
 
-void Writer::vwriteff(fmt::string_view fmtstr, fmt::format_args args) {
-    struct OutputIt {
-        OutputIt(WritableStream& stream)
-            : m_stream(&stream) { }
-
-        struct OutputAdapter {
-            OutputAdapter(OutputIt& it)
-                : m_it(it) { }
-
-            OutputAdapter& operator=(uint8_t t) {
-                (void)m_it.m_stream->write({ &t, 1 });
-                return *this;
-            }
-
-            OutputIt& m_it;
-        };
-
-        OutputAdapter operator*() { return OutputAdapter { *this }; }
-
-        auto& operator++() {
-            return *this;
-        }
-        auto operator++(int) {
-            return *this;
-        }
-        bool operator==(OutputIt const& other) const = default;
-
-        WritableStream* m_stream;
-    };
-    OutputIt out { m_stream };
-    fmt::vformat_to(out, fmtstr, std::move(args));
+OsErrorOr<void> Writer::vwriteff(fmt::string_view fmtstr, fmt::format_args args) {
+    fmt::memory_buffer buffer;
+    fmt::vformat_to(std::back_inserter(buffer), fmtstr, args);
+    return write_all({ reinterpret_cast<uint8_t const*>(buffer.data()), buffer.size() });
 }
 
 }
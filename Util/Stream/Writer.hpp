@@ -1,14 +1,57 @@
 #pragma once
 
+#include "../Buffer.hpp"
 #include "../Endianness.hpp"
 #include "../UString.hpp"
+#include "../Varint.hpp"
 #include "Stream.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <fmt/core.h>
 #include <fmt/format.h>
 
 namespace Util {
 
+// Stream that collects small writes in a buffer and writes them to the
+// underlying stream in big chunks. Writes bigger than the buffer are passed
+// directly, together with what was buffered (in one write_vectored() call).
+// Remaining data is flushed on destruction, but errors can only be printed
+// then, so call flush() explicitly to handle them.
+class BufferedWriter : public WritableStream {
+public:
+    static constexpr size_t DefaultBufferSize = 64 * 1024;
+
+    explicit BufferedWriter(WritableStream& stream, size_t buffer_size = DefaultBufferSize);
+    BufferedWriter(BufferedWriter const&) = delete;
+    BufferedWriter& operator=(BufferedWriter const&) = delete;
+    virtual ~BufferedWriter();
+
+    WritableStream& stream() const { return m_stream; }
+    size_t buffered_size() const { return m_buffered_size; }
+
+    OsErrorOr<void> flush();
+
+    // Like for write(), an error is returned only if nothing was accepted.
+    // If writing to the stream fails after a part of the data was accepted
+    // (buffered or written), that count is returned, and the error happens
+    // again on the next write.
+    virtual OsErrorOr<size_t> write(std::span<uint8_t const>) override;
+
+    // This flushes first.
+    virtual OsErrorOr<void> seek(ssize_t count, SeekDirection direction = SeekDirection::FromCurrent) override;
+
+private:
+    // Write buffered data followed by `data` to the stream. Returns how
+    // much of `data` was written, which is less than all of it only if
+    // writing failed after a part of it.
+    OsErrorOr<size_t> write_through(std::span<uint8_t const> data);
+
+    WritableStream& m_stream;
+    Buffer m_buffer;
+    size_t m_buffered_size = 0;
+};
+
 class Writer {
 public:
     explicit Writer(WritableStream& stream, UString::Encoding encoding = UString::Encoding::Utf8)
@@ -22,9 +65,10 @@ public:
     OsErrorOr<void> write_all(std::span<uint8_t const>);
     OsErrorOr<void> write(UString const&);
 
-    // TODO: Make this fallible
+    // Formats into a buffer and writes it at once. Short outputs don't
+    // allocate.
     template<class... Args>
-    void writeff(fmt::format_string<Args...> fmt, Args&&... args) {
+    OsErrorOr<void> writeff(fmt::format_string<Args...> fmt, Args&&... args) {
         return vwriteff(fmt, fmt::make_format_args(args...));
     }
 
@@ -62,6 +106,41 @@ public:
     requires(sizeof(FP) == 8)
         OsErrorOr<void> write_big_endian(FP value) { return write_big_endian(std::bit_cast<uint64_t>(value)); }
 
+    // Convert a whole array in chunks and write each of them at once,
+    // which is much faster than writing elements one by one.
+    template<EndianConvertible T>
+    OsErrorOr<void> write_little_endian_array(std::span<T const> values) {
+        if constexpr (std::endian::native == std::endian::little) {
+            return write_all({ reinterpret_cast<uint8_t const*>(values.data()), values.size_bytes() });
+        }
+        else {
+            return write_converted_array<T>(values, [](auto input, auto output) { convert_from_host_to_little_endian<T>(input, output); });
+        }
+    }
+
+    template<EndianConvertible T>
+    OsErrorOr<void> write_big_endian_array(std::span<T const> values) {
+        if constexpr (std::endian::native == std::endian::big) {
+            return write_all({ reinterpret_cast<uint8_t const*>(values.data()), values.size_bytes() });
+        }
+        else {
+            return write_converted_array<T>(values, [](auto input, auto output) { convert_from_host_to_big_endian<T>(input, output); });
+        }
+    }
+
+    // Variable-length encoding (see Util/Varint.hpp), 1 byte for values
+    // below 128.
+    OsErrorOr<void> write_varint(uint64_t value) {
+        uint8_t data[Varint::MaxSize];
+        return write_all({ data, Varint::encode(value, data) });
+    }
+
+    // Zigzag and varint encoding, 1 byte for values in [-64, 63].
+    OsErrorOr<void> write_zigzag(int64_t value) { return write_varint(Varint::zigzag_encode(value)); }
+
+    // Encode values in chunks and write each of them at once.
+    OsErrorOr<void> write_varint_array(std::span<uint64_t const> values);
+
     template<class T>
     requires(std::is_trivial_v<T>)
         OsErrorOr<void> write_struct(T t) {
@@ -70,8 +149,20 @@ public:
     }
 
 private:
-    // TODO: Make this fallible
-    void vwriteff(fmt::string_view fmtstr, fmt::format_args args);
+    OsErrorOr<void> vwriteff(fmt::string_view fmtstr, fmt::format_args args);
+
+    template<class T, class Convert>
+    OsErrorOr<void> write_converted_array(std::span<T const> values, Convert&& convert) {
+        constexpr size_t ChunkSize = 4096 / sizeof(T);
+        T chunk[ChunkSize];
+        while (!values.empty()) {
+            auto count = std::min(values.size(), ChunkSize);
+            convert(values.first(count), std::span<T> { chunk, count });
+            TRY(write_all({ reinterpret_cast<uint8_t const*>(chunk), count * sizeof(T) }));
+            values = values.subspan(count);
+        }
+        return {};
+    }
 
     WritableStream& m_stream;
     UString::Encoding m_encoding {};
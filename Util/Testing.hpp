@@ -77,8 +77,16 @@ ErrorOr<void, TestError> expect_no_error(ErrorOr<T, E> value, std::string_view e
 using Test = ErrorOr<void, TestError>();
 using Benchmark = void();
 
+struct BenchmarkInfo {
+    Benchmark* function;
+
+    // Bytes processed by a single run, used for displaying throughput.
+    // 0 if not applicable.
+    size_t bytes_per_run = 0;
+};
+
 std::map<std::string_view, Test*> tests;
-std::map<std::string_view, Benchmark*> benchmarks;
+std::map<std::string_view, BenchmarkInfo> benchmarks;
 
 }
 
@@ -98,11 +106,15 @@ constexpr bool Fail = false;
     } __test_##name##_adder;                                                            \
     ErrorOr<void, __TestSuite::TestError> __test_##name##_func()
 
-#define BENCHMARK(name)                                                                                \
-    void __benchmark_##name##_func();                                                                  \
-    struct __Benchmark_##name {                                                                        \
-        __Benchmark_##name() { __TestSuite::benchmarks.insert({ #name, __benchmark_##name##_func }); } \
-    } __benchmark_##name##_adder;                                                                      \
+#define BENCHMARK(name) BENCHMARK_THROUGHPUT(name, 0)
+
+// Benchmark that processes `bytes_per_run` bytes in every run. Throughput
+// is displayed in addition to time.
+#define BENCHMARK_THROUGHPUT(name, bytes_per_run)                                                                           \
+    void __benchmark_##name##_func();                                                                                       \
+    struct __Benchmark_##name {                                                                                             \
+        __Benchmark_##name() { __TestSuite::benchmarks.insert({ #name, { __benchmark_##name##_func, (bytes_per_run) } }); } \
+    } __benchmark_##name##_adder;                                                                                           \
     void __benchmark_##name##_func()
 
 int main(int, char** argv) {
@@ -131,14 +143,19 @@ int main(int, char** argv) {
         constexpr size_t MaxRuns = 1000000;
         size_t run_count = MaxRuns;
         for (size_t s = 0; s < MaxRuns; s++) {
-            benchmark.second();
+            benchmark.second.function();
             if (clock.elapsed() > MaxRunTime) {
                 run_count = s + 1;
                 break;
             }
         }
         auto time = clock.elapsed();
-        fmt::print("\r\e\2K• \e[1m{}\e[m: {} run(s) finished in: {} ({} per test)\n", test_name, run_count, fmt::streamed(time), fmt::streamed(time / run_count));
+        fmt::print("\r\e\2K• \e[1m{}\e[m: {} run(s) finished in: {} ({} per test)", test_name, run_count, fmt::streamed(time), fmt::streamed(time / run_count));
+        if (benchmark.second.bytes_per_run > 0) {
+            auto seconds = std::chrono::duration<double>(time).count();
+            fmt::print(" ({:.3f} GB/s)", static_cast<double>(benchmark.second.bytes_per_run) * run_count / seconds / 1e9);
+        }
+        fmt::print("\n");
     }
     return failed ? 1 : 0;
 }
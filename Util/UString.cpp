@@ -1,13 +1,17 @@
 #include "UString.hpp"
 
 #include "Buffer.hpp"
+#include "MemoryResource.hpp"
+#include "Utf8.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <bit>
 #include <cassert>
 #include <compare>
 #include <cstring>
 #include <iostream>
+#include <new>
 #include <sstream>
 #include <string>
 #include <type_traits>
@@ -16,10 +20,68 @@
 
 namespace Util {
 
+// Heap storage of a string. It is shared (and reference counted) between
+// copies and substrings of a string, since strings are immutable.
+struct UString::Storage {
+    std::atomic<size_t> ref_count { 1 };
+    size_t size {};
+
+    // Resource that this was allocated from.
+    std::pmr::memory_resource* resource {};
+
+    // Array adopted by take_ownership() (allocated with new[]) or from
+    // a UStringBuilder (allocated from `resource`, with `adopted_capacity`).
+    // If null, codepoints are stored directly after this header.
+    uint32_t* adopted {};
+    size_t adopted_capacity {};
+
+    uint32_t* data() { return adopted ? adopted : reinterpret_cast<uint32_t*>(this + 1); }
+
+    static size_t allocation_size(size_t size) { return sizeof(Storage) + size * sizeof(uint32_t); }
+
+    static Storage* create(size_t size, std::pmr::memory_resource* resource = current_memory_resource()) {
+        auto memory = resource->allocate(allocation_size(size), alignof(Storage));
+        return new (memory) Storage { .size = size, .resource = resource };
+    }
+
+    static Storage* adopt(uint32_t* array, size_t size) {
+        auto storage = create(0);
+        storage->size = size;
+        storage->adopted = array;
+        return storage;
+    }
+
+    static Storage* adopt(uint32_t* array, size_t size, std::pmr::memory_resource* resource, size_t capacity) {
+        auto storage = create(0, resource);
+        storage->size = size;
+        storage->adopted = array;
+        storage->adopted_capacity = capacity;
+        return storage;
+    }
+
+    void ref() {
+        ref_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void unref() {
+        if (ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (adopted_capacity > 0) {
+                resource->deallocate(adopted, adopted_capacity * sizeof(uint32_t), alignof(uint32_t));
+            }
+            else {
+                delete[] adopted;
+            }
+            auto storage_resource = resource;
+            auto storage_size = allocation_size(adopted ? 0 : size);
+            this->~Storage();
+            storage_resource->deallocate(this, storage_size, alignof(Storage));
+        }
+    }
+};
+
 UString::UString(UString const& other) {
     // std::cout << __PRETTY_FUNCTION__ << std::endl;
-    reallocate(other.m_size);
-    std::copy(other.m_storage, other.m_storage + other.m_size, m_storage);
+    share_storage_with(other, 0, other.m_size);
 }
 
 UString::UString(std::span<uint32_t const> codepoints) {
@@ -29,187 +91,72 @@ UString::UString(std::span<uint32_t const> codepoints) {
 
 UString::~UString() {
     // std::cout << __PRETTY_FUNCTION__ << ": " << dump() << std::endl;
-    delete[] m_storage;
+    free_storage();
 }
 
 UString& UString::operator=(UString const& other) {
     // std::cout << __PRETTY_FUNCTION__ << std::endl;
     if (this == &other)
         return *this;
-    reallocate(other.m_size);
-    std::copy(other.m_storage, other.m_storage + other.m_size, m_storage);
+    // Take a reference first, other may be a substring of this.
+    UString copy { other };
+    free_storage();
+    take_storage_from(copy);
     return *this;
 }
 
-UString::UString(UString&& other) {
+UString::UString(UString&& other) noexcept {
     // std::cout << __PRETTY_FUNCTION__ << ": " << dump() << " << " << other.dump() << std::endl;
-    m_size = std::exchange(other.m_size, 0);
-    m_storage = std::exchange(other.m_storage, nullptr);
+    take_storage_from(other);
 }
 
-UString& UString::operator=(UString&& other) {
+UString& UString::operator=(UString&& other) noexcept {
     // std::cout << __PRETTY_FUNCTION__ << ": " << dump() << " << " << other.dump() << std::endl;
     if (this == &other)
         return *this;
-    delete[] m_storage;
-    m_size = std::exchange(other.m_size, 0);
-    m_storage = std::exchange(other.m_storage, nullptr);
+    free_storage();
+    take_storage_from(other);
     return *this;
 }
 
 UString UString::take_ownership(std::span<uint32_t const> codepoints) {
-    UString str;
     // NOTE: This assumes that the storage isn't modified by any of
     //       the methods. We can't enforce m_storage being const
     //       because it is written by constructors (e.g uint32 or UTF-8).
     // FIXME: Find a way to enforce m_storage being const to avoid this
     //        const_cast.
-    str.m_storage = const_cast<uint32_t*>(codepoints.data());
+    auto array = const_cast<uint32_t*>(codepoints.data());
+    if (codepoints.size() <= InlineCapacity) {
+        UString str { codepoints };
+        delete[] array;
+        return str;
+    }
+    UString str;
+    str.m_block = Storage::adopt(array, codepoints.size());
+    str.m_storage = array;
     str.m_size = codepoints.size();
     return str;
 }
 
+UString UString::take_ownership(uint32_t* array, size_t size, std::pmr::memory_resource* resource, size_t capacity) {
+    if (size <= InlineCapacity) {
+        UString str { std::span<uint32_t const> { array, size } };
+        resource->deallocate(array, capacity * sizeof(uint32_t), alignof(uint32_t));
+        return str;
+    }
+    UString str;
+    str.m_block = Storage::adopt(array, size, resource, capacity);
+    str.m_storage = array;
+    str.m_size = size;
+    return str;
+}
+
 UString::UString(uint32_t codepoint) {
     // std::cout << __PRETTY_FUNCTION__ << std::endl;
     reallocate(1);
     m_storage[0] = codepoint;
 }
 
-namespace Utf8 {
-
-static int bytes_required_to_store_codepoint(uint32_t codepoint) {
-    if (codepoint < 0x80)
-        return 1;
-    if (codepoint < 0x800)
-        return 2;
-    if (codepoint < 0x10000)
-        return 3;
-    if (codepoint < 0x200000)
-        return 4;
-    if (codepoint < 0x4000000)
-        return 5;
-    return 6;
-}
-
-template<class Callback>
-static bool decode_impl(std::string_view string, uint32_t replacement, Callback callback) {
-    bool error = false;
-    for (size_t s = 0; s < string.size(); s++) {
-        auto byte = std::bit_cast<uint8_t>(string[s]);
-        uint32_t codepoint = 0;
-        int additional_bytes_to_expect = 0;
-        if (byte >= 0b1111'1110) {
-            // std::cout << "invalid utf8 character: 0x" << std::hex << static_cast<uint16_t>(byte) << std::dec << std::endl;
-            error = true;
-            codepoint = replacement;
-        }
-        else if ((byte & 0b1111'1110) == 0b1111'1100) {
-            additional_bytes_to_expect = 5;
-            codepoint = byte & 0b1;
-        }
-        else if ((byte & 0b1111'1100) == 0b1111'1000) {
-            additional_bytes_to_expect = 4;
-            codepoint = byte & 0b11;
-        }
-        else if ((byte & 0b1111'1000) == 0b1111'0000) {
-            additional_bytes_to_expect = 3;
-            codepoint = byte & 0b111;
-        }
-        else if ((byte & 0b1111'0000) == 0b1110'0000) {
-            additional_bytes_to_expect = 2;
-            codepoint = byte & 0b1111;
-        }
-        else if ((byte & 0b1110'0000) == 0b1100'0000) {
-            additional_bytes_to_expect = 1;
-            codepoint = byte & 0b11111;
-        }
-        else {
-            codepoint = byte & 0x7f;
-        }
-
-        for (int i = 0; i < additional_bytes_to_expect; i++) {
-            s++;
-            if (s >= string.size()) {
-                // std::cout << "unfinished utf8 sequence" << std::endl;
-                return false;
-            }
-            codepoint <<= 6;
-            codepoint |= (string[s] & 0b111111);
-        }
-
-        // Check if codepoint was stored optimally
-        auto required_bytes = bytes_required_to_store_codepoint(codepoint);
-        auto got_bytes = additional_bytes_to_expect + 1;
-        if (required_bytes > got_bytes) {
-            // std::cout << "got more bytes than required to encode codepoint " << codepoint << " (" << got_bytes << " > " << required_bytes << ")\n";
-        }
-
-        callback(codepoint);
-    }
-    return !error;
-}
-
-static std::optional<size_t> strlen(std::string_view string) {
-    size_t size = 0;
-    if (!decode_impl(string, 0x0, [&size](auto) { size++; })) {
-        return {};
-    }
-    return size;
-}
-
-static bool decode(std::span<uint32_t> storage, std::string_view string, uint32_t replacement) {
-    size_t offset = 0;
-    return decode_impl(string, replacement, [&offset, &storage](auto cp) {
-        assert(offset < storage.size());
-        storage[offset] = cp;
-        offset++;
-    });
-}
-
-static Buffer encode(std::span<uint32_t const> storage) {
-    Buffer result;
-    // Some random heuristic to make less allocations
-    result.ensure_capacity(storage.size() * 1.1);
-    for (auto codepoint : storage) {
-        if (codepoint < 0x80) {
-            result.append(codepoint);
-        }
-        else if (codepoint < 0x800) {
-            result.append(0b1100'0000 | ((codepoint & 0b11111'000000) >> 6));
-            result.append(0b1000'0000 | ((codepoint & 0b111111)));
-        }
-        else if (codepoint < 0x10000) {
-            result.append(0b1110'0000 | ((codepoint & 0b1111'000000'000000) >> 12));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000) >> 6));
-            result.append(0b1000'0000 | ((codepoint & 0b111111)));
-        }
-        else if (codepoint < 0x200000) {
-            result.append(0b1111'0000 | ((codepoint & 0b1110'000000'000000'000000) >> 18));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000'000000) >> 12));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000) >> 6));
-            result.append(0b1000'0000 | ((codepoint & 0b111111)));
-        }
-        else if (codepoint < 0x4000000) {
-            result.append(0b1111'1000 | ((codepoint & 0b1100'000000'000000'000000'000000) >> 24));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000'000000'000000) >> 18));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000'000000) >> 12));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000) >> 6));
-            result.append(0b1000'0000 | ((codepoint & 0b111111)));
-        }
-        else {
-            result.append(0b1111'1100 | ((codepoint & 0b1000'000000'000000'000000'000000'000000) >> 30));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000'000000'000000'000000) >> 24));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000'000000'000000) >> 18));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000'000000) >> 12));
-            result.append(0b1000'0000 | ((codepoint & 0b111111'000000) >> 6));
-            result.append(0b1000'0000 | ((codepoint & 0b111111)));
-        }
-    }
-    return result;
-}
-
-}
-
 UString::UString(std::string_view string, Encoding encoding, uint32_t replacement) {
     switch (encoding) {
     case Encoding::ASCII:
@@ -217,12 +164,12 @@ UString::UString(std::string_view string, Encoding encoding, uint32_t replacemen
         std::copy(string.begin(), string.end(), m_storage);
         break;
     case Encoding::Utf8: {
-        auto size = Utf8::strlen(string);
-        if (!size) {
-            size = 0;
-        }
-        reallocate(*size);
-        Utf8::decode({ m_storage, m_size }, string, replacement);
+        // Decoding never produces more codepoints than there are bytes, so
+        // decode into a buffer of that size and shrink it to what was actually
+        // decoded. This is exact for ASCII and avoids a separate length pass.
+        reallocate(string.size());
+        auto result = Utf8::decode({ m_storage, m_size }, string, replacement);
+        reallocate(result.codepoints);
         break;
     }
     }
@@ -235,37 +182,54 @@ UString::UString(std::span<uint8_t const> data, Encoding encoding, uint32_t repl
 ErrorOr<UString, UString::DecodingErrorTag> UString::decode(std::span<uint8_t const> data, Encoding) {
     std::string_view data_sv { reinterpret_cast<char const*>(data.data()), data.size() };
     UString string;
-    auto size = Utf8::strlen(data_sv);
-    if (!size) {
+    string.reallocate(data_sv.size());
+    auto result = Utf8::decode({ string.m_storage, string.m_size }, data_sv);
+    if (!result.valid) {
         return UString::DecodingError;
     }
-    string.reallocate(*size);
-    [[maybe_unused]] bool r = Utf8::decode({ string.m_storage, string.m_size }, data_sv, 0xfffd);
-    assert(r);
+    string.reallocate(result.codepoints);
     return string;
 }
 
-Buffer UString::encode_buffer(Encoding encoding) const {
+// Both encodings compute the exact output size first so that the result is
+// allocated once and written in place.
+static size_t encoded_size(std::span<uint32_t const> codepoints, UString::Encoding encoding) {
     switch (encoding) {
-    case Encoding::ASCII: {
-        Buffer str;
-        for (auto cp : span()) {
+    case UString::Encoding::ASCII:
+        return std::count_if(codepoints.begin(), codepoints.end(), [](uint32_t cp) { return cp <= 0x7f; });
+    case UString::Encoding::Utf8:
+        return Utf8::encoded_length(codepoints);
+    }
+    ESSA_UNREACHABLE;
+}
+
+static void encode_into(std::span<uint8_t> output, std::span<uint32_t const> codepoints, UString::Encoding encoding) {
+    switch (encoding) {
+    case UString::Encoding::ASCII: {
+        size_t offset = 0;
+        for (auto cp : codepoints) {
             if (cp > 0x7f)
                 continue;
-            str.append(cp);
+            output[offset++] = cp;
         }
-        return str;
-    }
-    case Encoding::Utf8: {
-        return Utf8::encode(span());
+        return;
     }
+    case UString::Encoding::Utf8:
+        Utf8::encode(output, codepoints);
+        return;
     }
-    return Buffer();
 }
 
-std::string UString::encode(Encoding e) const {
-    Buffer encoded = encode_buffer(e);
-    return std::string { reinterpret_cast<char const*>(encoded.span().data()), encoded.size() };
+Buffer UString::encode_buffer(Encoding encoding) const {
+    auto result = Buffer::uninitialized(encoded_size(span(), encoding));
+    encode_into(result.span(), span(), encoding);
+    return result;
+}
+
+std::string UString::encode(Encoding encoding) const {
+    std::string result(encoded_size(span(), encoding), '\0');
+    encode_into({ reinterpret_cast<uint8_t*>(result.data()), result.size() }, span(), encoding);
+    return result;
 }
 
 uint32_t UString::at(size_t p) const {
@@ -280,33 +244,21 @@ UString UString::substring(size_t start) const {
 UString UString::substring(size_t start, size_t size) const {
     assert(start + size <= m_size);
     UString result;
-    result.reallocate(size);
-    if (m_storage)
-        std::copy(m_storage + start, m_storage + start + size, result.m_storage);
+    result.share_storage_with(*this, start, size);
     return result;
 }
 
 std::optional<size_t> UString::find(UString const& needle, size_t start) const {
     assert(start <= m_size);
-    for (size_t s = start; s < m_size; s++) {
-        if (m_storage[s] == needle.at(0)) {
-            bool found = true;
-            for (size_t t = s; t - s < needle.m_size; t++) {
-                if (t == m_size) {
-                    found = false;
-                    break;
-                }
-                if (m_storage[t] != needle.at(t - s)) {
-                    found = false;
-                    break;
-                }
-            }
-            if (found) {
-                return s;
-            }
-        }
-    }
-    return {};
+    return UStringSearcher { needle.span() }.find(span(), start);
+}
+
+std::optional<size_t> UString::rfind(UString const& needle, std::optional<size_t> end) const {
+    return UStringSearcher { needle.span() }.rfind(span(), end);
+}
+
+std::vector<size_t> UString::find_all(UString const& needle) const {
+    return UStringSearcher { needle.span() }.find_all(span());
 }
 
 std::optional<size_t> UString::find_one_of(std::initializer_list<uint32_t> codepoints, size_t start) const {
@@ -324,6 +276,13 @@ UString UString::erase(size_t start, size_t size) const {
         size = m_size - start;
     }
     // std::cout << "erase " << start << " +" << size << " from US[" << m_size << "]" << std::endl;
+    // Erasing from either end leaves a substring, which doesn't need a copy.
+    if (start == 0) {
+        return substring(size);
+    }
+    if (start + size == m_size) {
+        return substring(0, start);
+    }
     UString result;
     result.reallocate(m_size - size);
     if (m_storage) {
@@ -372,21 +331,76 @@ bool UString::starts_with(UString other) const {
 }
 
 void UString::reallocate(size_t size) {
-    auto old_storage = m_storage;
-    if (size > 0) {
-        auto old_size = m_size;
+    // Shared storage must be copied even if the size doesn't change.
+    if (size == m_size && !is_sharing_storage()) {
+        return;
+    }
+    UString result;
+    result.m_size = size;
+    if (size > InlineCapacity) {
+        result.m_block = Storage::create(size);
+        result.m_storage = result.m_block->data();
+    }
+    else if (size > 0) {
+        result.m_storage = result.m_inline;
+    }
+    if (m_storage) {
+        std::copy(m_storage, m_storage + std::min(size, m_size), result.m_storage);
+    }
+    *this = std::move(result);
+    // std::cout << __PRETTY_FUNCTION__ << " with size = " << size << " result = " << dump() << std::endl;
+}
 
-        m_storage = new uint32_t[size];
-        if (old_storage) {
-            std::copy(old_storage, old_storage + std::min(size, old_size), m_storage);
-        }
+void UString::compact() {
+    if (!has_heap_storage() || m_block->size == m_size) {
+        return;
+    }
+    // Detach from the (possibly much bigger) storage of a parent string.
+    UString copy { span() };
+    *this = std::move(copy);
+}
+
+bool UString::is_sharing_storage() const {
+    return has_heap_storage() && m_block->ref_count.load(std::memory_order_relaxed) > 1;
+}
+
+void UString::free_storage() {
+    if (has_heap_storage()) {
+        m_block->unref();
+    }
+    m_storage = nullptr;
+    m_size = 0;
+}
+
+void UString::take_storage_from(UString& other) {
+    if (other.is_inline()) {
+        std::copy(other.m_inline, other.m_inline + other.m_size, m_inline);
+        m_storage = m_inline;
+    }
+    else {
+        m_storage = other.m_storage;
+        m_block = other.m_block;
+    }
+    m_size = other.m_size;
+    other.m_storage = nullptr;
+    other.m_size = 0;
+}
+
+void UString::share_storage_with(UString const& other, size_t start, size_t size) {
+    assert(!m_storage);
+    if (size == 0) {
+        return;
+    }
+    if (size <= InlineCapacity) {
+        std::copy(other.m_storage + start, other.m_storage + start + size, m_inline);
+        m_storage = m_inline;
     }
     else {
-        m_storage = nullptr;
+        m_block = other.m_block;
+        m_block->ref();
+        m_storage = other.m_storage + start;
     }
-    delete[] old_storage;
     m_size = size;
-    // std::cout << __PRETTY_FUNCTION__ << " with size = " << size << " result = " << dump() << std::endl;
 }
 
 std::string UString::dump() const {
@@ -396,7 +410,7 @@ std::string UString::dump() const {
         oss << "U+" << std::hex << std::setfill('0') << std::setw(4) << cp << std::dec << " ";
     }
     oss << " (encoded to ";
-    auto encoded = Utf8::encode(span());
+    auto encoded = encode_buffer();
     for (auto ch : encoded) {
         oss << std::hex << ((uint16_t)ch & 0xff) << std::dec << " ";
     }
@@ -477,6 +491,12 @@ bool UString::operator==(UString const& other) const {
 }
 
 UString operator+(UString const& lhs, UString const& rhs) {
+    if (rhs.is_empty()) {
+        return lhs;
+    }
+    if (lhs.is_empty()) {
+        return rhs;
+    }
     UString result;
     result.reallocate(lhs.m_size + rhs.m_size);
     std::copy(lhs.m_storage, lhs.m_storage + lhs.m_size, result.m_storage);
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "Error.hpp"
+#include "UStringSearcher.hpp"
 #include <compare>
 #include <cstdint>
+#include <memory_resource>
 #include <optional>
 #include <ostream>
 #include <span>
@@ -19,14 +21,20 @@ class Buffer;
 // (because why is should be, you have size and this is sufficient
 // in MODERN languages like C++ :^))
 // It is immutable like in JS or Python.
+// Short strings (up to InlineCapacity codepoints) are stored inline in the
+// object itself and don't allocate. Longer strings share reference-counted
+// storage between copies and substrings, so these are O(1). Storage is
+// allocated from current_memory_resource().
 class UString {
 public:
     UString() = default;
     ~UString();
     UString(UString const& other);
     UString& operator=(UString const& other);
-    UString(UString&& other);
-    UString& operator=(UString&& other);
+    UString(UString&& other) noexcept;
+    UString& operator=(UString&& other) noexcept;
+
+    static constexpr size_t InlineCapacity = 4;
 
     static UString take_ownership(std::span<uint32_t const>);
 
@@ -83,7 +91,22 @@ public:
     [[nodiscard]] UString substring(size_t start) const;
 
     [[nodiscard]] UString substring(size_t start, size_t size) const;
+    // Make this string own storage of exactly its size. Substrings keep the
+    // whole storage of their parent alive, use this to release it when a
+    // small substring of a big string is kept for long.
+    void compact();
+
+    // True if storage is shared with another string (e.g it is a copy or
+    // a substring).
+    [[nodiscard]] bool is_sharing_storage() const;
+
+    // Searching is linear in haystack + needle size. When searching for
+    // the same needle many times, use UStringSearcher directly.
     [[nodiscard]] std::optional<size_t> find(UString const& needle, size_t start = 0) const;
+    // Last occurrence of needle that ends at or before `end` (end of string by default).
+    [[nodiscard]] std::optional<size_t> rfind(UString const& needle, std::optional<size_t> end = {}) const;
+    // All non-overlapping occurrences of needle.
+    [[nodiscard]] std::vector<size_t> find_all(UString const& needle) const;
     [[nodiscard]] std::optional<size_t> find_one_of(std::initializer_list<uint32_t>, size_t start = 0) const;
     [[nodiscard]] UString erase(size_t start, size_t size = 1) const;
     [[nodiscard]] UString insert(UString other, size_t where) const;
@@ -93,9 +116,11 @@ public:
 
     template<class Callback>
     void for_each_split(UString const& splitter, Callback&& callback) const {
+        assert(!splitter.is_empty());
+        UStringSearcher searcher { splitter.span() };
         size_t index = 0;
         while (true) {
-            auto next = find(splitter, index);
+            auto next = searcher.find(span(), index);
             if (!next.has_value()) {
                 next = size();
             }
@@ -104,7 +129,7 @@ public:
             callback({ m_storage + index, *next - index });
             if (next == size())
                 break;
-            index = *next + 1;
+            index = *next + splitter.size();
         }
     }
 
@@ -125,12 +150,31 @@ public:
 
 private:
     friend UString operator+(UString const& lhs, UString const& rhs);
+    friend class UStringBuilder;
 
+    struct Storage;
+
+    // Adopt an array of `capacity` codepoints allocated from `resource`.
+    static UString take_ownership(uint32_t* array, size_t size, std::pmr::memory_resource* resource, size_t capacity);
+
+    // Change size of the string, keeping codepoints that still fit. This
+    // always gives the string its own (not shared) storage, so it may be
+    // written to.
     void reallocate(size_t);
+    void free_storage();
+    void take_storage_from(UString&);
+    void share_storage_with(UString const&, size_t start, size_t size);
+    bool is_inline() const { return m_storage == m_inline; }
+    bool has_heap_storage() const { return m_storage && !is_inline(); }
     std::string dump() const;
 
+    // Points either to m_inline or into m_block's data.
     uint32_t* m_storage {};
     size_t m_size {};
+    union {
+        uint32_t m_inline[InlineCapacity];
+        Storage* m_block;
+    };
 };
 
 template<typename T>
@@ -1,10 +1,16 @@
 #include "UStringBuilder.hpp"
-#include <fmt/core.h>
+
+#include "MemoryResource.hpp"
+#include "Utf8.hpp"
+#include <algorithm>
+#include <fmt/format.h>
 
 namespace Util {
 
 UStringBuilder::~UStringBuilder() {
-    delete[] m_storage;
+    if (m_storage) {
+        m_resource->deallocate(m_storage, m_capacity * sizeof(uint32_t), alignof(uint32_t));
+    }
 }
 
 void UStringBuilder::reserve(size_t count) {
@@ -13,7 +19,14 @@ void UStringBuilder::reserve(size_t count) {
     }
 }
 
-void UStringBuilder::append(UString str) {
+void UStringBuilder::ensure_capacity_for(size_t count) {
+    auto needed_capacity = m_size + count;
+    if (needed_capacity > m_capacity) {
+        reallocate(std::max({ needed_capacity, m_capacity * 2, size_t { 16 } }));
+    }
+}
+
+void UStringBuilder::append(UString const& str) {
     append(str.span());
 }
 
@@ -25,16 +38,27 @@ void UStringBuilder::append(std::span<uint32_t const> codepoints) {
     if (codepoints.empty()) {
         return;
     }
-    auto needed_capacity = m_size + codepoints.size();
-    if (needed_capacity > m_capacity) {
-        reallocate(needed_capacity);
-    }
+    ensure_capacity_for(codepoints.size());
     std::copy(codepoints.begin(), codepoints.end(), m_storage + m_size);
     m_size += codepoints.size();
 }
 
+void UStringBuilder::append(std::string_view string, uint32_t replacement) {
+    if (string.empty()) {
+        return;
+    }
+    // Every codepoint takes at least 1 byte.
+    ensure_capacity_for(string.size());
+    auto result = Utf8::decode({ m_storage + m_size, string.size() }, string, replacement);
+    m_size += result.codepoints;
+}
+
 void UStringBuilder::vappendff(fmt::string_view fmtstr, fmt::format_args args) {
-    append(UString { fmt::vformat(fmtstr, args) });
+    // Short results are formatted on stack, so there is no allocation
+    // other than for growing the builder.
+    fmt::memory_buffer buffer;
+    fmt::vformat_to(std::back_inserter(buffer), fmtstr, args);
+    append(std::string_view { buffer.data(), buffer.size() });
 }
 
 UString UStringBuilder::build() const {
@@ -42,7 +66,10 @@ UString UStringBuilder::build() const {
 }
 
 UString UStringBuilder::release_string() {
-    auto string = UString::take_ownership(codepoints());
+    if (!m_storage) {
+        return {};
+    }
+    auto string = UString::take_ownership(m_storage, m_size, m_resource, m_capacity);
     m_storage = nullptr;
     m_capacity = 0;
     m_size = 0;
@@ -52,18 +79,25 @@ UString UStringBuilder::release_string() {
 void UStringBuilder::reallocate(size_t new_capacity) {
     auto old_storage = m_storage;
     if (new_capacity > 0) {
-        auto old_capacity = m_capacity;
-
-        m_storage = new uint32_t[new_capacity];
+        m_storage = static_cast<uint32_t*>(resource()->allocate(new_capacity * sizeof(uint32_t), alignof(uint32_t)));
         if (old_storage) {
-            std::copy(old_storage, old_storage + std::min(new_capacity, old_capacity), m_storage);
+            std::copy(old_storage, old_storage + std::min(new_capacity, m_size), m_storage);
         }
     }
     else {
         m_storage = nullptr;
     }
-    delete[] old_storage;
+    if (old_storage) {
+        m_resource->deallocate(old_storage, m_capacity * sizeof(uint32_t), alignof(uint32_t));
+    }
     m_capacity = new_capacity;
 }
 
+std::pmr::memory_resource* UStringBuilder::resource() {
+    if (!m_resource) {
+        m_resource = current_memory_resource();
+    }
+    return m_resource;
+}
+
 }
@@ -3,12 +3,20 @@
 #include "UString.hpp"
 #include <cstddef>
 #include <cstdint>
+#include <memory_resource>
+#include <string_view>
 
 namespace Util {
 
 class UStringBuilder {
 public:
     UStringBuilder() = default;
+
+    // Allocate from `resource` instead of current_memory_resource(). This
+    // is also used for the released string.
+    explicit UStringBuilder(std::pmr::memory_resource* resource)
+        : m_resource(resource) { }
+
     UStringBuilder(UStringBuilder const&) = delete;
     ~UStringBuilder();
 
@@ -16,10 +24,20 @@ public:
     // than current capacity is ignored. This doesn't initialize the data.
     void reserve(size_t);
 
-    void append(UString);
+    // Appends are amortized O(1), the buffer grows geometrically.
+    void append(UString const&);
     void append(uint32_t);
     void append(std::span<uint32_t const>);
 
+    // Decode UTF-8 directly into the buffer. Invalid sequences are
+    // replaced with `replacement`.
+    void append(std::string_view, uint32_t replacement = 0xfffd);
+
+    template<size_t S>
+    void append(char const (&string)[S]) {
+        append(std::string_view { string, S - 1 });
+    }
+
     template<class... Args>
     void appendff(fmt::format_string<Args...> fmtstr, Args&&... args) {
         vappendff(fmtstr, fmt::make_format_args(args...));
@@ -37,14 +55,23 @@ public:
     std::span<uint32_t const> codepoints() const { return { m_storage, m_size }; }
 
 private:
+    // Make sure that `count` more codepoints fit in the buffer, growing
+    // it geometrically if they don't.
+    void ensure_capacity_for(size_t count);
+
     // Allocate a new array with specified capacity, copying previous data
     // that fits that new array. This doesn't touch size.
     void reallocate(size_t capacity);
 
+    std::pmr::memory_resource* resource();
+
     uint32_t* m_storage = nullptr;
     size_t m_capacity = 0;
 
     size_t m_size = 0;
+
+    // Null until the first allocation if not given explicitly.
+    std::pmr::memory_resource* m_resource = nullptr;
 };
 
 }
@@ -0,0 +1,338 @@
+#include "UStringRope.hpp"
+
+#include "Config.hpp"
+#include "UStringBuilder.hpp"
+
+#include <cassert>
+#include <iterator>
+#include <utility>
+
+namespace Util {
+
+// Nodes are split when they grow over the maximum and merged with a
+// neighbour when they shrink below the minimum. The root is exempt from the
+// minimum.
+static constexpr size_t MaxLeafSize = 1024;
+static constexpr size_t MinLeafSize = MaxLeafSize / 4;
+static constexpr size_t MaxChildren = 16;
+static constexpr size_t MinChildren = MaxChildren / 4;
+
+UStringRope::Node::Ptr UStringRope::Node::create_leaf(UString text) {
+    auto leaf = std::make_unique<Node>();
+    leaf->text = std::move(text);
+    leaf->update();
+    return leaf;
+}
+
+std::vector<UStringRope::Node::Ptr> UStringRope::Node::create_leaves(UString const& text) {
+    auto count = std::max<size_t>(1, (text.size() + MaxLeafSize - 1) / MaxLeafSize);
+    std::vector<Ptr> leaves;
+    leaves.reserve(count);
+    size_t offset = 0;
+    for (size_t s = 0; s < count; s++) {
+        // Substrings share storage with the text, so this doesn't copy.
+        auto size = text.size() / count + (s < text.size() % count ? 1 : 0);
+        leaves.push_back(create_leaf(text.substring(offset, size)));
+        offset += size;
+    }
+    return leaves;
+}
+
+std::vector<UStringRope::Node::Ptr> UStringRope::Node::create_parents(std::vector<Ptr> nodes) {
+    auto count = std::max<size_t>(1, (nodes.size() + MaxChildren - 1) / MaxChildren);
+    std::vector<Ptr> parents;
+    parents.reserve(count);
+    auto it = nodes.begin();
+    for (size_t s = 0; s < count; s++) {
+        auto size = nodes.size() / count + (s < nodes.size() % count ? 1 : 0);
+        auto parent = std::make_unique<Node>();
+        parent->is_leaf = false;
+        parent->children.assign(std::make_move_iterator(it), std::make_move_iterator(it + size));
+        parent->update();
+        parents.push_back(std::move(parent));
+        it += size;
+    }
+    return parents;
+}
+
+std::vector<UStringRope::Node::Ptr> UStringRope::Node::merge(Ptr left, Ptr right) {
+    if (left->is_leaf) {
+        return create_leaves(left->text + right->text);
+    }
+    auto children = std::move(left->children);
+    children.insert(children.end(), std::make_move_iterator(right->children.begin()), std::make_move_iterator(right->children.end()));
+    return create_parents(std::move(children));
+}
+
+void UStringRope::Node::update() {
+    if (is_leaf) {
+        size = text.size();
+        newlines = std::count(text.begin(), text.end(), '\n');
+        return;
+    }
+    size = 0;
+    newlines = 0;
+    for (auto const& child : children) {
+        size += child->size;
+        newlines += child->newlines;
+    }
+}
+
+bool UStringRope::Node::is_underfull() const {
+    return is_leaf ? size < MinLeafSize : children.size() < MinChildren;
+}
+
+void UStringRope::Node::rebalance_children() {
+    size_t index = 0;
+    while (index < children.size() && children.size() > 1) {
+        if (!children[index]->is_underfull()) {
+            index++;
+            continue;
+        }
+        // Merged node may still be underfull, so check it again.
+        index = index + 1 < children.size() ? index : index - 1;
+        auto merged = merge(std::move(children[index]), std::move(children[index + 1]));
+        children.erase(children.begin() + index, children.begin() + index + 2);
+        children.insert(children.begin() + index, std::make_move_iterator(merged.begin()), std::make_move_iterator(merged.end()));
+    }
+}
+
+std::vector<UStringRope::Node::Ptr> UStringRope::Node::insert(size_t where, UString const& string) {
+    if (is_leaf) {
+        auto new_text = text.insert(string, where);
+        if (new_text.size() <= MaxLeafSize) {
+            text = std::move(new_text);
+            update();
+            return {};
+        }
+        auto leaves = create_leaves(new_text);
+        text = std::move(leaves.front()->text);
+        update();
+        leaves.erase(leaves.begin());
+        return leaves;
+    }
+
+    size_t index = 0;
+    while (index + 1 < children.size() && where > children[index]->size) {
+        where -= children[index]->size;
+        index++;
+    }
+    auto siblings = children[index]->insert(where, string);
+    children.insert(children.begin() + index + 1, std::make_move_iterator(siblings.begin()), std::make_move_iterator(siblings.end()));
+    if (children.size() <= MaxChildren) {
+        update();
+        return {};
+    }
+    auto parents = create_parents(std::move(children));
+    children = std::move(parents.front()->children);
+    update();
+    parents.erase(parents.begin());
+    return parents;
+}
+
+void UStringRope::Node::erase(size_t start, size_t count) {
+    if (is_leaf) {
+        text = text.erase(start, count);
+        update();
+        return;
+    }
+
+    size_t index = 0;
+    while (index < children.size() && count > 0) {
+        auto& child = *children[index];
+        if (start >= child.size) {
+            start -= child.size;
+            index++;
+            continue;
+        }
+        auto erased = std::min(count, child.size - start);
+        if (erased == child.size) {
+            children.erase(children.begin() + index);
+        }
+        else {
+            child.erase(start, erased);
+            index++;
+        }
+        count -= erased;
+        start = 0;
+    }
+    rebalance_children();
+    update();
+}
+
+void UStringRope::Node::append_range(size_t start, size_t count, UStringBuilder& builder) const {
+    if (is_leaf) {
+        builder.append(text.span().subspan(start, count));
+        return;
+    }
+    for (auto const& child : children) {
+        if (count == 0) {
+            break;
+        }
+        if (start >= child->size) {
+            start -= child->size;
+            continue;
+        }
+        auto appended = std::min(count, child->size - start);
+        child->append_range(start, appended, builder);
+        count -= appended;
+        start = 0;
+    }
+}
+
+UStringRope::UStringRope()
+    : m_root(Node::create_leaf({})) {
+}
+
+UStringRope::UStringRope(UString const& string) {
+    auto nodes = Node::create_leaves(string);
+    while (nodes.size() > 1) {
+        nodes = Node::create_parents(std::move(nodes));
+    }
+    m_root = std::move(nodes.front());
+}
+
+UStringRope::~UStringRope() = default;
+
+UStringRope::UStringRope(UStringRope&& other)
+    : m_root(std::exchange(other.m_root, Node::create_leaf({}))) {
+}
+
+UStringRope& UStringRope::operator=(UStringRope&& other) {
+    if (this == &other) {
+        return *this;
+    }
+    m_root = std::exchange(other.m_root, Node::create_leaf({}));
+    return *this;
+}
+
+size_t UStringRope::size() const {
+    return m_root->size;
+}
+
+uint32_t UStringRope::at(size_t index) const {
+    assert(index < size());
+    Node const* node = m_root.get();
+    while (!node->is_leaf) {
+        for (auto const& child : node->children) {
+            if (index < child->size) {
+                node = child.get();
+                break;
+            }
+            index -= child->size;
+        }
+    }
+    return node->text.at(index);
+}
+
+size_t UStringRope::line_count() const {
+    return m_root->newlines + 1;
+}
+
+size_t UStringRope::line_start(size_t line) const {
+    assert(line < line_count());
+    if (line == 0) {
+        return 0;
+    }
+
+    // Find the line-th newline, skipping subtrees that have less of them.
+    size_t position = 0;
+    Node const* node = m_root.get();
+    while (!node->is_leaf) {
+        for (auto const& child : node->children) {
+            if (line <= child->newlines) {
+                node = child.get();
+                break;
+            }
+            line -= child->newlines;
+            position += child->size;
+        }
+    }
+    for (size_t s = 0; s < node->text.size(); s++) {
+        if (node->text.at(s) == '\n' && --line == 0) {
+            return position + s + 1;
+        }
+    }
+    ESSA_UNREACHABLE;
+}
+
+UString UStringRope::line(size_t line) const {
+    auto start = line_start(line);
+    auto end = line + 1 < line_count() ? line_start(line + 1) - 1 : size();
+    return substring(start, end - start);
+}
+
+void UStringRope::insert(UString const& string, size_t where) {
+    assert(where <= size());
+    if (string.is_empty()) {
+        return;
+    }
+    auto siblings = m_root->insert(where, string);
+
+    // The root overflowed, so the tree grows by one level (or more if a lot
+    // of text was inserted).
+    while (!siblings.empty()) {
+        siblings.insert(siblings.begin(), std::move(m_root));
+        auto parents = Node::create_parents(std::move(siblings));
+        m_root = std::move(parents.front());
+        parents.erase(parents.begin());
+        siblings = std::move(parents);
+    }
+}
+
+void UStringRope::erase(size_t start, size_t count) {
+    assert(start <= size());
+    count = std::min(count, size() - start);
+    if (count == 0) {
+        return;
+    }
+    m_root->erase(start, count);
+    while (!m_root->is_leaf && m_root->children.size() == 1) {
+        m_root = std::move(m_root->children.front());
+    }
+    if (!m_root->is_leaf && m_root->children.empty()) {
+        m_root = Node::create_leaf({});
+    }
+}
+
+UString UStringRope::substring(size_t start, size_t count) const {
+    assert(start + count <= size());
+    if (count == 0) {
+        return {};
+    }
+
+    // If the range is in a single leaf, share its storage instead of copying.
+    Node const* node = m_root.get();
+    while (!node->is_leaf) {
+        Node const* next = nullptr;
+        auto local_start = start;
+        for (auto const& child : node->children) {
+            if (local_start < child->size) {
+                if (local_start + count <= child->size) {
+                    next = child.get();
+                }
+                break;
+            }
+            local_start -= child->size;
+        }
+        if (!next) {
+            break;
+        }
+        node = next;
+        start = local_start;
+    }
+    if (node->is_leaf) {
+        return node->text.substring(start, count);
+    }
+
+    UStringBuilder builder;
+    builder.reserve(count);
+    node->append_range(start, count, builder);
+    return builder.release_string();
+}
+
+UString UStringRope::to_string() const {
+    return substring(0, size());
+}
+
+}
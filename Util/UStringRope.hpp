@@ -0,0 +1,136 @@
+#pragma once
+
+#include "NonCopyable.hpp"
+#include "UString.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace Util {
+
+class UStringBuilder;
+
+// Text optimized for editing, e.g in text fields. It is a B-tree of UString
+// chunks, so insert, erase and looking up a codepoint or line are O(log n)
+// (plus size of the inserted/returned text), as opposed to O(n) for UString.
+// Every node caches size and newline count of its subtree, so lines can be
+// found without scanning the text.
+class UStringRope : public NonCopyable {
+public:
+    UStringRope();
+    explicit UStringRope(UString const&);
+    ~UStringRope();
+    UStringRope(UStringRope&&);
+    UStringRope& operator=(UStringRope&&);
+
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] bool is_empty() const { return size() == 0; }
+    [[nodiscard]] uint32_t at(size_t) const;
+
+    // Count of newlines + 1. Note that for_each_line() skips the last line
+    // if it is empty, like UString::for_each_line().
+    [[nodiscard]] size_t line_count() const;
+
+    // Index of the first codepoint of a line.
+    [[nodiscard]] size_t line_start(size_t line) const;
+
+    // Contents of a line, without the newline.
+    [[nodiscard]] UString line(size_t line) const;
+
+    void insert(UString const&, size_t where);
+    void erase(size_t start, size_t size = 1);
+
+    [[nodiscard]] UString substring(size_t start, size_t size) const;
+    [[nodiscard]] UString to_string() const;
+
+    // Call callback with every chunk of the text, in order.
+    template<class Callback>
+    void for_each_chunk(Callback&& callback) const {
+        for_each_chunk_impl(*m_root, callback);
+    }
+
+    // Same as UString::for_each_line(). Lines that are in a single chunk are
+    // passed without copying.
+    template<class Callback>
+    void for_each_line(Callback&& callback) const {
+        std::vector<uint32_t> pending;
+        for_each_chunk([&](std::span<uint32_t const> chunk) {
+            auto index = chunk.begin();
+            while (true) {
+                auto newline = std::find(index, chunk.end(), '\n');
+                if (newline == chunk.end()) {
+                    pending.insert(pending.end(), index, chunk.end());
+                    break;
+                }
+                if (pending.empty()) {
+                    callback(std::span<uint32_t const> { index, newline });
+                }
+                else {
+                    pending.insert(pending.end(), index, newline);
+                    callback(std::span<uint32_t const> { pending });
+                    pending.clear();
+                }
+                index = newline + 1;
+            }
+        });
+        if (!pending.empty() || is_empty()) {
+            callback(std::span<uint32_t const> { pending });
+        }
+    }
+
+private:
+    struct Node {
+        using Ptr = std::unique_ptr<Node>;
+
+        size_t size = 0;
+        size_t newlines = 0;
+
+        // Leaves store text, other nodes store children.
+        bool is_leaf = true;
+        UString text;
+        std::vector<Ptr> children;
+
+        static Ptr create_leaf(UString);
+
+        // Split text into leaves of (roughly) equal size.
+        static std::vector<Ptr> create_leaves(UString const&);
+
+        // Group nodes into parents with (roughly) equal child counts.
+        static std::vector<Ptr> create_parents(std::vector<Ptr>);
+
+        // Merge two neighbouring nodes of the same depth into one, or into
+        // two balanced ones if it would overflow.
+        static std::vector<Ptr> merge(Ptr, Ptr);
+
+        void update();
+        bool is_underfull() const;
+        void rebalance_children();
+
+        // Returns nodes that were split off this node because it overflowed.
+        // They must be inserted after it in the parent.
+        std::vector<Ptr> insert(size_t where, UString const&);
+        void erase(size_t start, size_t size);
+        void append_range(size_t start, size_t size, UStringBuilder&) const;
+    };
+
+    template<class Callback>
+    static void for_each_chunk_impl(Node const& node, Callback& callback) {
+        if (node.is_leaf) {
+            if (!node.text.is_empty()) {
+                callback(node.text.span());
+            }
+            return;
+        }
+        for (auto const& child : node.children) {
+            for_each_chunk_impl(*child, callback);
+        }
+    }
+
+    std::unique_ptr<Node> m_root;
+};
+
+}
@@ -0,0 +1,257 @@
+#include "UStringSearcher.hpp"
+
+#include "CpuFeatures.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <utility>
+
+#ifdef ESSA_ARCH_X86
+#    include <immintrin.h>
+#endif
+
+namespace Util {
+
+// Find next position `j` (starting from `start`) that may be an occurrence
+// of the needle, i.e where haystack[j] == first and haystack[j + m - 1] ==
+// last. Returns haystack size if there is no such position.
+using FindCandidateFunction = size_t (*)(uint32_t const* haystack, size_t n, size_t m, uint32_t first, uint32_t last, size_t start);
+
+static size_t find_candidate_scalar(uint32_t const* haystack, size_t n, size_t m, uint32_t first, uint32_t last, size_t start) {
+    for (size_t j = start; j + m <= n; j++) {
+        if (haystack[j] == first && haystack[j + m - 1] == last) {
+            return j;
+        }
+    }
+    return n;
+}
+
+#ifdef ESSA_ARCH_X86
+
+[[gnu::target("sse2")]] static size_t find_candidate_sse2(uint32_t const* haystack, size_t n, size_t m, uint32_t first, uint32_t last, size_t start) {
+    auto const first_v = _mm_set1_epi32(first);
+    auto const last_v = _mm_set1_epi32(last);
+    size_t j = start;
+    for (; j + m + 3 <= n; j += 4) {
+        auto first_eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(haystack + j)), first_v);
+        auto last_eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(haystack + j + m - 1)), last_v);
+        auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(first_eq, last_eq))));
+        if (mask != 0) {
+            return j + std::countr_zero(mask);
+        }
+    }
+    return find_candidate_scalar(haystack, n, m, first, last, j);
+}
+
+[[gnu::target("avx2")]] static size_t find_candidate_avx2(uint32_t const* haystack, size_t n, size_t m, uint32_t first, uint32_t last, size_t start) {
+    auto const first_v = _mm256_set1_epi32(first);
+    auto const last_v = _mm256_set1_epi32(last);
+    size_t j = start;
+    for (; j + m + 7 <= n; j += 8) {
+        auto first_eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(haystack + j)), first_v);
+        auto last_eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(haystack + j + m - 1)), last_v);
+        auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(first_eq, last_eq))));
+        if (mask != 0) {
+            return j + std::countr_zero(mask);
+        }
+    }
+    return find_candidate_scalar(haystack, n, m, first, last, j);
+}
+
+#endif
+
+static FindCandidateFunction select_find_candidate() {
+#ifdef ESSA_ARCH_X86
+    if (cpu_supports(CpuFeature::AVX2)) {
+        return find_candidate_avx2;
+    }
+    if (cpu_supports(CpuFeature::SSE2)) {
+        return find_candidate_sse2;
+    }
+#endif
+    return find_candidate_scalar;
+}
+
+// Accessors that allow running the same algorithm on reversed needle and
+// haystack, for rfind().
+struct Forward {
+    std::span<uint32_t const> data;
+    uint32_t operator()(ssize_t i) const { return data[i]; }
+};
+
+struct Backward {
+    std::span<uint32_t const> data;
+    uint32_t operator()(ssize_t i) const { return data[data.size() - 1 - i]; }
+};
+
+// Returns start of the maximal suffix (minus 1) and its period. If
+// `reversed_order` is true, the alphabet order is reversed.
+template<class Needle>
+static std::pair<ssize_t, ssize_t> maximal_suffix(Needle x, ssize_t m, bool reversed_order) {
+    ssize_t ms = -1;
+    ssize_t j = 0;
+    ssize_t k = 1;
+    ssize_t p = 1;
+    while (j + k < m) {
+        auto a = x(j + k);
+        auto b = x(ms + k);
+        if (reversed_order ? a > b : a < b) {
+            j += k;
+            k = 1;
+            p = j - ms;
+        }
+        else if (a == b) {
+            if (k != p) {
+                k++;
+            }
+            else {
+                j += p;
+                k = 1;
+            }
+        }
+        else {
+            ms = j;
+            j = ms + 1;
+            k = p = 1;
+        }
+    }
+    return { ms, p };
+}
+
+template<class Needle>
+static UStringSearcher::Factorization factorize(Needle x, ssize_t m) {
+    auto [i, p] = maximal_suffix(x, m, false);
+    auto [j, q] = maximal_suffix(x, m, true);
+    auto [critical_position, period] = i > j ? std::pair { i, p } : std::pair { j, q };
+
+    bool is_periodic = true;
+    for (ssize_t s = 0; s <= critical_position; s++) {
+        if (x(s) != x(s + period)) {
+            is_periodic = false;
+            break;
+        }
+    }
+    if (!is_periodic) {
+        // Any occurrence can only be shifted by at least this much.
+        period = std::max(critical_position + 1, m - critical_position - 1) + 1;
+    }
+    return { .critical_position = critical_position, .period = static_cast<size_t>(period), .is_periodic = is_periodic };
+}
+
+template<class Needle, class Haystack, class Prefilter>
+static std::optional<size_t> two_way(Needle x, ssize_t m, Haystack y, ssize_t n, UStringSearcher::Factorization const& f, ssize_t j, Prefilter prefilter) {
+    auto ell = f.critical_position;
+    auto period = static_cast<ssize_t>(f.period);
+
+    // Length of the prefix known to match after a shift by the period,
+    // minus 1. Only used for periodic needles.
+    ssize_t memory = -1;
+    while (j + m <= n) {
+        if (memory < 0) {
+            j = prefilter(j);
+            if (j + m > n) {
+                break;
+            }
+        }
+
+        // Match the right part of the needle.
+        auto i = std::max(ell, memory) + 1;
+        while (i < m && x(i) == y(i + j)) {
+            i++;
+        }
+        if (i < m) {
+            j += i - ell;
+            memory = -1;
+            continue;
+        }
+
+        // Match the left part of the needle.
+        i = ell;
+        while (i > memory && x(i) == y(i + j)) {
+            i--;
+        }
+        if (i <= memory) {
+            return j;
+        }
+        j += period;
+        if (f.is_periodic) {
+            memory = m - period - 1;
+        }
+    }
+    return {};
+}
+
+UStringSearcher::UStringSearcher(std::span<uint32_t const> needle)
+    : m_needle(needle) {
+    if (!needle.empty()) {
+        m_forward = factorize(Forward { needle }, needle.size());
+        m_backward = factorize(Backward { needle }, needle.size());
+    }
+}
+
+std::optional<size_t> UStringSearcher::find(std::span<uint32_t const> haystack, size_t start) const {
+    auto m = m_needle.size();
+    auto n = haystack.size();
+    if (start > n || m > n - start) {
+        return {};
+    }
+    if (m == 0) {
+        return start;
+    }
+
+    static FindCandidateFunction const find_candidate = select_find_candidate();
+    auto first = m_needle.front();
+    auto last = m_needle.back();
+    auto prefilter = [&](ssize_t j) -> ssize_t {
+        return find_candidate(haystack.data(), n, m, first, last, j);
+    };
+    if (m <= 2) {
+        // Prefilter already checks the whole needle.
+        auto candidate = static_cast<size_t>(prefilter(start));
+        if (candidate == n) {
+            return {};
+        }
+        return candidate;
+    }
+    return two_way(Forward { m_needle }, m, Forward { haystack }, n, m_forward, start, prefilter);
+}
+
+std::optional<size_t> UStringSearcher::rfind(std::span<uint32_t const> haystack, std::optional<size_t> end) const {
+    if (end) {
+        haystack = haystack.first(std::min(*end, haystack.size()));
+    }
+    auto m = m_needle.size();
+    auto n = haystack.size();
+    if (m > n) {
+        return {};
+    }
+    if (m == 0) {
+        return n;
+    }
+    auto no_prefilter = [](ssize_t j) { return j; };
+    auto position = two_way(Backward { m_needle }, m, Backward { haystack }, n, m_backward, 0, no_prefilter);
+    if (!position) {
+        return {};
+    }
+    return n - *position - m;
+}
+
+std::vector<size_t> UStringSearcher::find_all(std::span<uint32_t const> haystack) const {
+    std::vector<size_t> result;
+    if (m_needle.empty()) {
+        // Empty needle matches everywhere.
+        for (size_t s = 0; s <= haystack.size(); s++) {
+            result.push_back(s);
+        }
+        return result;
+    }
+    size_t start = 0;
+    while (auto position = find(haystack, start)) {
+        result.push_back(*position);
+        start = *position + m_needle.size();
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <sys/types.h>
+#include <vector>
+
+namespace Util {
+
+// Linear-time substring search (the Two-Way algorithm by Crochemore and
+// Perrin). The needle is preprocessed once in the constructor, so a single
+// searcher should be reused when searching for the same needle many times.
+// Forward searches additionally skip to candidate positions by comparing
+// first and last codepoint of the needle with SIMD.
+//
+// The needle is not copied, it must outlive the searcher.
+class UStringSearcher {
+public:
+    explicit UStringSearcher(std::span<uint32_t const> needle);
+
+    std::span<uint32_t const> needle() const { return m_needle; }
+
+    // Index of the first occurrence of needle that starts at or after `start`.
+    std::optional<size_t> find(std::span<uint32_t const> haystack, size_t start = 0) const;
+
+    // Index of the last occurrence of needle that ends at or before `end`.
+    std::optional<size_t> rfind(std::span<uint32_t const> haystack, std::optional<size_t> end = {}) const;
+
+    // Indices of all non-overlapping occurrences of needle, in order.
+    std::vector<size_t> find_all(std::span<uint32_t const> haystack) const;
+
+    // Critical factorization of the needle.
+    struct Factorization {
+        // Last index of the left part (may be -1 if it's empty).
+        ssize_t critical_position = -1;
+        size_t period = 1;
+
+        // True if the left part is a suffix of the right part's prefix of
+        // length `period`, i.e the whole needle has period `period`.
+        bool is_periodic = false;
+    };
+
+private:
+    std::span<uint32_t const> m_needle;
+    Factorization m_forward;
+    Factorization m_backward;
+};
+
+}
@@ -0,0 +1,396 @@
+#include "Utf8.hpp"
+
+#include "CpuFeatures.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+#ifdef ESSA_ARCH_X86
+#    include <immintrin.h>
+#endif
+
+namespace Util::Utf8 {
+
+// Widen as many ASCII bytes as possible, in blocks. Returns count of bytes
+// (and codepoints) written. Anything that doesn't fit in a block is left for
+// the scalar loop.
+using WidenAsciiFunction = size_t (*)(uint8_t const* input, size_t size, uint32_t* output);
+
+static size_t widen_ascii_scalar(uint8_t const*, size_t, uint32_t*) {
+    return 0;
+}
+
+// Narrow as many ASCII codepoints as possible, in blocks. Returns count of
+// codepoints (and bytes) written.
+using NarrowAsciiFunction = size_t (*)(uint32_t const* input, size_t size, uint8_t* output);
+
+static size_t narrow_ascii_scalar(uint32_t const*, size_t, uint8_t*) {
+    return 0;
+}
+
+using EncodedLengthFunction = size_t (*)(std::span<uint32_t const> codepoints);
+
+#ifdef ESSA_ARCH_X86
+
+[[gnu::target("sse2")]] static size_t widen_ascii_sse2(uint8_t const* input, size_t size, uint32_t* output) {
+    size_t s = 0;
+    auto const zero = _mm_setzero_si128();
+    for (; s + 16 <= size; s += 16) {
+        auto bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input + s));
+        if (_mm_movemask_epi8(bytes) != 0) {
+            break;
+        }
+        auto low = _mm_unpacklo_epi8(bytes, zero);
+        auto high = _mm_unpackhi_epi8(bytes, zero);
+        auto out = reinterpret_cast<__m128i*>(output + s);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(high, zero));
+    }
+    return s;
+}
+
+[[gnu::target("avx2")]] static size_t widen_ascii_avx2(uint8_t const* input, size_t size, uint32_t* output) {
+    size_t s = 0;
+    for (; s + 32 <= size; s += 32) {
+        auto bytes = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + s));
+        if (_mm256_movemask_epi8(bytes) != 0) {
+            break;
+        }
+        auto low = _mm256_castsi256_si128(bytes);
+        auto high = _mm256_extracti128_si256(bytes, 1);
+        auto out = reinterpret_cast<__m256i*>(output + s);
+        _mm256_storeu_si256(out + 0, _mm256_cvtepu8_epi32(low));
+        _mm256_storeu_si256(out + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+        _mm256_storeu_si256(out + 2, _mm256_cvtepu8_epi32(high));
+        _mm256_storeu_si256(out + 3, _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+    }
+    return s;
+}
+
+[[gnu::target("sse2")]] static size_t narrow_ascii_sse2(uint32_t const* input, size_t size, uint8_t* output) {
+    size_t s = 0;
+    auto const non_ascii_mask = _mm_set1_epi32(~0x7f);
+    for (; s + 16 <= size; s += 16) {
+        auto in = reinterpret_cast<__m128i const*>(input + s);
+        auto a = _mm_loadu_si128(in + 0);
+        auto b = _mm_loadu_si128(in + 1);
+        auto c = _mm_loadu_si128(in + 2);
+        auto d = _mm_loadu_si128(in + 3);
+        auto all = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(all, non_ascii_mask), _mm_setzero_si128())) != 0xffff) {
+            break;
+        }
+        auto bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + s), bytes);
+    }
+    return s;
+}
+
+[[gnu::target("avx2")]] static size_t narrow_ascii_avx2(uint32_t const* input, size_t size, uint8_t* output) {
+    size_t s = 0;
+    auto const non_ascii_mask = _mm256_set1_epi32(~0x7f);
+    // Packing works within 128-bit lanes, this puts 4-byte groups back in order.
+    auto const permutation = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; s + 32 <= size; s += 32) {
+        auto in = reinterpret_cast<__m256i const*>(input + s);
+        auto a = _mm256_loadu_si256(in + 0);
+        auto b = _mm256_loadu_si256(in + 1);
+        auto c = _mm256_loadu_si256(in + 2);
+        auto d = _mm256_loadu_si256(in + 3);
+        auto all = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(all, non_ascii_mask)) {
+            break;
+        }
+        auto bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + s), _mm256_permutevar8x32_epi32(bytes, permutation));
+    }
+    return s;
+}
+
+// Codepoints are unsigned, but there are no unsigned comparisons in SSE2/AVX2.
+// Flipping the sign bit makes signed comparison give the unsigned result.
+constexpr int32_t SignBit = static_cast<int32_t>(0x80000000);
+
+[[gnu::target("sse2")]] static size_t encoded_length_sse2(std::span<uint32_t const> codepoints) {
+    auto const sign = _mm_set1_epi32(SignBit);
+    __m128i const thresholds[] = {
+        _mm_set1_epi32(0x7f ^ SignBit),
+        _mm_set1_epi32(0x7ff ^ SignBit),
+        _mm_set1_epi32(0xffff ^ SignBit),
+        _mm_set1_epi32(0x1fffff ^ SignBit),
+        _mm_set1_epi32(0x3ffffff ^ SignBit),
+    };
+
+    size_t length = 0;
+    size_t s = 0;
+    while (s + 4 <= codepoints.size()) {
+        // Every iteration adds at most 5 to each 32-bit lane. Flush them
+        // regularly so that they never overflow.
+        auto sum = _mm_setzero_si128();
+        auto block_end = std::min(codepoints.size() & ~size_t { 3 }, s + (1 << 24));
+        for (; s < block_end; s += 4) {
+            auto cp = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(codepoints.data() + s)), sign);
+            for (auto const& threshold : thresholds) {
+                sum = _mm_sub_epi32(sum, _mm_cmpgt_epi32(cp, threshold));
+            }
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+        length += static_cast<size_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+    // Every codepoint takes at least 1 byte, the loop above counted only
+    // the additional ones.
+    length += s;
+    return length + encoded_length_scalar(codepoints.subspan(s));
+}
+
+[[gnu::target("avx2")]] static size_t encoded_length_avx2(std::span<uint32_t const> codepoints) {
+    auto const sign = _mm256_set1_epi32(SignBit);
+    __m256i const thresholds[] = {
+        _mm256_set1_epi32(0x7f ^ SignBit),
+        _mm256_set1_epi32(0x7ff ^ SignBit),
+        _mm256_set1_epi32(0xffff ^ SignBit),
+        _mm256_set1_epi32(0x1fffff ^ SignBit),
+        _mm256_set1_epi32(0x3ffffff ^ SignBit),
+    };
+
+    size_t length = 0;
+    size_t s = 0;
+    while (s + 8 <= codepoints.size()) {
+        auto sum = _mm256_setzero_si256();
+        auto block_end = std::min(codepoints.size() & ~size_t { 7 }, s + (1 << 24));
+        for (; s < block_end; s += 8) {
+            auto cp = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(codepoints.data() + s)), sign);
+            for (auto const& threshold : thresholds) {
+                sum = _mm256_sub_epi32(sum, _mm256_cmpgt_epi32(cp, threshold));
+            }
+        }
+        uint32_t lanes[8];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+        for (auto lane : lanes) {
+            length += lane;
+        }
+    }
+    length += s;
+    return length + encoded_length_scalar(codepoints.subspan(s));
+}
+
+#endif
+
+struct Implementation {
+    WidenAsciiFunction widen_ascii = widen_ascii_scalar;
+    NarrowAsciiFunction narrow_ascii = narrow_ascii_scalar;
+    EncodedLengthFunction encoded_length = encoded_length_scalar;
+};
+
+static Implementation select_implementation() {
+#ifdef ESSA_ARCH_X86
+    if (cpu_supports(CpuFeature::AVX2)) {
+        return { widen_ascii_avx2, narrow_ascii_avx2, encoded_length_avx2 };
+    }
+    if (cpu_supports(CpuFeature::SSE2)) {
+        return { widen_ascii_sse2, narrow_ascii_sse2, encoded_length_sse2 };
+    }
+#endif
+    return {};
+}
+
+static Implementation const& implementation() {
+    static Implementation const implementation = select_implementation();
+    return implementation;
+}
+
+static size_t encode_impl(std::span<uint8_t> output, std::span<uint32_t const> codepoints, NarrowAsciiFunction narrow_ascii) {
+    auto out = output.data();
+    size_t o = 0;
+    size_t s = 0;
+    while (s < codepoints.size()) {
+        auto codepoint = codepoints[s];
+        if (codepoint < 0x80) {
+            auto narrowed = narrow_ascii(codepoints.data() + s, codepoints.size() - s, out + o);
+            s += narrowed;
+            o += narrowed;
+            while (s < codepoints.size() && codepoints[s] < 0x80) {
+                out[o++] = codepoints[s++];
+            }
+            continue;
+        }
+
+        assert(o + bytes_required_to_store_codepoint(codepoint) <= output.size());
+        if (codepoint < 0x800) {
+            out[o++] = 0b1100'0000 | ((codepoint & 0b11111'000000) >> 6);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111));
+        }
+        else if (codepoint < 0x10000) {
+            out[o++] = 0b1110'0000 | ((codepoint & 0b1111'000000'000000) >> 12);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000) >> 6);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111));
+        }
+        else if (codepoint < 0x200000) {
+            out[o++] = 0b1111'0000 | ((codepoint & 0b1110'000000'000000'000000) >> 18);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000'000000) >> 12);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000) >> 6);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111));
+        }
+        else if (codepoint < 0x4000000) {
+            out[o++] = 0b1111'1000 | ((codepoint & 0b1100'000000'000000'000000'000000) >> 24);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000'000000'000000) >> 18);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000'000000) >> 12);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000) >> 6);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111));
+        }
+        else {
+            out[o++] = 0b1111'1100 | ((codepoint & 0b1000'000000'000000'000000'000000'000000) >> 30);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000'000000'000000'000000) >> 24);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000'000000'000000) >> 18);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000'000000) >> 12);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111'000000) >> 6);
+            out[o++] = 0b1000'0000 | ((codepoint & 0b111111));
+        }
+        s++;
+    }
+    return o;
+}
+
+static DecodeResult decode_impl(std::span<uint32_t> output, std::string_view string, uint32_t replacement, WidenAsciiFunction widen_ascii) {
+    assert(output.size() >= string.size());
+    auto input = reinterpret_cast<uint8_t const*>(string.data());
+    auto size = string.size();
+    auto out = output.data();
+
+    DecodeResult result;
+    size_t s = 0;
+    while (s < size) {
+        auto byte = input[s];
+        if (byte < 0x80) {
+            auto widened = widen_ascii(input + s, size - s, out + result.codepoints);
+            s += widened;
+            result.codepoints += widened;
+            while (s < size && input[s] < 0x80) {
+                out[result.codepoints++] = input[s++];
+            }
+            continue;
+        }
+
+        // 2..6 leading ones is a lead byte of multibyte sequence. 1 is a
+        // continuation byte that has nothing to continue, and 7+ is never
+        // valid.
+        auto leading_ones = std::countl_one(byte);
+        if (leading_ones < 2 || leading_ones > 6) {
+            result.valid = false;
+            out[result.codepoints++] = replacement;
+            s++;
+            continue;
+        }
+
+        uint32_t codepoint = byte & (0x7f >> leading_ones);
+        size_t t = s + 1;
+        size_t sequence_end = s + leading_ones;
+        for (; t < sequence_end && t < size; t++) {
+            if ((input[t] & 0b1100'0000) != 0b1000'0000) {
+                break;
+            }
+            codepoint = (codepoint << 6) | (input[t] & 0b11'1111);
+        }
+        if (t != sequence_end) {
+            // Unfinished sequence. Replace it and restart at the byte
+            // that interrupted it.
+            result.valid = false;
+            out[result.codepoints++] = replacement;
+            s = t;
+            continue;
+        }
+        out[result.codepoints++] = codepoint;
+        s = sequence_end;
+    }
+    return result;
+}
+
+DecodeResult decode(std::span<uint32_t> output, std::string_view input, uint32_t replacement) {
+    return decode_impl(output, input, replacement, implementation().widen_ascii);
+}
+
+DecodeResult decode_scalar(std::span<uint32_t> output, std::string_view input, uint32_t replacement) {
+    return decode_impl(output, input, replacement, widen_ascii_scalar);
+}
+
+// Length of the sequence started by a lead byte, 0 if it isn't one.
+static size_t sequence_length(uint8_t byte) {
+    auto leading_ones = std::countl_one(byte);
+    return leading_ones >= 2 && leading_ones <= 6 ? leading_ones : 0;
+}
+
+static bool is_continuation_byte(uint8_t byte) {
+    return (byte & 0b1100'0000) == 0b1000'0000;
+}
+
+// Count of bytes at the end of input that are a lead byte followed by
+// continuation bytes, but not all that the sequence needs. These may be
+// finished by the next chunk.
+static size_t unfinished_sequence_length(std::string_view input) {
+    auto bytes = reinterpret_cast<uint8_t const*>(input.data());
+    for (size_t s = 1; s <= std::min(input.size(), StreamingDecoder::MaxPendingBytes); s++) {
+        auto byte = bytes[input.size() - s];
+        if (is_continuation_byte(byte)) {
+            continue;
+        }
+        return sequence_length(byte) > s ? s : 0;
+    }
+    return 0;
+}
+
+DecodeResult StreamingDecoder::decode(std::span<uint32_t> output, std::string_view input) {
+    DecodeResult result;
+    if (m_pending_size > 0) {
+        // Take the rest of the sequence, but stop at a byte that can't
+        // continue it, so that it's decoded as a part of the chunk.
+        auto needed = sequence_length(m_pending[0]);
+        size_t taken = 0;
+        while (m_pending_size < needed && taken < input.size() && is_continuation_byte(input[taken])) {
+            m_pending[m_pending_size++] = input[taken++];
+        }
+        input.remove_prefix(taken);
+        if (m_pending_size < needed && input.empty()) {
+            return result;
+        }
+        result = Utf8::decode(output, { reinterpret_cast<char const*>(m_pending), m_pending_size }, m_replacement);
+        m_pending_size = 0;
+    }
+
+    auto unfinished = unfinished_sequence_length(input);
+    auto chunk_result = Utf8::decode(output.subspan(result.codepoints), input.substr(0, input.size() - unfinished), m_replacement);
+    std::copy(input.end() - unfinished, input.end(), m_pending);
+    m_pending_size = unfinished;
+    return { .codepoints = result.codepoints + chunk_result.codepoints, .valid = result.valid && chunk_result.valid };
+}
+
+DecodeResult StreamingDecoder::finish(std::span<uint32_t> output) {
+    auto result = Utf8::decode(output, { reinterpret_cast<char const*>(m_pending), m_pending_size }, m_replacement);
+    m_pending_size = 0;
+    return result;
+}
+
+size_t encoded_length(std::span<uint32_t const> codepoints) {
+    return implementation().encoded_length(codepoints);
+}
+
+size_t encode(std::span<uint8_t> output, std::span<uint32_t const> codepoints) {
+    return encode_impl(output, codepoints, implementation().narrow_ascii);
+}
+
+size_t encoded_length_scalar(std::span<uint32_t const> codepoints) {
+    size_t length = 0;
+    for (auto codepoint : codepoints) {
+        length += bytes_required_to_store_codepoint(codepoint);
+    }
+    return length;
+}
+
+size_t encode_scalar(std::span<uint8_t> output, std::span<uint32_t const> codepoints) {
+    return encode_impl(output, codepoints, narrow_ascii_scalar);
+}
+
+}
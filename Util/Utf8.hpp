@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace Util::Utf8 {
+
+struct DecodeResult {
+    // Count of codepoints written to the output.
+    size_t codepoints = 0;
+
+    // False if there was any invalid or truncated sequence in the input.
+    // These are replaced with the replacement character.
+    bool valid = true;
+};
+
+// Decode UTF-8 string to UTF-32 in a single pass. `output` must have space for
+// at least `input.size()` codepoints (UTF-8 never decodes to more codepoints
+// than bytes). Runs of ASCII characters are widened with SIMD if the CPU
+// supports it (selected at runtime).
+DecodeResult decode(std::span<uint32_t> output, std::string_view input, uint32_t replacement = 0xfffd);
+
+// Same as decode(), but never uses SIMD. Used as a fallback on platforms
+// that don't support it, and as a reference for benchmarks.
+DecodeResult decode_scalar(std::span<uint32_t> output, std::string_view input, uint32_t replacement = 0xfffd);
+
+// Decoder for UTF-8 that comes in chunks, e.g from a stream. Sequences that
+// are split between chunks are kept until the next chunk, so the result is
+// the same as if the input was decoded at once.
+class StreamingDecoder {
+public:
+    // Maximum count of bytes kept between chunks (a 6-byte sequence
+    // without its last byte).
+    static constexpr size_t MaxPendingBytes = 5;
+
+    explicit StreamingDecoder(uint32_t replacement = 0xfffd)
+        : m_replacement(replacement) { }
+
+    // Decode a chunk. `output` must have space for at least `input.size() +
+    // MaxPendingBytes` codepoints.
+    DecodeResult decode(std::span<uint32_t> output, std::string_view input);
+
+    // Call at the end of input. Replaces sequence that was left unfinished,
+    // if any. `output` must have space for at least MaxPendingBytes
+    // codepoints.
+    DecodeResult finish(std::span<uint32_t> output);
+
+    bool has_pending_bytes() const { return m_pending_size > 0; }
+
+private:
+    uint32_t m_replacement;
+    uint8_t m_pending[MaxPendingBytes + 1];
+    size_t m_pending_size = 0;
+};
+
+// Count of bytes needed to store a codepoint in UTF-8.
+constexpr size_t bytes_required_to_store_codepoint(uint32_t codepoint) {
+    if (codepoint < 0x80)
+        return 1;
+    if (codepoint < 0x800)
+        return 2;
+    if (codepoint < 0x10000)
+        return 3;
+    if (codepoint < 0x200000)
+        return 4;
+    if (codepoint < 0x4000000)
+        return 5;
+    return 6;
+}
+
+// Exact count of bytes that encode() will write for `codepoints`.
+size_t encoded_length(std::span<uint32_t const> codepoints);
+
+// Encode UTF-32 to UTF-8. `output` must have space for at least
+// encoded_length(codepoints) bytes. Returns count of bytes written. Runs of
+// ASCII characters are narrowed with SIMD if the CPU supports it.
+size_t encode(std::span<uint8_t> output, std::span<uint32_t const> codepoints);
+
+// Same as encode() and encoded_length(), but never use SIMD.
+size_t encoded_length_scalar(std::span<uint32_t const> codepoints);
+size_t encode_scalar(std::span<uint8_t> output, std::span<uint32_t const> codepoints);
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Endianness.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+
+// Unsigned LEB128 ("varint", as in protobuf): 7 bits per byte, least
+// significant group first, with the high bit set on all bytes but the
+// last. Values below 128 take 1 byte, 64-bit values take up to 10.
+namespace Util::Varint {
+
+constexpr size_t MaxSize = 10;
+
+constexpr size_t encoded_size(uint64_t value) {
+    return std::max<size_t>(1, (std::bit_width(value) + 6) / 7);
+}
+
+// Write `value` to `output`, which must have at least MaxSize bytes.
+// Returns the encoded size.
+inline size_t encode(uint64_t value, uint8_t* output) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        output[size++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    output[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+// Map signed values to unsigned, so that ones close to zero (of any sign)
+// get short encodings: 0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...
+constexpr uint64_t zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+constexpr int64_t zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>((value >> 1) ^ -(value & 1));
+}
+
+struct Decoded {
+    uint64_t value;
+
+    // Count of bytes that the value took, 0 if data ends in the middle of
+    // it.
+    size_t size;
+};
+
+// Decode a value from the beginning of `data`. Returns an empty optional
+// if the value doesn't fit in 64 bits, or if it is overlong (ends with a
+// zero group after a continuation byte, e.g 0x80 0x00), so that every value
+// has exactly one encoding.
+inline std::optional<Decoded> decode(std::span<uint8_t const> data) {
+    // Most common case
+    if (!data.empty() && data[0] < 0x80) {
+        return Decoded { data[0], 1 };
+    }
+    uint64_t value = 0;
+    size_t s = 0;
+    if (data.size() >= 8) {
+        // Find the last byte and gather 7-bit groups of up to 8 bytes at
+        // once, without branching on every byte.
+        uint64_t word;
+        std::memcpy(&word, data.data(), sizeof(word));
+        word = convert_from_little_to_host_endian(word);
+        auto last_bytes = ~word & 0x8080808080808080;
+        size_t size = last_bytes != 0 ? static_cast<size_t>(std::countr_zero(last_bytes)) / 8 + 1 : 8;
+        if (size < 8) {
+            word &= (uint64_t { 1 } << (size * 8)) - 1;
+        }
+        word &= 0x7f7f7f7f7f7f7f7f;
+        word = ((word & 0x7f007f007f007f00) >> 1) | (word & 0x007f007f007f007f);
+        word = ((word & 0x3fff00003fff0000) >> 2) | (word & 0x00003fff00003fff);
+        word = ((word & 0x0fffffff00000000) >> 4) | (word & 0x000000000fffffff);
+        if (last_bytes != 0) {
+            if (size > 1 && data[size - 1] == 0) {
+                return {};
+            }
+            return Decoded { word, size };
+        }
+        value = word;
+        s = 8;
+    }
+
+    for (; s < std::min(data.size(), MaxSize); s++) {
+        auto group = static_cast<uint64_t>(data[s] & 0x7f);
+        if (s == MaxSize - 1 && group > 1) {
+            return {};
+        }
+        value |= group << (s * 7);
+        if (!(data[s] & 0x80)) {
+            if (s > 0 && data[s] == 0) {
+                return {};
+            }
+            return Decoded { value, s + 1 };
+        }
+    }
+    if (data.size() >= MaxSize) {
+        return {};
+    }
+    return Decoded { 0, 0 };
+}
+
+}
@@ -1,3 +1,4 @@
 include(${CMAKE_CURRENT_LIST_DIR}/EssaUtil.cmake)
 include(${CMAKE_CURRENT_LIST_DIR}/utils.cmake)
 find_package(fmt REQUIRED)
+find_package(Threads REQUIRED)